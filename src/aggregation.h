@@ -0,0 +1,297 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unit_description.h"
+#include "utils.h"
+
+/**
+ * @brief Statistics of a measurement over an aggregation window
+ *
+ * All values are raw values as in the process image, scaled up as described by their
+ * UnitDescription @see result_value
+ */
+typedef struct Aggregate {
+    int64_t min;        ///< The smallest value in the window
+    int64_t max;        ///< The largest value in the window
+    int64_t mean;       ///< The arithmetic mean of all values in the window, rounded to the nearest
+    int64_t last;       ///< The most recent value in the window
+    uint32_t count;     ///< The number of values in the window
+} Aggregate;
+
+/**
+ * @brief The running aggregate of a single measurement of a module
+ */
+typedef struct AggregationSlot {
+    Aggregate current;      ///< The aggregate of the current window, empty if count is 0
+    int64_t sum;            ///< The sum of all values in the current window
+    uint64_t windowEndMs;   ///< When the current window ends, in milliseconds since the epoch
+} AggregationSlot;
+
+/**
+ * @brief The completed aggregates of a module which have not been taken yet
+ *
+ * The arrays hold one entry for each measurement of the module.
+ */
+typedef struct PendingAggregates {
+    Aggregate *aggregates;      ///< The completed aggregates
+    int64_t *sums;              ///< The sums of their values, to merge further windows into them exactly
+    uint32_t *means;            ///< The mean of each completed aggregate as a raw value
+    bool *completed;            ///< Whether each aggregate has been completed
+    struct timespec timestamp;  ///< The end of the latest completed window
+    bool pending;               ///< Whether any aggregate has been completed since the last one was taken
+} PendingAggregates;
+
+/**
+ * @brief Aggregates the completed ResultSets of all modules over the windows of their measurements
+ *
+ * Every completed ResultSet is added as soon as it is complete, so the aggregates describe
+ * all values read, no matter how fast they can be published. Completed aggregates are kept
+ * for each module until they are taken, and can be handed to the publisher from there
+ * without copying them first @see aggregator_pending. If further windows complete in the
+ * meantime, they are merged into the waiting aggregates, which then cover all of these
+ * windows; single measurements are replaced by their latest value.
+ */
+typedef struct Aggregator {
+    AggregationSlot *slots;                         ///< size slots for each module
+    size_t size;                                    ///< The number of measurements per module
+    size_t moduleCount;                             ///< The number of modules
+    PendingAggregates *pending;                     ///< The completed aggregates of each module
+    Aggregate *aggregates;                          ///< size entries for each module, @see PendingAggregates
+    int64_t *sums;                                  ///< size entries for each module
+    uint32_t *means;                                ///< size entries for each module
+    bool *completed;                                ///< size entries for each module
+} Aggregator;
+
+/**
+ * @brief Returns the statistics of a value of a ResultSet if it has been aggregated over a window
+ *
+ * @retval The aggregate of the value, or NULL if it is a single measurement
+ */
+const Aggregate *result_aggregate(const ResultSet *results, size_t index) {
+    if (results->aggregates == NULL || results->descriptions[index]->aggregationWindowMs == 0) {
+        return NULL;
+    }
+    return &results->aggregates[index];
+}
+
+/**
+ * @brief Frees the state of an aggregator
+ */
+void aggregator_destroy(Aggregator *aggregator) {
+    free(aggregator->slots);
+    free(aggregator->pending);
+    free(aggregator->aggregates);
+    free(aggregator->sums);
+    free(aggregator->means);
+    free(aggregator->completed);
+    aggregator->slots = NULL;
+    aggregator->pending = NULL;
+    aggregator->aggregates = NULL;
+    aggregator->sums = NULL;
+    aggregator->means = NULL;
+    aggregator->completed = NULL;
+}
+
+/**
+ * @brief Allocates the state of an aggregator
+ *
+ * @param[out] aggregator The aggregator to initialize
+ * @param[in] size The number of measurements per module
+ * @param[in] moduleCount The number of power measurement modules
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode aggregator_init(Aggregator *aggregator, size_t size, size_t moduleCount) {
+    if (size > RESULT_SET_MAX_VALUES) {
+        return -ERROR_TOO_MANY_MEASUREMENTS;
+    }
+    aggregator->slots = calloc(size * moduleCount, sizeof(AggregationSlot));
+    aggregator->pending = calloc(moduleCount, sizeof(PendingAggregates));
+    aggregator->aggregates = calloc(size * moduleCount, sizeof(Aggregate));
+    aggregator->sums = calloc(size * moduleCount, sizeof(int64_t));
+    aggregator->means = calloc(size * moduleCount, sizeof(uint32_t));
+    aggregator->completed = calloc(size * moduleCount, sizeof(bool));
+    if (aggregator->slots == NULL || aggregator->pending == NULL || aggregator->aggregates == NULL
+        || aggregator->sums == NULL || aggregator->means == NULL || aggregator->completed == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the aggregator\n");
+        aggregator_destroy(aggregator);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    for (size_t module = 0; module < moduleCount; module++) {
+        aggregator->pending[module] = (PendingAggregates) {
+            .aggregates = &aggregator->aggregates[module * size],
+            .sums = &aggregator->sums[module * size],
+            .means = &aggregator->means[module * size],
+            .completed = &aggregator->completed[module * size]
+        };
+    }
+    aggregator->size = size;
+    aggregator->moduleCount = moduleCount;
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Adds a value to the aggregate of a slot
+ *
+ * The raw values are summed up exactly in 64 bits, which holds more than 2^31 values of
+ * 32 bits each, far more than any window of a few seconds.
+ */
+void aggregate_add(AggregationSlot *slot, int64_t value) {
+    Aggregate *aggregate = &slot->current;
+    if (aggregate->count == 0) {
+        aggregate->min = value;
+        aggregate->max = value;
+        slot->sum = value;
+    } else {
+        if (value < aggregate->min) {
+            aggregate->min = value;
+        }
+        if (value > aggregate->max) {
+            aggregate->max = value;
+        }
+        slot->sum += value;
+    }
+    aggregate->last = value;
+    aggregate->count++;
+}
+
+/**
+ * @brief Computes the mean of a sum of values
+ *
+ * The mean is rounded half away from zero, so it is exact to the resolution of the process image.
+ */
+int64_t aggregate_mean(int64_t sum, int64_t count) {
+    const int64_t half = sum < 0 ? -count / 2 : count / 2;
+    return (sum + half) / count;
+}
+
+/**
+ * @brief Completes the aggregate of a slot and adds it to the pending aggregates of its module
+ *
+ * An aggregate still pending from an earlier window is extended to cover this one as well.
+ *
+ * @param[inout] slot The slot whose window has ended
+ * @param[inout] pending The pending aggregates of the module
+ * @param[in] index The position of the measurement
+ */
+void aggregate_complete(AggregationSlot *slot, PendingAggregates *pending, size_t index) {
+    Aggregate *aggregate = &pending->aggregates[index];
+    if (!pending->completed[index]) {
+        *aggregate = slot->current;
+        pending->sums[index] = slot->sum;
+        pending->completed[index] = true;
+    } else {
+        if (slot->current.min < aggregate->min) {
+            aggregate->min = slot->current.min;
+        }
+        if (slot->current.max > aggregate->max) {
+            aggregate->max = slot->current.max;
+        }
+        aggregate->last = slot->current.last;
+        aggregate->count += slot->current.count;
+        pending->sums[index] += slot->sum;
+    }
+    aggregate->mean = aggregate_mean(pending->sums[index], aggregate->count);
+    pending->means[index] = (uint32_t)aggregate->mean;
+}
+
+/**
+ * @brief Adds a completed ResultSet to the aggregates of its module
+ *
+ * Windows are aligned to multiples of their length since the epoch, so the aggregates of all
+ * modules cover the same periods. A window is completed by the first value past its end.
+ * Measurements without an aggregation window are completed with every value. Values missing
+ * from the ResultSet are skipped. The completed aggregates are added to the pending ones of
+ * the module, timestamped with the end of their windows.
+ *
+ * @param[in] aggregator The aggregator
+ * @param[in] results The completed ResultSet, timestamped
+ * @retval true if the module has pending aggregates, false otherwise
+ */
+bool aggregator_add(Aggregator *aggregator, const ResultSet *results) {
+    if (results->moduleIndex >= aggregator->moduleCount || results->size != aggregator->size) {
+        return false;
+    }
+    AggregationSlot *slots = &aggregator->slots[results->moduleIndex * aggregator->size];
+    PendingAggregates *pending = &aggregator->pending[results->moduleIndex];
+    uint64_t nowMs = (uint64_t)results->timestamp.tv_sec * 1000 + results->timestamp.tv_nsec / 1000000;
+    uint64_t windowEndMs = 0;
+    bool anyCompleted = false;
+
+    for (size_t i = 0; i < results->size; i++) {
+        const unsigned windowMs = results->descriptions[i]->aggregationWindowMs;
+        AggregationSlot *slot = &slots[i];
+
+        if (!result_included(results, i)) {
+            continue;
+        }
+        if (slot->current.count > 0 && nowMs >= slot->windowEndMs) {
+            aggregate_complete(slot, pending, i);
+            if (slot->windowEndMs > windowEndMs) {
+                windowEndMs = slot->windowEndMs;
+            }
+            slot->current.count = 0;
+            anyCompleted = true;
+        }
+        const int64_t value = result_value(results, i);
+        if (windowMs == 0) {
+            pending->aggregates[i] = (Aggregate){ .min = value, .max = value, .mean = value, .last = value, .count = 1 };
+            pending->means[i] = results->values[i];
+            pending->completed[i] = true;
+            anyCompleted = true;
+        } else {
+            if (slot->current.count == 0) {
+                // dividing only when a new window starts keeps this cheap on 32-bit targets
+                slot->windowEndMs = (nowMs / windowMs + 1) * windowMs;
+            }
+            aggregate_add(slot, value);
+        }
+    }
+
+    if (anyCompleted) {
+        struct timespec timestamp = results->timestamp;
+        if (windowEndMs > 0) {
+            timestamp.tv_sec = windowEndMs / 1000;
+            timestamp.tv_nsec = (windowEndMs % 1000) * 1000000;
+        }
+        // aggregates merged into pending ones cover the later windows as well
+        if (!pending->pending || timestamp.tv_sec > pending->timestamp.tv_sec
+            || (timestamp.tv_sec == pending->timestamp.tv_sec && timestamp.tv_nsec > pending->timestamp.tv_nsec)) {
+            pending->timestamp = timestamp;
+        }
+        pending->pending = true;
+    }
+    return pending->pending;
+}
+
+/**
+ * @brief Returns the pending aggregates of a module
+ *
+ * @param[in] aggregator The aggregator
+ * @param[in] module The index of the module
+ * @retval The pending aggregates, or NULL if none have been completed since they were last taken
+ */
+const PendingAggregates *aggregator_pending(const Aggregator *aggregator, size_t module) {
+    const PendingAggregates *pending = &aggregator->pending[module];
+    return pending->pending ? pending : NULL;
+}
+
+/**
+ * @brief Marks the pending aggregates of a module as taken, after they have been copied
+ *
+ * @param[in] aggregator The aggregator
+ * @param[in] module The index of the module
+ */
+void aggregator_taken(Aggregator *aggregator, size_t module) {
+    PendingAggregates *pending = &aggregator->pending[module];
+    memset(pending->completed, 0, aggregator->size * sizeof(bool));
+    pending->pending = false;
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mqtt.h"
+#include "utils.h"
+
+#define BATCH_MAX_FRAMES 256        ///< Upper limit for the number of frames in a batch
+#define BATCH_VARINT_MAX_LENGTH 10  ///< The longest encoding of a 64-bit varint
+#define BATCH_FRAME_OVERHEAD 6      ///< Room for the field tag and length in front of each frame
+
+/**
+ * @brief The settings of the batching of ResultSets @see config_load
+ */
+typedef struct BatchSettings {
+    bool enabled;           ///< Whether the ResultSets of all modules are sent in batches
+    size_t maxBytes;        ///< A batch is sent before it would grow larger than this
+    unsigned maxFrames;     ///< A batch is sent once it holds this many frames
+    unsigned maxAgeMs;      ///< A batch is sent once its oldest frame has waited this long
+} BatchSettings;
+
+/**
+ * @brief Completed ResultSets of any modules, collected to be sent as one message
+ *
+ * With the protocol buffer formats, a batch is a BatchMsg as defined in
+ * protobuf/result_set.proto. The frames are encoded without their timestamps and written
+ * behind a reserved area as they arrive, with the field tag and length of each in front of
+ * it. Once the batch is complete, the timestamp of its first frame and the offsets of all
+ * frames to it are written right in front of the frames, so the message is sent without
+ * copying it again. With the text formats, the frames keep their timestamps and are simply
+ * joined: JSON objects to a JSON array, InfluxDB lines one after the other and plain text
+ * messages separated by an empty line.
+ *
+ * The batch is only used by the publisher thread.
+ */
+typedef struct Batch {
+    uint8_t *buf;
+    size_t reserved;            ///< The size of the area in front of the frames
+    size_t capacity;            ///< The size of the area for the frames
+    size_t length;              ///< The bytes of frames written so far
+    size_t frames;              ///< The number of frames written so far
+    size_t offsetsLength;       ///< The encoded length of the timestamp offsets
+    uint64_t base;              ///< The timestamp of the first frame in nanoseconds since the epoch
+    int64_t offsets[BATCH_MAX_FRAMES];  ///< The timestamps of the frames relative to base
+    struct timespec started;    ///< When the first frame was added
+    PayloadFormat format;
+    BatchSettings settings;
+    uint64_t sent;              ///< Number of batches completed
+} Batch;
+
+/**
+ * @brief Returns the length of the varint encoding of a value
+ */
+size_t batch_varint_size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Writes a value as a varint
+ *
+ * @retval The number of bytes written
+ */
+size_t batch_put_varint(uint8_t *out, uint64_t value) {
+    size_t i = 0;
+    while (value >= 0x80) {
+        out[i++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[i++] = (uint8_t)value;
+    return i;
+}
+
+/**
+ * @brief Returns the zigzag encoding of a signed value, as used by sint64
+ */
+uint64_t batch_zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/**
+ * @brief Checks whether the frames of the configured payload format share their timestamp
+ */
+bool batch_shares_timestamps(const Batch *batch) {
+    return batch->format == PAYLOAD_PROTOBUF || batch->format == PAYLOAD_MEASUREMENT_SET;
+}
+
+/**
+ * @brief Returns the length of the BatchMsg fields in front of the frames
+ */
+size_t batch_header_length(size_t offsetsLength) {
+    // timestamp: tag and fixed64, timestamp_offset: tag, length and the packed varints
+    return 1 + 8 + 1 + batch_varint_size(offsetsLength) + offsetsLength;
+}
+
+/**
+ * @brief Computes the length the batch would have with another frame
+ *
+ * @param[in] batch The batch
+ * @param[in] timestamp The timestamp of the frame in nanoseconds since the epoch
+ * @param[in] length The length of the encoded frame
+ * @retval The length of the whole message including the frame
+ */
+size_t batch_length_with(const Batch *batch, uint64_t timestamp, size_t length) {
+    if (!batch_shares_timestamps(batch)) {
+        // a separator in front of the frame and the closing bracket of a JSON array
+        return 1 + batch->length + length + 1;
+    }
+    const int64_t offset = batch->frames == 0 ? 0 : (int64_t)(timestamp - batch->base);
+    return batch_header_length(batch->offsetsLength + batch_varint_size(batch_zigzag(offset)))
+           + batch->length + 1 + batch_varint_size(length) + length;
+}
+
+/**
+ * @brief Allocates the buffer of a batch
+ *
+ * The buffer always has room for a single frame of maxFrameLength, even if max_bytes is
+ * smaller, so such a frame is sent in a batch of its own.
+ *
+ * @param[out] batch The batch to initialize
+ * @param[in] settings The flush triggers
+ * @param[in] format The payload format of the frames
+ * @param[in] maxFrameLength The maximum length of an encoded frame
+ * @retval ERROR_SUCCESS on success, -ERROR_ALLOCATION_FAILED otherwise
+ */
+ErrorCode batch_init(Batch *batch, const BatchSettings *settings, PayloadFormat format, size_t maxFrameLength) {
+    memset(batch, 0, sizeof(Batch));
+    batch->settings = *settings;
+    batch->format = format;
+    batch->reserved = batch_header_length(BATCH_VARINT_MAX_LENGTH * BATCH_MAX_FRAMES);
+    batch->capacity = settings->maxBytes > maxFrameLength + BATCH_FRAME_OVERHEAD
+                      ? settings->maxBytes : maxFrameLength + BATCH_FRAME_OVERHEAD;
+    batch->buf = malloc(batch->reserved + batch->capacity);
+    if (batch->buf == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the batch buffer\n");
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Frees the buffer of a batch
+ */
+void batch_destroy(Batch *batch) {
+    free(batch->buf);
+    batch->buf = NULL;
+}
+
+/**
+ * @brief Returns the maximum length of a completed batch
+ */
+size_t batch_max_length(const Batch *batch) {
+    return batch->reserved + batch->capacity;
+}
+
+/**
+ * @brief Checks whether a frame can be added without exceeding max_bytes
+ *
+ * An empty batch takes any frame up to the maximum length given to batch_init().
+ *
+ * @param[in] batch The batch
+ * @param[in] timestamp The timestamp of the frame
+ * @param[in] length The length of the encoded frame
+ */
+bool batch_fits(const Batch *batch, const struct timespec *timestamp, size_t length) {
+    const uint64_t ns = (uint64_t)timestamp->tv_sec * 1000000000 + timestamp->tv_nsec;
+    if (batch->length + BATCH_FRAME_OVERHEAD + length > batch->capacity) {
+        return false;
+    }
+    return batch->frames == 0
+           || (batch->frames < batch->settings.maxFrames
+               && batch_length_with(batch, ns, length) <= batch->settings.maxBytes);
+}
+
+/**
+ * @brief Adds an encoded frame to the batch, which has to fit @see batch_fits
+ *
+ * @param[in] batch The batch
+ * @param[in] timestamp The timestamp of the frame, which with the protocol buffer formats
+ *            has to be left out of the frame itself
+ * @param[in] frame The encoded frame
+ * @param[in] length The length of the encoded frame
+ */
+void batch_add(Batch *batch, const struct timespec *timestamp, const uint8_t *frame, size_t length) {
+    uint8_t *out = batch->buf + batch->reserved + batch->length;
+    const uint64_t ns = (uint64_t)timestamp->tv_sec * 1000000000 + timestamp->tv_nsec;
+
+    if (batch->frames == 0) {
+        batch->base = ns;
+        clock_gettime(CLOCK_MONOTONIC, &batch->started);
+    }
+    if (batch_shares_timestamps(batch)) {
+        const int64_t offset = (int64_t)(ns - batch->base);
+        batch->offsets[batch->frames] = offset;
+        batch->offsetsLength += batch_varint_size(batch_zigzag(offset));
+        // result_set = 3 or measurement_set = 4, both length-delimited
+        *out++ = (batch->format == PAYLOAD_PROTOBUF ? 3 : 4) << 3 | 2;
+        out += batch_put_varint(out, length);
+    } else if (batch->frames > 0 && batch->format == PAYLOAD_JSON) {
+        *out++ = ',';
+    } else if (batch->frames > 0 && batch->format == PAYLOAD_TEXT) {
+        *out++ = '\n';
+    }
+    memcpy(out, frame, length);
+    batch->length = out + length - (batch->buf + batch->reserved);
+    batch->frames++;
+}
+
+/**
+ * @brief Checks whether the batch holds as many frames as it may
+ */
+bool batch_full(const Batch *batch) {
+    return batch->frames >= batch->settings.maxFrames;
+}
+
+/**
+ * @brief Returns the time until the oldest frame of the batch has waited max_age_ms
+ *
+ * @param[in] batch The batch
+ * @retval The remaining time in ms, 0 if the batch is due, or UINT64_MAX if it is empty
+ */
+uint64_t batch_remaining_ms(const Batch *batch) {
+    if (batch->frames == 0) {
+        return UINT64_MAX;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t ageMs = elapsed_ns(&batch->started, &now) / 1000000;
+    return ageMs >= batch->settings.maxAgeMs ? 0 : batch->settings.maxAgeMs - ageMs;
+}
+
+/**
+ * @brief Completes the batch and empties it for the next frames
+ *
+ * The message stays valid until the next frame is added.
+ *
+ * @param[in] batch The batch holding at least one frame
+ * @param[out] length The length of the message
+ * @retval A pointer to the message
+ */
+const uint8_t *batch_finish(Batch *batch, size_t *length) {
+    uint8_t *frames = batch->buf + batch->reserved;
+    uint8_t *start;
+
+    if (batch_shares_timestamps(batch)) {
+        start = frames - batch_header_length(batch->offsetsLength);
+        uint8_t *out = start;
+        // timestamp = 1, fixed64 in little endian
+        *out++ = 1 << 3 | 1;
+        for (size_t i = 0; i < 8; i++) {
+            *out++ = (uint8_t)(batch->base >> (8 * i));
+        }
+        // timestamp_offset = 2, packed
+        *out++ = 2 << 3 | 2;
+        out += batch_put_varint(out, batch->offsetsLength);
+        for (size_t i = 0; i < batch->frames; i++) {
+            out += batch_put_varint(out, batch_zigzag(batch->offsets[i]));
+        }
+        *length = frames + batch->length - start;
+    } else if (batch->format == PAYLOAD_JSON) {
+        start = frames - 1;
+        *start = '[';
+        frames[batch->length] = ']';
+        *length = batch->length + 2;
+    } else {
+        start = frames;
+        *length = batch->length;
+    }
+
+    batch->length = 0;
+    batch->frames = 0;
+    batch->offsetsLength = 0;
+    batch->sent++;
+    return start;
+}
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef COLLECTION_H
 #define COLLECTION_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @brief The collection ID to query measurement values from
  */
@@ -11,6 +15,41 @@ typedef enum COL_ID {
     HARMONIC_ANALYSIS_L3 = 22
 } COL_ID;
 
+#define COLLECTION_COUNT 4      ///< Number of collections in COL_ID @see collection_slot
+#define HARMONIC_PHASE_COUNT 3  ///< Number of harmonic analysis collections, one per phase
+
+/**
+ * @brief Maps a collection ID to a dense index for lookup tables with an entry per collection
+ *
+ * @param[in] colID The collection ID @see COL_ID
+ * @retval The index of the collection, or COLLECTION_COUNT if the collection is unknown
+ */
+size_t collection_slot(uint8_t colID) {
+    switch (colID) {
+        case AC_MEASUREMENT: return 0;
+        case HARMONIC_ANALYSIS_L1: return 1;
+        case HARMONIC_ANALYSIS_L2: return 2;
+        case HARMONIC_ANALYSIS_L3: return 3;
+        default: return COLLECTION_COUNT;
+    }
+}
+
+/**
+ * @brief Checks whether a collection is one of the harmonic analysis collections
+ */
+bool is_harmonic_collection(uint8_t colID) {
+    return colID >= HARMONIC_ANALYSIS_L1 && colID <= HARMONIC_ANALYSIS_L3;
+}
+
+/**
+ * @brief The measurement collections for the harmonic analysis of each phase
+ *
+ * The measurement ID is the order of the current harmonic, from the fundamental (order 1)
+ * up to HARMONIC_MAX_ORDER. Each value is the amplitude of the harmonic relative to the
+ * fundamental.
+ */
+#define HARMONIC_MAX_ORDER 41
+
 /**
  * @brief The measurement collection for the AC measurement
  */
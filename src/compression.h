@@ -0,0 +1,233 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef PAYLOAD_COMPRESSION
+#include <zlib.h>
+#endif
+
+#include "cycle_stats.h"
+#include "utils.h"
+
+#define COMPRESSION_PATH_LENGTH 128         ///< Maximum length of the path of the dictionary, including the terminator
+#define COMPRESSION_DICTIONARY_MAX 32768    ///< Deflate only looks back this far, so more of a dictionary is never used
+#define COMPRESSION_CONTENT_ENCODING "zlib" ///< The value of the content-encoding user property of compressed messages
+
+/**
+ * @brief The settings of the payload compression @see config_load
+ */
+typedef struct CompressionSettings {
+    bool enabled;
+    size_t minBytes;                            ///< Shorter payloads are sent as they are
+    int level;                                  ///< The zlib compression level, 1 (fastest) to 9 (smallest)
+    char dictionary[COMPRESSION_PATH_LENGTH];   ///< The preset dictionary, empty for none
+} CompressionSettings;
+
+/**
+ * @brief Compresses payloads with zlib and a preset dictionary
+ *
+ * Payloads of at least minBytes are compressed into the zlib format (RFC 1950), and sent
+ * compressed if that makes them smaller, with a content-encoding user property of "zlib".
+ * Text payloads and batches repeat the same descriptions, units and similar numbers in every
+ * message, most of which the dictionary takes care of even in the first bytes of a message.
+ * The dictionary is a file of typical payloads, e.g. recorded from the broker, with the most
+ * common content at its end. Receivers need the same file to decompress the messages, and the
+ * zlib header of every message carries the Adler-32 checksum of the dictionary it was
+ * compressed with.
+ *
+ * The CPU time spent on each message is measured on the calling thread and part of the
+ * statistics, along with the bytes saved. The compressor is only used by the publisher
+ * thread. Without PAYLOAD_COMPRESSION defined at compile time, it is never enabled.
+ */
+typedef struct Compressor {
+    bool enabled;
+#ifdef PAYLOAD_COMPRESSION
+    z_stream stream;
+#endif
+    uint8_t *dictionary;
+    size_t dictionaryLength;
+    uint8_t *buf;               ///< The output buffer
+    size_t capacity;            ///< The size of the output buffer
+    size_t maxInput;            ///< Longer payloads are sent as they are, as they might not fit
+    size_t minBytes;
+    uint64_t compressed;        ///< Number of payloads sent compressed
+    uint64_t uncompressed;      ///< Number of payloads compressed to no avail
+    uint64_t bytesIn;           ///< The bytes of the payloads sent compressed, before
+    uint64_t bytesOut;          ///< and after compression
+    uint64_t cpuNs;             ///< The CPU time spent on all compressed and uncompressed payloads
+    uint32_t maxCpuNs;          ///< The most CPU time spent on a single payload
+} Compressor;
+
+/**
+ * @brief Reads the preset dictionary, keeping its last COMPRESSION_DICTIONARY_MAX bytes
+ *
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode compressor_load_dictionary(Compressor *compressor, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to open the compression dictionary %s: %s\n", path, strerror(errno));
+        return -ERROR_CONFIG_INVALID;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    long start = size > COMPRESSION_DICTIONARY_MAX ? size - COMPRESSION_DICTIONARY_MAX : 0;
+    compressor->dictionaryLength = size - start;
+    compressor->dictionary = size > 0 ? malloc(compressor->dictionaryLength) : NULL;
+    if (compressor->dictionary == NULL || fseek(file, start, SEEK_SET) != 0
+        || fread(compressor->dictionary, 1, compressor->dictionaryLength, file) != compressor->dictionaryLength) {
+        dprintf(LOGLEVEL_ERR, "Failed to read the compression dictionary %s\n", path);
+        free(compressor->dictionary);
+        compressor->dictionary = NULL;
+        fclose(file);
+        return -ERROR_CONFIG_INVALID;
+    }
+    fclose(file);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Sets up the compressor
+ *
+ * @param[out] compressor The compressor to initialize
+ * @param[in] settings The settings of the compression
+ * @param[in] maxInput The length of the longest payload to compress
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode compressor_init(Compressor *compressor, const CompressionSettings *settings, size_t maxInput) {
+    memset(compressor, 0, sizeof(Compressor));
+    if (!settings->enabled) {
+        return ERROR_SUCCESS;
+    }
+#ifdef PAYLOAD_COMPRESSION
+    if (settings->dictionary[0] != '\0') {
+        ErrorCode result = compressor_load_dictionary(compressor, settings->dictionary);
+        if (result != ERROR_SUCCESS) {
+            return result;
+        }
+    }
+    if (deflateInit(&compressor->stream, settings->level) != Z_OK) {
+        dprintf(LOGLEVEL_ERR, "Failed to set up the compression\n");
+        free(compressor->dictionary);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    compressor->maxInput = maxInput;
+    compressor->capacity = deflateBound(&compressor->stream, maxInput);
+    compressor->buf = malloc(compressor->capacity);
+    if (compressor->buf == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the compression buffer\n");
+        deflateEnd(&compressor->stream);
+        free(compressor->dictionary);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    compressor->minBytes = settings->minBytes;
+    compressor->enabled = true;
+    return ERROR_SUCCESS;
+#else
+    dprintf(LOGLEVEL_ERR, "Payload compression is not available, build with PAYLOAD_COMPRESSION=1\n");
+    return -ERROR_CONFIG_INVALID;
+#endif
+}
+
+/**
+ * @brief Releases the compressor
+ */
+void compressor_destroy(Compressor *compressor) {
+#ifdef PAYLOAD_COMPRESSION
+    if (compressor->enabled) {
+        deflateEnd(&compressor->stream);
+    }
+#endif
+    free(compressor->buf);
+    free(compressor->dictionary);
+    compressor->buf = NULL;
+    compressor->dictionary = NULL;
+    compressor->enabled = false;
+}
+
+/**
+ * @brief Compresses a payload if it is long enough and gets shorter
+ *
+ * @param[in] compressor The compressor
+ * @param[in] payload The payload
+ * @param[in] length The length of the payload
+ * @param[out] compressedLength The length of the compressed payload
+ * @retval The compressed payload, valid until the next call, or NULL to send the payload as it is
+ */
+const uint8_t *compressor_apply(Compressor *compressor, const uint8_t *payload, size_t length,
+                                size_t *compressedLength) {
+    if (!compressor->enabled || length < compressor->minBytes || length > compressor->maxInput) {
+        return NULL;
+    }
+#ifdef PAYLOAD_COMPRESSION
+    struct timespec start, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+    z_stream *stream = &compressor->stream;
+    bool done = deflateReset(stream) == Z_OK;
+    // a reset forgets the dictionary along with everything else
+    if (done && compressor->dictionary != NULL) {
+        done = deflateSetDictionary(stream, compressor->dictionary, compressor->dictionaryLength) == Z_OK;
+    }
+    if (done) {
+        stream->next_in = (Bytef *)payload;
+        stream->avail_in = length;
+        stream->next_out = compressor->buf;
+        stream->avail_out = compressor->capacity;
+        done = deflate(stream, Z_FINISH) == Z_STREAM_END && stream->total_out < length;
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    const uint32_t cpuNs = elapsed_ns(&start, &end);
+    compressor->cpuNs += cpuNs;
+    if (cpuNs > compressor->maxCpuNs) {
+        compressor->maxCpuNs = cpuNs;
+    }
+    if (!done) {
+        compressor->uncompressed++;
+        return NULL;
+    }
+    compressor->compressed++;
+    compressor->bytesIn += length;
+    compressor->bytesOut += stream->total_out;
+    *compressedLength = stream->total_out;
+    return compressor->buf;
+#else
+    return NULL;
+#endif
+}
+
+/**
+ * @brief Formats the statistics of the compression
+ *
+ * @param[in] compressor The compressor
+ * @param[out] buf The buffer for the text
+ * @param[in] bufSize The size of the buffer
+ * @retval The length of the text, 0 if the compression is disabled
+ */
+size_t format_compression_stats(const Compressor *compressor, char *buf, size_t bufSize) {
+    if (bufSize == 0 || !compressor->enabled) {
+        return 0;
+    }
+    const uint64_t attempts = compressor->compressed + compressor->uncompressed;
+    int written = snprintf(buf, bufSize,
+                           "compressed: %llu, not compressed: %llu, %llu bytes to %llu (%.1f %%), "
+                           "CPU time per payload: %.1f us mean, %.1f us max\n",
+                           (unsigned long long)compressor->compressed, (unsigned long long)compressor->uncompressed,
+                           (unsigned long long)compressor->bytesIn, (unsigned long long)compressor->bytesOut,
+                           compressor->bytesIn > 0 ? 100.0 * compressor->bytesOut / compressor->bytesIn : 100.0,
+                           attempts > 0 ? compressor->cpuNs / 1000.0 / attempts : 0.0, compressor->maxCpuNs / 1000.0);
+    return written < 0 ? 0 : (size_t)written < bufSize ? (size_t)written : bufSize - 1;
+}
+
+#endif
@@ -0,0 +1,676 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "collection.h"
+#include "compression.h"
+#include "cycle_timer.h"
+#include "kbus.h"
+#include "mqtt.h"
+#include "realtime.h"
+#include "snapshot.h"
+#include "spool.h"
+#include "unit_description.h"
+#include "utils.h"
+
+#define CONFIG_DEFAULT_PATH "/etc/energymeter.conf"
+#define CONFIG_LINE_LENGTH 256      ///< Maximum length of a line of the configuration file
+#define DEFAULT_CYCLE_TIME_US 50000
+#define MIN_CYCLE_TIME_US 1000
+#define SAMPLE_PERIOD_DEFAULT -1    ///< Keep the sample period of the catalogue
+
+/**
+ * @brief The configuration of the program
+ *
+ * The configuration file is parsed once at startup into these tables, which do not change
+ * afterwards. Everything derived from the measurement plan, like the schedule, the index of
+ * the measurement IDs and the sizes of the encoder buffers, is computed from them before the
+ * main loop starts, so the main loop never deals with names or strings. The MQTT settings are
+ * written to mqttSettings directly. @see MqttSettings
+ *
+ * The file is made up of sections:
+ * - [general]: cycle_time_us, timer (nanosleep or timerfd)
+ * - [realtime]: enabled, cycle_cpu, cycle_priority, background_cpu, background_priority
+ * - [mqtt]: address, client_id, topic_prefix, qos, keepalive_s, payload_format (protobuf,
+ *   measurement_set, text, json or influx), delta_encoding, keyframe_interval,
+ *   report_by_exception, report_heartbeat_s, max_in_flight, delivery_target_ms
+ * - [spool]: path (empty to disable the store-and-forward buffer), size_kib, drain_rate,
+ *   sync_interval_ms
+ * - [batch]: enabled, max_bytes, max_frames, max_age_ms
+ * - [compression]: enabled, min_bytes, level, dictionary (a file, empty for none)
+ * - [snapshot]: name (of the shared-memory segment, e.g. /energymeter, empty to disable it)
+ * - [measurements]: one measurement per line by the name of its UnitDescription, optionally
+ *   followed by "= <sample period in ms>". HarmonicL1, HarmonicL2 and HarmonicL3 stand for all
+ *   orders of a phase.
+ *
+ * Lines starting with '#' or ';' are comments.
+ */
+typedef struct Config {
+    unsigned long cycleTimeUs;
+    CycleTimerMode timerMode;
+    RealtimeConfig realtime;
+    SpoolSettings spool;
+    BatchSettings batch;
+    CompressionSettings compression;
+    char snapshotName[SNAPSHOT_NAME_LENGTH];    ///< The shared-memory snapshot, empty if disabled
+    const UnitDescription **measurements;   ///< The measurement plan in the order of the ResultSets
+    size_t measurementCount;
+    UnitDescription *units;                 ///< The UnitDescriptions of the plan in one block
+} Config;
+
+/**
+ * @brief The measurements taken without a configuration file
+ */
+const UnitDescription *const DEFAULT_MEASUREMENTS[] = {
+    &RMSVoltageL1N,
+    &EffectivePowerL1,
+    &ReactivePowerN1,
+    &RMSVoltageL2N,
+    &EffectivePowerL2,
+    &ReactivePowerN2,
+    &RMSVoltageL3N,
+    &EffectivePowerL3,
+    &ReactivePowerN3
+};
+
+/**
+ * @brief Builds the measurement plan from a list of catalogue entries
+ *
+ * @param[inout] config The configuration to set the plan of
+ * @param[in] selected The catalogue entries of the measurements
+ * @param[in] periods The sample period of each measurement in ms, or SAMPLE_PERIOD_DEFAULT
+ * @param[in] count The number of measurements
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode config_set_measurements(Config *config, const UnitDescription *const *selected, const long *periods,
+                                  size_t count) {
+    UnitDescription *units = malloc(count * sizeof(UnitDescription));
+    const UnitDescription **measurements = malloc(count * sizeof(UnitDescription *));
+    if (units == NULL || measurements == NULL) {
+        free(units);
+        free(measurements);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const UnitDescription *base = selected[i];
+        const UnitDescription unit = {
+            .colID = base->colID,
+            .metID = base->metID,
+            .unit = base->unit,
+            .description = base->description,
+            .scaleExponent = base->scaleExponent,
+            .scalingFactor = base->scalingFactor,
+            .isUnsigned = base->isUnsigned,
+            .absoluteDeadband = base->absoluteDeadband,
+            .relativeDeadband = base->relativeDeadband,
+            .aggregationWindowMs = base->aggregationWindowMs,
+            .samplePeriodMs = periods == NULL || periods[i] == SAMPLE_PERIOD_DEFAULT
+                              ? base->samplePeriodMs : (unsigned)periods[i]
+        };
+        memcpy(&units[i], &unit, sizeof(UnitDescription));
+        measurements[i] = &units[i];
+    }
+    free(config->units);
+    free(config->measurements);
+    config->units = units;
+    config->measurements = measurements;
+    config->measurementCount = count;
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Initializes a configuration with the defaults
+ *
+ * @param[out] config The configuration
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode config_init(Config *config) {
+    memset(config, 0, sizeof(Config));
+    config->cycleTimeUs = DEFAULT_CYCLE_TIME_US;
+    config->timerMode = CYCLE_TIMER_NANOSLEEP;
+    config->realtime = (RealtimeConfig) {
+        .enabled = false,
+        .cycleCpu = RT_CPU_ANY,
+        .cyclePriority = KBUS_MAINPRIO,
+        .backgroundCpu = RT_CPU_ANY,
+        .backgroundPriority = 0
+    };
+    config->spool = (SpoolSettings) {
+        .path = "",
+        .sizeKiB = 4096,
+        .drainRate = 50,
+        .syncIntervalMs = 5000
+    };
+    config->batch = (BatchSettings) {
+        .enabled = false,
+        .maxBytes = 4096,
+        .maxFrames = 32,
+        .maxAgeMs = 200
+    };
+    config->compression = (CompressionSettings) {
+        .enabled = false,
+        .minBytes = 256,
+        .level = 6,
+        .dictionary = ""
+    };
+    config->snapshotName[0] = '\0';
+    return config_set_measurements(config, DEFAULT_MEASUREMENTS, NULL,
+                                   sizeof(DEFAULT_MEASUREMENTS) / sizeof(UnitDescription *));
+}
+
+/**
+ * @brief Frees the tables of a configuration
+ */
+void config_destroy(Config *config) {
+    free(config->units);
+    free(config->measurements);
+    config->units = NULL;
+    config->measurements = NULL;
+    config->measurementCount = 0;
+}
+
+/**
+ * @brief Removes leading and trailing whitespace in place
+ */
+char *config_trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+/**
+ * @brief Parses a decimal integer within a range
+ *
+ * @retval true if the whole value is a number within [min, max], false otherwise
+ */
+bool config_parse_long(const char *value, long min, long max, long *result) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || parsed < min || parsed > max) {
+        return false;
+    }
+    *result = parsed;
+    return true;
+}
+
+/**
+ * @brief Parses a boolean, given as true/false, yes/no, on/off or 1/0
+ *
+ * @retval true if the value is a boolean, false otherwise
+ */
+bool config_parse_bool(const char *value, bool *result) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "yes") == 0 || strcmp(value, "on") == 0
+        || strcmp(value, "1") == 0) {
+        *result = true;
+        return true;
+    }
+    if (strcmp(value, "false") == 0 || strcmp(value, "no") == 0 || strcmp(value, "off") == 0
+        || strcmp(value, "0") == 0) {
+        *result = false;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Parses a CPU number, or "any" for RT_CPU_ANY
+ */
+bool config_parse_cpu(const char *value, int *result) {
+    long cpu;
+    if (strcmp(value, "any") == 0) {
+        *result = RT_CPU_ANY;
+        return true;
+    }
+    if (!config_parse_long(value, 0, CPU_SETSIZE - 1, &cpu)) {
+        return false;
+    }
+    *result = (int)cpu;
+    return true;
+}
+
+/**
+ * @brief Copies a string setting, which has to fit into a buffer of a given size
+ */
+bool config_parse_string(const char *value, char *setting, size_t settingSize) {
+    size_t length = strlen(value);
+    if (length == 0 || length >= settingSize) {
+        return false;
+    }
+    memcpy(setting, value, length + 1);
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [general] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_general(Config *config, const char *key, const char *value) {
+    long number;
+    if (strcmp(key, "cycle_time_us") == 0) {
+        if (!config_parse_long(value, MIN_CYCLE_TIME_US, LONG_MAX, &number)) {
+            return false;
+        }
+        config->cycleTimeUs = number;
+    } else if (strcmp(key, "timer") == 0) {
+        if (strcmp(value, "nanosleep") == 0) {
+            config->timerMode = CYCLE_TIMER_NANOSLEEP;
+        } else if (strcmp(value, "timerfd") == 0) {
+            config->timerMode = CYCLE_TIMER_TIMERFD;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [realtime] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_realtime(Config *config, const char *key, const char *value) {
+    RealtimeConfig *rt = &config->realtime;
+    long number;
+    if (strcmp(key, "enabled") == 0) {
+        return config_parse_bool(value, &rt->enabled);
+    } else if (strcmp(key, "cycle_cpu") == 0) {
+        return config_parse_cpu(value, &rt->cycleCpu);
+    } else if (strcmp(key, "background_cpu") == 0) {
+        return config_parse_cpu(value, &rt->backgroundCpu);
+    } else if (strcmp(key, "cycle_priority") == 0) {
+        if (!config_parse_long(value, 1, 99, &number)) {
+            return false;
+        }
+        rt->cyclePriority = number;
+    } else if (strcmp(key, "background_priority") == 0) {
+        if (!config_parse_long(value, 0, 99, &number)) {
+            return false;
+        }
+        rt->backgroundPriority = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [mqtt] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_mqtt(MqttSettings *settings, const char *key, const char *value) {
+    static const char *const PAYLOAD_FORMAT_NAMES[] = {
+        [PAYLOAD_PROTOBUF] = "protobuf",
+        [PAYLOAD_MEASUREMENT_SET] = "measurement_set",
+        [PAYLOAD_TEXT] = "text",
+        [PAYLOAD_JSON] = "json",
+        [PAYLOAD_INFLUX] = "influx"
+    };
+    long number;
+    if (strcmp(key, "address") == 0) {
+        return config_parse_string(value, settings->address, MQTT_SETTING_LENGTH);
+    } else if (strcmp(key, "client_id") == 0) {
+        return config_parse_string(value, settings->clientID, MQTT_SETTING_LENGTH);
+    } else if (strcmp(key, "topic_prefix") == 0) {
+        // the prefix is part of topic names, which must not contain wildcards
+        size_t length = strlen(value);
+        while (length > 0 && value[length - 1] == '/') {
+            length--;
+        }
+        if (length == 0 || length >= MQTT_SETTING_LENGTH || strpbrk(value, "+#") != NULL) {
+            return false;
+        }
+        memcpy(settings->topicPrefix, value, length);
+        settings->topicPrefix[length] = '\0';
+    } else if (strcmp(key, "delta_encoding") == 0) {
+        return config_parse_bool(value, &settings->deltaEncoding);
+    } else if (strcmp(key, "report_by_exception") == 0) {
+        return config_parse_bool(value, &settings->reportByException);
+    } else if (strcmp(key, "qos") == 0) {
+        if (!config_parse_long(value, 0, 2, &number)) {
+            return false;
+        }
+        settings->qos = number;
+    } else if (strcmp(key, "keepalive_s") == 0) {
+        if (!config_parse_long(value, 1, 65535, &number)) {
+            return false;
+        }
+        settings->keepAliveS = number;
+    } else if (strcmp(key, "keyframe_interval") == 0) {
+        if (!config_parse_long(value, 1, INT32_MAX, &number)) {
+            return false;
+        }
+        settings->keyframeInterval = number;
+    } else if (strcmp(key, "report_heartbeat_s") == 0) {
+        if (!config_parse_long(value, 1, 86400, &number)) {
+            return false;
+        }
+        settings->reportHeartbeatS = number;
+    } else if (strcmp(key, "max_in_flight") == 0) {
+        if (!config_parse_long(value, 1, PACER_MAX_IN_FLIGHT, &number)) {
+            return false;
+        }
+        settings->maxInFlight = number;
+    } else if (strcmp(key, "delivery_target_ms") == 0) {
+        if (!config_parse_long(value, 1, 3600000, &number)) {
+            return false;
+        }
+        settings->deliveryTargetMs = number;
+    } else if (strcmp(key, "payload_format") == 0) {
+        for (size_t i = 0; i < sizeof(PAYLOAD_FORMAT_NAMES) / sizeof(PAYLOAD_FORMAT_NAMES[0]); i++) {
+            if (strcmp(value, PAYLOAD_FORMAT_NAMES[i]) == 0) {
+                settings->payloadFormat = (PayloadFormat)i;
+                return true;
+            }
+        }
+        return false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [spool] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_spool(SpoolSettings *settings, const char *key, const char *value) {
+    long number;
+    if (strcmp(key, "path") == 0) {
+        settings->path[0] = '\0';
+        return *value == '\0' || config_parse_string(value, settings->path, SPOOL_PATH_LENGTH);
+    } else if (strcmp(key, "size_kib") == 0) {
+        if (!config_parse_long(value, 64, 1024 * 1024, &number)) {
+            return false;
+        }
+        settings->sizeKiB = number;
+    } else if (strcmp(key, "drain_rate") == 0) {
+        if (!config_parse_long(value, 1, 10000, &number)) {
+            return false;
+        }
+        settings->drainRate = number;
+    } else if (strcmp(key, "sync_interval_ms") == 0) {
+        if (!config_parse_long(value, 0, INT32_MAX, &number)) {
+            return false;
+        }
+        settings->syncIntervalMs = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [batch] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_batch(BatchSettings *settings, const char *key, const char *value) {
+    long number;
+    if (strcmp(key, "enabled") == 0) {
+        return config_parse_bool(value, &settings->enabled);
+    } else if (strcmp(key, "max_bytes") == 0) {
+        if (!config_parse_long(value, 64, 1024 * 1024, &number)) {
+            return false;
+        }
+        settings->maxBytes = number;
+    } else if (strcmp(key, "max_frames") == 0) {
+        if (!config_parse_long(value, 1, BATCH_MAX_FRAMES, &number)) {
+            return false;
+        }
+        settings->maxFrames = number;
+    } else if (strcmp(key, "max_age_ms") == 0) {
+        if (!config_parse_long(value, 0, 60000, &number)) {
+            return false;
+        }
+        settings->maxAgeMs = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [compression] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_compression(CompressionSettings *settings, const char *key, const char *value) {
+    long number;
+    if (strcmp(key, "enabled") == 0) {
+        return config_parse_bool(value, &settings->enabled);
+    } else if (strcmp(key, "min_bytes") == 0) {
+        if (!config_parse_long(value, 0, INT32_MAX, &number)) {
+            return false;
+        }
+        settings->minBytes = number;
+    } else if (strcmp(key, "level") == 0) {
+        if (!config_parse_long(value, 1, 9, &number)) {
+            return false;
+        }
+        settings->level = number;
+    } else if (strcmp(key, "dictionary") == 0) {
+        settings->dictionary[0] = '\0';
+        return *value == '\0' || config_parse_string(value, settings->dictionary, COMPRESSION_PATH_LENGTH);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies a setting of the [snapshot] section
+ *
+ * @retval true if the setting is valid, false otherwise
+ */
+bool config_apply_snapshot(Config *config, const char *key, const char *value) {
+    if (strcmp(key, "name") == 0) {
+        config->snapshotName[0] = '\0';
+        // POSIX leaves names without a leading slash to the implementation
+        return *value == '\0' || (*value == '/' && strchr(value + 1, '/') == NULL
+                                   && config_parse_string(value, config->snapshotName, SNAPSHOT_NAME_LENGTH));
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether a measurement has already been selected
+ *
+ * The measurement index maps each measurement ID to one position only, so a measurement
+ * selected twice would leave the second position empty and its ResultSets never complete.
+ */
+bool config_measurement_selected(const UnitDescription *description, const UnitDescription **selected, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (selected[i]->colID == description->colID && selected[i]->metID == description->metID) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Adds a line of the [measurements] section to the measurements selected so far
+ *
+ * @param[in] name The name of the measurement, or of a whole harmonic spectrum
+ * @param[in] value The sample period in ms, or NULL to keep the one of the catalogue
+ * @param[inout] selected The catalogue entries selected so far
+ * @param[inout] periods Their sample periods
+ * @param[inout] count The number of these, at most RESULT_SET_MAX_VALUES
+ * @retval true if the measurement is valid, fits and has not been selected before, false otherwise
+ */
+bool config_add_measurement(const char *name, const char *value, const UnitDescription **selected, long *periods,
+                            size_t *count) {
+    long period = SAMPLE_PERIOD_DEFAULT;
+    if (value != NULL && !config_parse_long(value, 0, INT32_MAX, &period)) {
+        return false;
+    }
+    unsigned phase;
+    int length = 0;
+    if (sscanf(name, "HarmonicL%1u%n", &phase, &length) == 1 && name[length] == '\0') {
+        if (phase < 1 || phase > HARMONIC_PHASE_COUNT || *count + HARMONIC_MAX_ORDER > RESULT_SET_MAX_VALUES) {
+            return false;
+        }
+        for (size_t order = 1; order <= HARMONIC_MAX_ORDER; order++) {
+            if (config_measurement_selected(HARMONIC_CATALOGUE[phase - 1][order], selected, *count)) {
+                return false;
+            }
+            selected[*count] = HARMONIC_CATALOGUE[phase - 1][order];
+            periods[(*count)++] = period;
+        }
+        return true;
+    }
+    const UnitDescription *description = find_catalogue_entry_by_name(name);
+    if (description == NULL || *count >= RESULT_SET_MAX_VALUES
+        || config_measurement_selected(description, selected, *count)) {
+        return false;
+    }
+    selected[*count] = description;
+    periods[(*count)++] = period;
+    return true;
+}
+
+/**
+ * @brief Reads a configuration file
+ *
+ * Settings missing from the file keep their current values. If the file has a [measurements]
+ * section, it replaces the whole measurement plan.
+ *
+ * @param[inout] config The configuration to update
+ * @param[in] path The path of the configuration file
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode config_load(Config *config, const char *path) {
+    enum {
+        SECTION_NONE, SECTION_GENERAL, SECTION_REALTIME, SECTION_MQTT, SECTION_SPOOL, SECTION_BATCH,
+        SECTION_COMPRESSION, SECTION_SNAPSHOT, SECTION_MEASUREMENTS
+    } section = SECTION_NONE;
+    const UnitDescription *selected[RESULT_SET_MAX_VALUES];
+    long periods[RESULT_SET_MAX_VALUES];
+    size_t selectedCount = 0;
+    bool hasMeasurements = false;
+    char line[CONFIG_LINE_LENGTH];
+    unsigned lineNumber = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to open the configuration file %s: %s\n", path, strerror(errno));
+        return -ERROR_CONFIG_INVALID;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            dprintf(LOGLEVEL_ERR, "%s:%u: line too long\n", path, lineNumber);
+            fclose(file);
+            return -ERROR_CONFIG_INVALID;
+        }
+        char *text = config_trim(line);
+        if (*text == '\0' || *text == '#' || *text == ';') {
+            continue;
+        }
+
+        if (*text == '[') {
+            if (strcmp(text, "[general]") == 0) {
+                section = SECTION_GENERAL;
+            } else if (strcmp(text, "[realtime]") == 0) {
+                section = SECTION_REALTIME;
+            } else if (strcmp(text, "[mqtt]") == 0) {
+                section = SECTION_MQTT;
+            } else if (strcmp(text, "[spool]") == 0) {
+                section = SECTION_SPOOL;
+            } else if (strcmp(text, "[batch]") == 0) {
+                section = SECTION_BATCH;
+            } else if (strcmp(text, "[compression]") == 0) {
+                section = SECTION_COMPRESSION;
+            } else if (strcmp(text, "[snapshot]") == 0) {
+                section = SECTION_SNAPSHOT;
+            } else if (strcmp(text, "[measurements]") == 0) {
+                section = SECTION_MEASUREMENTS;
+                hasMeasurements = true;
+            } else {
+                dprintf(LOGLEVEL_ERR, "%s:%u: unknown section %s\n", path, lineNumber, text);
+                fclose(file);
+                return -ERROR_CONFIG_INVALID;
+            }
+            continue;
+        }
+
+        char *key = text;
+        char *value = NULL;
+        char *separator = strchr(text, '=');
+        if (separator != NULL) {
+            *separator = '\0';
+            key = config_trim(key);
+            value = config_trim(separator + 1);
+        }
+        bool valid;
+        switch (section) {
+            case SECTION_GENERAL:
+                valid = value != NULL && config_apply_general(config, key, value);
+                break;
+            case SECTION_REALTIME:
+                valid = value != NULL && config_apply_realtime(config, key, value);
+                break;
+            case SECTION_MQTT:
+                valid = value != NULL && config_apply_mqtt(&mqttSettings, key, value);
+                break;
+            case SECTION_SPOOL:
+                valid = value != NULL && config_apply_spool(&config->spool, key, value);
+                break;
+            case SECTION_BATCH:
+                valid = value != NULL && config_apply_batch(&config->batch, key, value);
+                break;
+            case SECTION_COMPRESSION:
+                valid = value != NULL && config_apply_compression(&config->compression, key, value);
+                break;
+            case SECTION_SNAPSHOT:
+                valid = value != NULL && config_apply_snapshot(config, key, value);
+                break;
+            case SECTION_MEASUREMENTS:
+                valid = config_add_measurement(key, value, selected, periods, &selectedCount);
+                break;
+            default:
+                valid = false;
+        }
+        if (!valid) {
+            dprintf(LOGLEVEL_ERR, "%s:%u: invalid setting %s\n", path, lineNumber, key);
+            fclose(file);
+            return -ERROR_CONFIG_INVALID;
+        }
+    }
+    fclose(file);
+
+    if (hasMeasurements) {
+        if (selectedCount == 0) {
+            dprintf(LOGLEVEL_ERR, "%s: no measurements configured\n", path);
+            return -ERROR_CONFIG_INVALID;
+        }
+        ErrorCode result = config_set_measurements(config, selected, periods, selectedCount);
+        if (result != ERROR_SUCCESS) {
+            return result;
+        }
+    }
+    dprintf(LOGLEVEL_INFO, "Configuration read from %s, %zu measurements\n", path, config->measurementCount);
+    return ERROR_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef CYCLE_STATS_H
+#define CYCLE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The histogram uses HDR-style logarithmic buckets: values below 2^HISTOGRAM_SUB_BUCKET_BITS
+ * get a bucket of their own, above that every power of two is split into 2^HISTOGRAM_SUB_BUCKET_BITS
+ * linear sub-buckets. With 4 bits this keeps the relative error below 6.25% over the whole
+ * uint32 range, using less than 2KB per histogram.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 4
+#define HISTOGRAM_SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT (HISTOGRAM_SUB_BUCKET_COUNT * (33 - HISTOGRAM_SUB_BUCKET_BITS))
+
+/**
+ * @brief The phases of a cycle which are timed individually
+ */
+typedef enum CyclePhase {
+    PHASE_PUSH,     ///< Triggering the KBus cycle
+    PHASE_READ,     ///< Reading the process input image
+    PHASE_DECODE,   ///< Processing the inputs and preparing the next requests
+    PHASE_PUBLISH,  ///< Handing completed results to the MQTT client
+    PHASE_WRITE,    ///< Writing the process output image
+    PHASE_CYCLE,    ///< The complete cycle
+    PHASE_COUNT
+} CyclePhase;
+
+const char *CYCLE_PHASE_NAMES[PHASE_COUNT] = {
+    "push", "read", "decode", "publish", "write", "cycle"
+};
+
+/**
+ * @brief A fixed-size latency histogram, values are recorded in nanoseconds
+ */
+typedef struct LatencyHistogram {
+    uint32_t counts[HISTOGRAM_BUCKET_COUNT];
+    uint64_t count;
+    uint32_t min;
+    uint32_t max;
+} LatencyHistogram;
+
+/**
+ * @brief Timing statistics of the main loop
+ */
+typedef struct CycleStats {
+    LatencyHistogram phases[PHASE_COUNT];   ///< Duration of each phase @see CyclePhase
+    LatencyHistogram wakeup;                ///< How late each cycle started compared to its deadline
+    LatencyHistogram completion;            ///< Time needed to complete a ResultSet in microseconds, over all modules
+    uint64_t overruns;                      ///< Cycles which took longer than the cycle time
+    uint64_t skippedPeriods;                ///< Whole periods skipped because a cycle overran them
+    uint64_t slotRejects[4];                ///< Values rejected in each slot of the process images
+    uint64_t outputBytes;                   ///< Bytes of the process output image written, i.e. of changed windows
+    uint64_t decodedInputs;                 ///< Process input images of modules decoded
+    uint64_t unchangedInputs;               ///< Process input images skipped as identical to the last decoded one
+    uint64_t pageFaults;                    ///< Page faults taken by the main loop since it started
+} CycleStats;
+
+/**
+ * @brief Returns the time between two timestamps in nanoseconds, for spans longer than elapsed_ns() covers
+ */
+uint64_t elapsed_ns64(const struct timespec *from, const struct timespec *to) {
+    int64_t ns = (int64_t)(to->tv_sec - from->tv_sec) * 1000000000 + (to->tv_nsec - from->tv_nsec);
+    return ns < 0 ? 0 : (uint64_t)ns;
+}
+
+/**
+ * @brief Returns the time between two timestamps in nanoseconds, saturating at UINT32_MAX (4.29 s)
+ */
+uint32_t elapsed_ns(const struct timespec *from, const struct timespec *to) {
+    uint64_t ns = elapsed_ns64(from, to);
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+/**
+ * @brief Adds a number of nanoseconds to a timestamp
+ */
+void timespec_add_ns(struct timespec *ts, uint64_t ns) {
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec += ns % 1000000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * @brief Maps a value to its histogram bucket
+ */
+size_t histogram_bucket(uint32_t value) {
+    if (value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return value;
+    }
+    unsigned shift = (31 - __builtin_clz(value)) - HISTOGRAM_SUB_BUCKET_BITS;
+    return HISTOGRAM_SUB_BUCKET_COUNT * (shift + 1) + ((value >> shift) - HISTOGRAM_SUB_BUCKET_COUNT);
+}
+
+/**
+ * @brief Returns the highest value which is mapped to a given histogram bucket
+ */
+uint32_t histogram_bucket_value(size_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    unsigned shift = bucket / HISTOGRAM_SUB_BUCKET_COUNT - 1;
+    uint64_t mantissa = HISTOGRAM_SUB_BUCKET_COUNT + bucket % HISTOGRAM_SUB_BUCKET_COUNT;
+    return (uint32_t)(((mantissa + 1) << shift) - 1);
+}
+
+/**
+ * @brief Records a single value in a histogram
+ */
+void histogram_record(LatencyHistogram *histogram, uint32_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+}
+
+/**
+ * @brief Computes a percentile of the recorded values
+ *
+ * @param[in] histogram The histogram to evaluate
+ * @param[in] percentile The percentile to compute, between 0 and 100
+ * @retval The highest value of the bucket containing the percentile (capped at the maximum)
+ */
+uint32_t histogram_percentile(const LatencyHistogram *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(histogram->count * percentile / 100);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            uint32_t value = histogram_bucket_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Records the duration of a phase
+ */
+void cycle_stats_record(CycleStats *stats, CyclePhase phase, uint32_t durationNs) {
+    histogram_record(&stats->phases[phase], durationNs);
+}
+
+/**
+ * @brief Appends one line of percentiles to a buffer
+ */
+size_t format_histogram_line(char *buf, size_t bufSize, const char *name, const LatencyHistogram *histogram) {
+    int written = snprintf(buf, bufSize,
+                           "%-8s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                           name,
+                           histogram_percentile(histogram, 50) / 1000.0,
+                           histogram_percentile(histogram, 90) / 1000.0,
+                           histogram_percentile(histogram, 99) / 1000.0,
+                           histogram_percentile(histogram, 99.9) / 1000.0,
+                           histogram->min / 1000.0,
+                           histogram->max / 1000.0);
+    if (written < 0) {
+        return 0;
+    }
+    return (size_t)written < bufSize ? (size_t)written : bufSize - 1;
+}
+
+/**
+ * @brief Formats the cycle statistics as a human-readable table
+ *
+ * @param[in] stats The cycle statistics
+ * @param[out] buf The buffer to write to
+ * @param[in] bufSize The size of the buffer
+ * @retval The length of the resulting string
+ */
+size_t format_cycle_stats(const CycleStats *stats, char *buf, size_t bufSize) {
+    if (bufSize == 0) {
+        return 0;
+    }
+    int written = snprintf(buf, bufSize,
+                           "cycles: %llu, overruns: %llu, skipped periods: %llu\n"
+                           "phase          p50       p90       p99      p999       min       max [us]\n",
+                           (unsigned long long)stats->phases[PHASE_CYCLE].count,
+                           (unsigned long long)stats->overruns,
+                           (unsigned long long)stats->skippedPeriods);
+    size_t length = written < 0 ? 0 : (size_t)written < bufSize ? (size_t)written : bufSize - 1;
+
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        length += format_histogram_line(buf + length, bufSize - length, CYCLE_PHASE_NAMES[i], &stats->phases[i]);
+    }
+    length += format_histogram_line(buf + length, bufSize - length, "wakeup", &stats->wakeup);
+    // ResultSets take seconds rather than microseconds, so they are recorded in microseconds
+    written = snprintf(buf + length, bufSize - length,
+                       "ResultSet      p50       p90       p99      p999       min       max [ms]\n");
+    if (written > 0) {
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    length += format_histogram_line(buf + length, bufSize - length, "complete", &stats->completion);
+    written = snprintf(buf + length, bufSize - length, "rejected values per slot: %llu %llu %llu %llu\n",
+                       (unsigned long long)stats->slotRejects[0], (unsigned long long)stats->slotRejects[1],
+                       (unsigned long long)stats->slotRejects[2], (unsigned long long)stats->slotRejects[3]);
+    if (written > 0) {
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    const uint64_t cycles = stats->phases[PHASE_CYCLE].count;
+    written = snprintf(buf + length, bufSize - length, "output bytes written per cycle: %.1f, page faults: %llu\n",
+                       cycles > 0 ? (double)stats->outputBytes / cycles : 0.0,
+                       (unsigned long long)stats->pageFaults);
+    if (written > 0) {
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    const uint64_t inputs = stats->decodedInputs + stats->unchangedInputs;
+    written = snprintf(buf + length, bufSize - length, "input images decoded: %llu, unchanged: %llu (%.1f %%)\n",
+                       (unsigned long long)stats->decodedInputs, (unsigned long long)stats->unchangedInputs,
+                       inputs > 0 ? 100.0 * stats->unchangedInputs / inputs : 0.0);
+    if (written > 0) {
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    return length;
+}
+
+#endif
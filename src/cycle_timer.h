@@ -0,0 +1,125 @@
+#ifndef CYCLE_TIMER_H
+#define CYCLE_TIMER_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cycle_stats.h"
+#include "utils.h"
+
+/**
+ * @brief How the cycle timer waits for the next cycle
+ */
+typedef enum CycleTimerMode {
+    CYCLE_TIMER_NANOSLEEP,  ///< clock_nanosleep() until the absolute deadline of the next cycle
+    CYCLE_TIMER_TIMERFD     ///< A periodic timerfd, which counts missed expirations itself
+} CycleTimerMode;
+
+/**
+ * @brief Waits for the start of each cycle on a fixed grid of absolute deadlines
+ *
+ * The deadlines are multiples of the cycle time from the start of the first cycle on
+ * CLOCK_MONOTONIC, so waiting never accumulates drift and the cycles stay phase-locked no
+ * matter how long the program runs. If a cycle overruns by more than a whole period, the
+ * periods missed are skipped and counted instead of shifting all later cycles.
+ */
+typedef struct CycleTimer {
+    CycleTimerMode mode;
+    uint64_t cycleTimeNs;
+    struct timespec deadline;   ///< The start of the current cycle, CLOCK_MONOTONIC
+    int fd;                     ///< The timerfd in CYCLE_TIMER_TIMERFD mode, -1 otherwise
+} CycleTimer;
+
+/**
+ * @brief Starts a cycle timer with the first cycle starting now
+ *
+ * @param[out] timer The timer to initialize
+ * @param[in] mode How to wait for the next cycle
+ * @param[in] cycleTimeUs The cycle time in microseconds
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode cycle_timer_init(CycleTimer *timer, CycleTimerMode mode, unsigned long cycleTimeUs) {
+    memset(timer, 0, sizeof(CycleTimer));
+    timer->mode = mode;
+    timer->cycleTimeNs = (uint64_t)cycleTimeUs * 1000;
+    timer->fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+
+    if (mode == CYCLE_TIMER_TIMERFD) {
+        timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (timer->fd < 0) {
+            dprintf(LOGLEVEL_ERR, "Failed to create the cycle timer: %s\n", strerror(errno));
+            return -ERROR_TIMER_FAILED;
+        }
+        struct itimerspec spec = {
+            .it_interval = { .tv_sec = cycleTimeUs / 1000000, .tv_nsec = (cycleTimeUs % 1000000) * 1000 },
+            .it_value = timer->deadline
+        };
+        timespec_add_ns(&spec.it_value, timer->cycleTimeNs);
+        if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+            dprintf(LOGLEVEL_ERR, "Failed to start the cycle timer: %s\n", strerror(errno));
+            close(timer->fd);
+            timer->fd = -1;
+            return -ERROR_TIMER_FAILED;
+        }
+    }
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Stops a cycle timer
+ */
+void cycle_timer_destroy(CycleTimer *timer) {
+    if (timer->fd >= 0) {
+        close(timer->fd);
+        timer->fd = -1;
+    }
+}
+
+/**
+ * @brief Waits for the start of the next cycle
+ *
+ * Signals do not end the wait early, so the cycles stay on their grid. A stop request is
+ * noticed at the start of the next cycle at the latest.
+ *
+ * @param[inout] timer The cycle timer
+ * @param[out] wakeupLatencyNs How late the cycle starts compared to its deadline
+ * @retval The number of periods skipped because the last cycle overran them
+ */
+uint64_t cycle_timer_wait(CycleTimer *timer, uint32_t *wakeupLatencyNs) {
+    struct timespec now;
+    uint64_t skipped = 0;
+
+    if (timer->mode == CYCLE_TIMER_TIMERFD) {
+        uint64_t expirations = 0;
+        ssize_t result;
+        do {
+            result = read(timer->fd, &expirations, sizeof(expirations));
+        } while (result < 0 && errno == EINTR);
+        if (result == sizeof(expirations) && expirations > 0) {
+            skipped = expirations - 1;
+            timespec_add_ns(&timer->deadline, expirations * timer->cycleTimeNs);
+        }
+    } else {
+        timespec_add_ns(&timer->deadline, timer->cycleTimeNs);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t lateNs = (int64_t)(now.tv_sec - timer->deadline.tv_sec) * 1000000000
+                         + (now.tv_nsec - timer->deadline.tv_nsec);
+        if (lateNs >= (int64_t)timer->cycleTimeNs) {
+            skipped = (uint64_t)lateNs / timer->cycleTimeNs;
+            timespec_add_ns(&timer->deadline, skipped * timer->cycleTimeNs);
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timer->deadline, NULL) == EINTR) {
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *wakeupLatencyNs = elapsed_ns(&timer->deadline, &now);
+    return skipped;
+}
+
+#endif
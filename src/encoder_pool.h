@@ -0,0 +1,114 @@
+#ifndef ENCODER_POOL_H
+#define ENCODER_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "unit_description.h"
+#include "utils.h"
+
+/**
+ * @brief The state of the delta encoding of a single module
+ */
+typedef struct DeltaState {
+    int64_t previous[RESULT_SET_MAX_VALUES];    ///< The raw values of the previous message
+    size_t size;                                ///< The number of previous values, 0 before the first key frame
+    uint32_t sequence;                          ///< The sequence number of the next message
+    uint32_t sinceKeyFrame;                     ///< The number of messages since the last key frame
+    bool resync;                                ///< Whether the next message has to be a key frame, as earlier ones may have been lost
+} DeltaState;
+
+/**
+ * @brief Preallocated buffers for encoding MQTT messages, one per power measurement module
+ *
+ * Paho copies the payload in MQTTAsync_sendMessage(), so a buffer can be reused as soon as
+ * the message has been handed over. The buffers are sized at startup from an upper bound of
+ * the encoded message size, so the steady-state send path never needs to allocate. Should a
+ * message ever exceed the bound, a temporary buffer is allocated instead and counted in
+ * heapAllocations, which is part of the published statistics and should always stay at 0.
+ */
+typedef struct EncoderPool {
+    uint8_t *storage;               ///< One contiguous block holding all buffers
+    size_t bufferSize;              ///< The size of each buffer
+    size_t bufferCount;             ///< The number of buffers
+    DeltaState *deltas;             ///< The delta encoding state for each buffer
+    atomic_ullong heapAllocations;  ///< Number of messages which did not fit into their buffer
+} EncoderPool;
+
+/**
+ * @brief Allocates the buffers of an encoder pool
+ *
+ * @param[out] pool The pool to initialize
+ * @param[in] bufferCount The number of buffers, usually the number of modules
+ * @param[in] bufferSize The size of each buffer
+ * @retval ERROR_SUCCESS on success, -ERROR_ALLOCATION_FAILED otherwise
+ */
+ErrorCode encoder_pool_init(EncoderPool *pool, size_t bufferCount, size_t bufferSize) {
+    pool->storage = calloc(bufferCount, bufferSize);
+    pool->deltas = calloc(bufferCount, sizeof(DeltaState));
+    if (pool->storage == NULL || pool->deltas == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the encoder buffers\n");
+        free(pool->storage);
+        free(pool->deltas);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    pool->bufferSize = bufferSize;
+    pool->bufferCount = bufferCount;
+    atomic_init(&pool->heapAllocations, 0);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Frees all buffers of an encoder pool
+ */
+void encoder_pool_destroy(EncoderPool *pool) {
+    free(pool->storage);
+    free(pool->deltas);
+    pool->storage = NULL;
+    pool->deltas = NULL;
+    pool->bufferCount = 0;
+}
+
+/**
+ * @brief Makes the next message of every module a key frame
+ *
+ * This is needed whenever messages may have been lost, as the differences sent in the
+ * following messages would refer to values the receivers have never seen.
+ */
+void encoder_pool_resync(EncoderPool *pool) {
+    for (size_t i = 0; i < pool->bufferCount; i++) {
+        pool->deltas[i].resync = true;
+    }
+}
+
+/**
+ * @brief Gets a buffer for encoding a message
+ *
+ * @param[in] pool The encoder pool
+ * @param[in] index The index of the buffer, usually the module index
+ * @param[in] size The required size
+ * @retval The preallocated buffer if it is large enough, a newly allocated one
+ *         (to be returned with encoder_pool_release()) otherwise, or NULL on failure
+ */
+uint8_t *encoder_pool_acquire(EncoderPool *pool, size_t index, size_t size) {
+    if (index < pool->bufferCount && size <= pool->bufferSize) {
+        return pool->storage + index * pool->bufferSize;
+    }
+    atomic_fetch_add_explicit(&pool->heapAllocations, 1, memory_order_relaxed);
+    return malloc(size);
+}
+
+/**
+ * @brief Returns a buffer obtained from encoder_pool_acquire()
+ */
+void encoder_pool_release(EncoderPool *pool, uint8_t *buf) {
+    uintptr_t start = (uintptr_t)pool->storage;
+    uintptr_t address = (uintptr_t)buf;
+    if (address < start || address >= start + pool->bufferCount * pool->bufferSize) {
+        free(buf);
+    }
+}
+
+#endif
@@ -1,32 +1,57 @@
+// for CPU affinity and per-thread resource usage
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <dal/adi_application_interface.h>
 #include <MQTTAsync.h>
 
 #include "utils.h"
+#include "aggregation.h"
+#include "config.h"
+#include "cycle_stats.h"
+#include "cycle_timer.h"
 #include "kbus.h"
+#include "module_request.h"
 #include "collection.h"
 #include "unit_description.h"
 #include "mqtt.h"
+#include "publisher.h"
+#include "realtime.h"
+#include "schedule.h"
+#include "snapshot.h"
+
+#ifdef KBUS_SIMULATION
+#include "sim/kbus_sim.h"
+#endif
 
 //-----------------------------------------------------------------------------
 // defines and test setup
 //-----------------------------------------------------------------------------
-#define CYCLE_TIME_US 50000
-
 // This could be configurable by a commandline parameter in the future
 Loglevel loglevel = LOGLEVEL_DEBUG;
 
 // Signal handling
 volatile sig_atomic_t running = 1;
+volatile sig_atomic_t statsRequested = 0;
+
+// Timing statistics of the main loop and the publisher thread. These are rather large,
+// so keep them off the stack
+CycleStats cycleStats;
+Aggregator aggregator;
+Publisher publisher;
+MeasurementSchedule schedule;
+Snapshot snapshot;
 
 /**
- * @brief The signal handler for catching the SIGINT signal.
+ * @brief The signal handler for catching the SIGINT and SIGUSR1 signals.
+ *
+ * SIGINT stops the program, SIGUSR1 requests a dump of the cycle statistics.
  *
  * @param[in] signum The signal received
  */
@@ -34,14 +59,110 @@ void sig_handler(int signum) {
     if (signum == SIGINT) {
         dprintf(LOGLEVEL_NOTICE, "Received signal SIGINT, quitting...\n");
         running = 0;
+    } else if (signum == SIGUSR1) {
+        statsRequested = 1;
     }
 }
 
-int main(void) {
+/**
+ * @brief Prints the command line usage
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s [-f config file] [-c cycle time in us] [-t] [-r [-a cpu] [-p priority] [-A cpu] [-P priority]]\n"
+           "  -f  configuration file (default %s if it exists), the other options override it\n"
+           "  -c  cycle time in microseconds, at least %d (default %d)\n"
+           "  -t  wait for the next cycle on a timerfd instead of clock_nanosleep()\n"
+           "  -r  real-time mode: lock and prefault memory, pin and prioritize the threads\n"
+           "  -a  CPU of the main loop in real-time mode, or any (default any)\n"
+           "  -p  SCHED_FIFO priority of the main loop in real-time mode, 1 to 99 (default %d)\n"
+           "  -A  CPU of the MQTT and publisher threads in real-time mode, or any (default any)\n"
+           "  -P  SCHED_FIFO priority of these in real-time mode, 1 to 99, 0 for SCHED_OTHER (default 0)\n",
+           program, CONFIG_DEFAULT_PATH, MIN_CYCLE_TIME_US, DEFAULT_CYCLE_TIME_US, KBUS_MAINPRIO);
+}
+
+int main(int argc, char *argv[]) {
     tDeviceId kbusDeviceId;
     tApplicationDeviceInterface *adi;
     uint32_t taskId = 0;
     tApplicationStateChangedEvent event;
+    Config config;
+    const char *configPath = NULL;
+    const char *options = "f:c:tra:p:A:P:h";
+    int option;
+    long number;
+
+    // read the configuration file first, so the other options can override it
+    opterr = 0;
+    while ((option = getopt(argc, argv, options)) != -1) {
+        if (option == 'f') {
+            configPath = optarg;
+        }
+    }
+    if (config_init(&config) != ERROR_SUCCESS) {
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    if (configPath == NULL && access(CONFIG_DEFAULT_PATH, R_OK) == 0) {
+        configPath = CONFIG_DEFAULT_PATH;
+    }
+    if (configPath != NULL) {
+        ErrorCode result = config_load(&config, configPath);
+        if (result != ERROR_SUCCESS) {
+            config_destroy(&config);
+            return result;
+        }
+    }
+    RealtimeConfig *rt = &config.realtime;
+
+    optind = 1;
+    opterr = 1;
+    while ((option = getopt(argc, argv, options)) != -1) {
+        switch (option) {
+            case 'f':
+                break;
+            case 'c':
+                config.cycleTimeUs = strtoul(optarg, NULL, 10);
+                if (config.cycleTimeUs < MIN_CYCLE_TIME_US) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                config.timerMode = CYCLE_TIMER_TIMERFD;
+                break;
+            case 'r':
+                rt->enabled = true;
+                break;
+            case 'a':
+                if (!config_parse_cpu(optarg, &rt->cycleCpu)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p':
+                if (!config_parse_long(optarg, 1, 99, &number)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                rt->cyclePriority = number;
+                break;
+            case 'A':
+                if (!config_parse_cpu(optarg, &rt->backgroundCpu)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P':
+                if (!config_parse_long(optarg, 0, 99, &number)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                rt->backgroundPriority = number;
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
 
     printf("*******************************************\n");
     printf("***         IoT Energy Meter            ***\n");
@@ -64,7 +185,7 @@ int main(void) {
 
     size_t inputDataSize, outputDataSize;
     exit_on_error(get_process_data_size(&inputDataSize, &outputDataSize));
-    dprintf(LOGLEVEL_INFO, "Input/output data sizes: %u %u\n", inputDataSize, outputDataSize);
+    dprintf(LOGLEVEL_INFO, "Input/output data sizes: %zu %zu\n", inputDataSize, outputDataSize);
 
     // allocate and clear process image memory
     void *inputData = malloc(inputDataSize);
@@ -80,32 +201,31 @@ int main(void) {
     size_t pmModuleCount;
     Type495ProcessInput **t495Inputs;
     Type495ProcessOutput **t495Outputs;
-    exit_on_error(get_pm_data_addresses(inputData, outputData, &pmModuleCount, &t495Inputs, &t495Outputs));
+    ProcessImageWindows inputWindows, outputWindows;
+    exit_on_error(get_pm_data_addresses(inputData, outputData, outputDataSize, &pmModuleCount, &t495Inputs, &t495Outputs,
+                                        &inputWindows, &outputWindows));
 
     // finish using the KBus DBus interface
     ldkc_KbusInfo_Destroy();
 
     // register signal handler
     signal(SIGINT, sig_handler);
-
-    // set the list of measurements to take and initialize the results set
-    const UnitDescription *listOfMeasurements[] = {
-        &RMSVoltageL1N,
-        &EffectivePowerL1,
-        &ReactivePowerN1,
-        &RMSVoltageL2N,
-        &EffectivePowerL2,
-        &ReactivePowerN2,
-        &RMSVoltageL3N,
-        &EffectivePowerL3,
-        &ReactivePowerN3
-    };
-    const size_t nrOfMeasurements = sizeof(listOfMeasurements) / sizeof(UnitDescription*);
-    const size_t completionMinCycles = ceil((double)nrOfMeasurements / 4);
+    signal(SIGUSR1, sig_handler);
+
+    // take the configured measurements and initialize the results set
+    const UnitDescription **listOfMeasurements = config.measurements;
+    const size_t nrOfMeasurements = config.measurementCount;
+    const unsigned long cycleTimeUs = config.cycleTimeUs;
+    if (nrOfMeasurements > RESULT_SET_MAX_VALUES) {
+        dprintf(LOGLEVEL_ERR, "Too many measurements, at most %d are supported\n", RESULT_SET_MAX_VALUES);
+        return -ERROR_TOO_MANY_MEASUREMENTS;
+    }
+    MeasurementIndex measurementIndex;
+    measurement_index_init(&measurementIndex, listOfMeasurements, nrOfMeasurements);
+    exit_on_error(schedule_init(&schedule, listOfMeasurements, nrOfMeasurements, cycleTimeUs));
     // The module can provide up to 4 measurements. If our list is shorter than that,
     // instead of looping around we simply don't fill the leftover slots.
-    const size_t iMax = nrOfMeasurements >= 4 ? 4 : nrOfMeasurements;
-    size_t measurementCursor = 0;
+    const size_t iMax = schedule.slotCount;
 
     ResultSet *results = allocate_results(listOfMeasurements,
                                           nrOfMeasurements,
@@ -114,109 +234,265 @@ int main(void) {
         dprintf(LOGLEVEL_ERR, "Memory allocation for the result set failed\n");
         return -ERROR_ALLOCATION_FAILED;
     }
-    // prevent sending all finished results at once by staggering them onto all available cycles
-    const size_t maxSendCount = ceil((double)pmModuleCount / completionMinCycles);
-    size_t messagesSent = 0;
+    exit_on_error(aggregator_init(&aggregator, nrOfMeasurements, pmModuleCount));
+    // every module has its own position in the schedule, so a module which is slow to answer
+    // only holds up itself
+    ModuleRequest *requests = calloc(pmModuleCount, sizeof(ModuleRequest));
+    const size_t moduleStatsSize = (pmModuleCount + 1) * MODULE_STATS_LINE_LENGTH;
+    char *moduleStatsBuf = malloc(moduleStatsSize);
+    if (requests == NULL || moduleStatsBuf == NULL) {
+        dprintf(LOGLEVEL_ERR, "Memory allocation for the module requests failed\n");
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    // prevent sending all finished results at once by staggering them onto all available cycles.
+    // Publishing happens in a separate thread, so this only serves to smooth out bandwidth usage.
+    // While messages are delivered slowly, the pacer lowers the budget below this, and the
+    // credit carries a budget of less than one ResultSet per cycle over to the next cycles
+    const uint32_t maxSendCount = ceil((double)pmModuleCount / schedule.completionMinCycles);
+    uint32_t sendCredit = 0;
+    // the modules take turns in handing over their results, so none of them is starved of
+    // a low budget
+    size_t nextSender = 0;
+    exit_on_error(pacer_init(&sendPacer, maxSendCount, mqttSettings.maxInFlight, mqttSettings.deliveryTargetMs));
+    exit_on_error(topic_table_init(&topicTable, mqttSettings.topicPrefix, pmModuleCount, config.batch.enabled));
+    exit_on_error(snapshot_open(&snapshot, config.snapshotName, listOfMeasurements, nrOfMeasurements, pmModuleCount));
+
+    // In real-time mode, the threads of the MQTT client and the publisher are started while the
+    // main thread is on their CPU and priority, so they inherit both. Everything allocated
+    // so far is locked, and so is everything allocated and mapped from now on.
+    if (rt->enabled) {
+        exit_on_error(rt_lock_memory());
+        exit_on_error(rt_place_thread(rt->backgroundCpu, rt->backgroundPriority));
+    }
 
     // set up MQTT
     MQTTAsync client = MQTT_init_and_connect();
+    exit_on_error(publisher_start(&publisher, client, listOfMeasurements, nrOfMeasurements, pmModuleCount,
+                                  rt->enabled ? rt->backgroundPriority : 0, &config.spool, &config.batch,
+                                  &config.compression));
+
+    if (rt->enabled) {
+        exit_on_error(rt_place_thread(rt->cycleCpu, rt->cyclePriority));
+        dprintf(LOGLEVEL_NOTICE, "Real-time mode: main loop on CPU %d with priority %d, "
+                "MQTT and publisher on CPU %d with priority %d\n",
+                rt->cycleCpu, rt->cyclePriority, rt->backgroundCpu, rt->backgroundPriority);
+    }
 
     // set the application state to 'running' and start the main loop
     event.State = ApplicationState_Running;
     exit_on_error(set_application_state(adi, event));
 
-    struct timespec startTime, finishTime;
-    unsigned long startTimeUs, finishTimeUs, runtimeUs = 0, remainingUs = 0;
+    struct timespec startTime, pushTime, readTime, publishStart, publishEnd, decodeTime, finishTime;
+    struct timespec lastStatsPublish;
+    unsigned long runtimeUs = 0;
+    uint32_t publishNs, wakeupNs;
+    char statsBuf[STATS_BUFFER_SIZE];
+    clock_gettime(CLOCK_MONOTONIC_RAW, &lastStatsPublish);
+    // page faults are counted from here on, once all memory of the main loop has been set up
+    const uint64_t pageFaultsAtStart = rt_thread_page_faults();
+
+    // the cycles run on a fixed grid of deadlines starting now
+    CycleTimer timer;
+    exit_on_error(cycle_timer_init(&timer, config.timerMode, cycleTimeUs));
+    dprintf(LOGLEVEL_INFO, "Cycle time %luus, waiting with %s\n", cycleTimeUs,
+            config.timerMode == CYCLE_TIMER_TIMERFD ? "a timerfd" : "clock_nanosleep()");
     while (running) {
         clock_gettime(CLOCK_MONOTONIC_RAW, &startTime);
-        startTimeUs = (startTime.tv_sec * 1000000) + (startTime.tv_nsec / 1000);
         exit_on_error(trigger_cycle(adi, kbusDeviceId));
         adi->WatchdogTrigger();
-        messagesSent = 0;
+        sendCredit += pacer_cycle_budget(&sendPacer);
+        if (sendCredit > maxSendCount * PACER_BUDGET_UNIT) {
+            sendCredit = maxSendCount * PACER_BUDGET_UNIT;
+        }
+        publishNs = 0;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &pushTime);
 
-        dprintf(LOGLEVEL_DEBUG,
-                "Time required for the last cycle: %luus (%luus remaining)\n",
-                runtimeUs, remainingUs);
-        if (runtimeUs > CYCLE_TIME_US) {
+        if (runtimeUs > cycleTimeUs) {
             dprintf(LOGLEVEL_WARNING,
                     "The time for the last cycle (%luus) was longer than the PLC cycle time\n",
                     runtimeUs);
         }
 
-        // read inputs
+        // read the inputs of the power measurement modules only
         adi->ReadStart(kbusDeviceId, taskId);
-        adi->ReadBytes(kbusDeviceId, taskId, 0, inputDataSize, inputData);
+        process_windows_read(adi, kbusDeviceId, taskId, &inputWindows, inputData);
         adi->ReadEnd(kbusDeviceId, taskId);
+        clock_gettime(CLOCK_MONOTONIC_RAW, &readTime);
+        snapshot_cycle(&snapshot);
 
         // iterate through the process data of each module and process the data
-        for (size_t modIndex = 0; modIndex < pmModuleCount; modIndex++) {
-            if (results_unstable(t495Inputs[modIndex], iMax)) {
+        const size_t firstModule = nextSender;
+        for (size_t n = 0; n < pmModuleCount; n++) {
+            const size_t modIndex = (firstModule + n) % pmModuleCount;
+            ModuleRequest *request = &requests[modIndex];
+            if (!request->pending) {
+                clock_gettime(CLOCK_MONOTONIC_RAW, &request->setStart);
+                module_request_next(request, &schedule, listOfMeasurements);
                 continue;
             }
+            // a module repeating the image it was last decoded from has nothing new to take
+            uint8_t accepted = 0;
+            if (module_request_unchanged(request, t495Inputs[modIndex], cycleStats.slotRejects)) {
+                cycleStats.unchangedInputs++;
+            } else {
+                accepted = module_request_accept(request, t495Inputs[modIndex], iMax, cycleStats.slotRejects);
+                cycleStats.decodedInputs++;
+            }
 
-            // fill the results set
+            // fill the results set with the values of the accepted slots
             for (size_t i = 0; i < iMax; i++) {
-                size_t index;
-                UnitDescription *description = find_description_with_id(results[modIndex].descriptions,
-                                                                        results[modIndex].size,
-                                                                        t495Inputs[modIndex]->metID[i],
-                                                                        &index);
-                if (description == NULL) continue;
-
-                results[modIndex].values[index] = read_measurement_value(description,
-                                                                         t495Inputs[modIndex]->processValue[i]);
+                if (!(accepted & (1u << i))) continue;
+                size_t index = measurement_index_find(&measurementIndex, t495Inputs[modIndex]->colID,
+                                                      t495Inputs[modIndex]->metID[i]);
+                if (index == MEASUREMENT_SLOT_NONE) continue;
+
+                results[modIndex].values[index] = read_measurement_value(t495Inputs[modIndex]->processValue[i]);
+                snapshot_store(&snapshot, modIndex, index,
+                               raw_value(listOfMeasurements[index], results[modIndex].values[index]));
                 if (!results[modIndex].validity[index]) {
                     results[modIndex].validity[index] = true;
                     results[modIndex].currentCount += 1;
+                    results[modIndex].requiredCount += schedule.required[index];
                 }
             }
+            snapshot_module_done(&snapshot, modIndex);
 
-            // send the finished results and then reset them
-            if (results[modIndex].currentCount == results[modIndex].size && messagesSent <= maxSendCount) {
+            // aggregate the finished results and then reset them, regardless of the send credit,
+            // so the aggregates cover every ResultSet
+            if (results[modIndex].requiredCount == schedule.requiredCount && results[modIndex].currentCount > 0) {
                 clock_gettime(CLOCK_TAI, &results[modIndex].timestamp);
-                if (MQTTAsync_isConnected(client)) {
-                    if (send_MQTT5_message(client, &results[modIndex]) == ERROR_SUCCESS) {
-                        messagesSent += 1;
-                    }
-                }
+                clock_gettime(CLOCK_MONOTONIC_RAW, &publishStart);
+                aggregator_add(&aggregator, &results[modIndex]);
+                clock_gettime(CLOCK_MONOTONIC_RAW, &publishEnd);
+                publishNs += elapsed_ns(&publishStart, &publishEnd);
+
+                const uint64_t completionUs = module_request_completed(request, &publishEnd) / 1000;
+                histogram_record(&cycleStats.completion, completionUs > UINT32_MAX ? UINT32_MAX : completionUs);
 
                 results[modIndex].currentCount = 0;
+                results[modIndex].requiredCount = 0;
                 memset(results[modIndex].validity, 0, sizeof(bool) * results[modIndex].size);
                 memset(&results[modIndex].timestamp, 0, sizeof(struct timespec));
             }
 
-            // request A/C values and status of L1
+            // send the completed aggregates as the credit allows, until then the aggregator keeps
+            // them and merges the next windows into them
+            const PendingAggregates *pending = aggregator_pending(&aggregator, modIndex);
+            if (pending != NULL && sendCredit >= PACER_BUDGET_UNIT) {
+                clock_gettime(CLOCK_MONOTONIC_RAW, &publishStart);
+                ResultSet aggregates = {
+                    .descriptions = results[modIndex].descriptions,
+                    .size = results[modIndex].size,
+                    .moduleIndex = modIndex,
+                    .values = pending->means,
+                    .timestamp = pending->timestamp,
+                    .validity = pending->completed,
+                    .aggregates = pending->aggregates
+                };
+                publisher_enqueue(&publisher, &aggregates);
+                aggregator_taken(&aggregator, modIndex);
+                sendCredit -= PACER_BUDGET_UNIT;
+                nextSender = (modIndex + 1) % pmModuleCount;
+                clock_gettime(CLOCK_MONOTONIC_RAW, &publishEnd);
+                publishNs += elapsed_ns(&publishStart, &publishEnd);
+            }
+            if (request->pendingSlots == 0) {
+                module_request_next(request, &schedule, listOfMeasurements);
+            } else {
+                // keep the request until the remaining slots have been answered
+                request->retries++;
+            }
+        }
+
+        // request process data and status of L1. This needs to happen regardless of the module's
+        // current state, otherwise a module which never confirmed a request would never get one
+        for (size_t modIndex = 0; modIndex < pmModuleCount; modIndex++) {
             t495Outputs[modIndex]->commMethod = COMM_PROCESS_DATA;
             t495Outputs[modIndex]->statusRequest = STATUS_L1;
-            t495Outputs[modIndex]->colID = AC_MEASUREMENT;
         }
 
-        // request the next batch of measurements - this needs to be done in a separate loop to
-        // ensure we request the same values from each module
-        for (size_t i = 0; i < iMax; i++, measurementCursor++) {
-            if (measurementCursor == nrOfMeasurements) {
-                measurementCursor = 0;
-            }
-            for (size_t modIndex = 0; modIndex < pmModuleCount; modIndex++) {
-                t495Outputs[modIndex]->metID[i] = listOfMeasurements[measurementCursor]->metID;
-            }
+        // request the current collection and batch of measurements of each module, which stay
+        // the same until the module has answered them
+        for (size_t modIndex = 0; modIndex < pmModuleCount; modIndex++) {
+            t495Outputs[modIndex]->colID = requests[modIndex].colID;
+            memcpy(t495Outputs[modIndex]->metID, requests[modIndex].metIDs, iMax);
         }
 
-        // write outputs
+        clock_gettime(CLOCK_MONOTONIC_RAW, &decodeTime);
+
+        // write the outputs of the power measurement modules, as far as they changed
         adi->WriteStart(kbusDeviceId, taskId);
-        adi->WriteBytes(kbusDeviceId, taskId, 0, outputDataSize, outputData);
+        cycleStats.outputBytes += process_windows_write_changed(adi, kbusDeviceId, taskId, &outputWindows, outputData);
         adi->WriteEnd(kbusDeviceId, taskId);
 
-        // measure the runtime and sleep until the cycle time has elapsed,
-        // making sure we always loop in multiples of the cycle time
+        // measure the runtime of each phase
         clock_gettime(CLOCK_MONOTONIC_RAW, &finishTime);
-        finishTimeUs = (finishTime.tv_sec * 1000000) + (finishTime.tv_nsec / 1000);
-        runtimeUs = finishTimeUs - startTimeUs;
-        remainingUs = CYCLE_TIME_US - (runtimeUs % CYCLE_TIME_US);
-        usleep(remainingUs);
-    }
+        cycle_stats_record(&cycleStats, PHASE_PUSH, elapsed_ns(&startTime, &pushTime));
+        cycle_stats_record(&cycleStats, PHASE_READ, elapsed_ns(&pushTime, &readTime));
+        cycle_stats_record(&cycleStats, PHASE_DECODE, elapsed_ns(&readTime, &decodeTime) - publishNs);
+        cycle_stats_record(&cycleStats, PHASE_PUBLISH, publishNs);
+        cycle_stats_record(&cycleStats, PHASE_WRITE, elapsed_ns(&decodeTime, &finishTime));
+        cycle_stats_record(&cycleStats, PHASE_CYCLE, elapsed_ns(&startTime, &finishTime));
+        runtimeUs = elapsed_ns(&startTime, &finishTime) / 1000;
+        if (runtimeUs > cycleTimeUs) {
+            cycleStats.overruns++;
+        }
 
+        // dump the statistics on request and publish them periodically, this happens
+        // outside the measured part of the cycle but still counts towards the cycle time
+        const bool publishStats = finishTime.tv_sec - lastStatsPublish.tv_sec >= STATS_PUBLISH_INTERVAL_S;
+        if (statsRequested || publishStats) {
+            const uint64_t pageFaults = rt_thread_page_faults() - pageFaultsAtStart;
+            if (rt->enabled && pageFaults > cycleStats.pageFaults) {
+                dprintf(LOGLEVEL_WARNING, "The main loop took %llu page faults despite the locked memory\n",
+                        (unsigned long long)(pageFaults - cycleStats.pageFaults));
+            }
+            cycleStats.pageFaults = pageFaults;
+        }
+        if (statsRequested) {
+            statsRequested = 0;
+            format_cycle_stats(&cycleStats, statsBuf, sizeof(statsBuf));
+            dprintf(LOGLEVEL_NOTICE, "%s", statsBuf);
+            format_module_stats(requests, pmModuleCount, moduleStatsBuf, moduleStatsSize);
+            dprintf(LOGLEVEL_NOTICE, "%s", moduleStatsBuf);
+        }
+        if (publishStats) {
+            lastStatsPublish = finishTime;
+            publisher_submit_stats(&publisher, &cycleStats);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &finishTime);
+        runtimeUs = elapsed_ns(&startTime, &finishTime) / 1000;
+#ifdef KBUS_SIMULATION
+        if (sim_full_speed()) {
+            continue;
+        }
+#endif
+        cycleStats.skippedPeriods += cycle_timer_wait(&timer, &wakeupNs);
+        histogram_record(&cycleStats.wakeup, wakeupNs);
+    }
+    cycle_timer_destroy(&timer);
+
+    cycleStats.pageFaults = rt_thread_page_faults() - pageFaultsAtStart;
+    format_cycle_stats(&cycleStats, statsBuf, sizeof(statsBuf));
+    dprintf(LOGLEVEL_NOTICE, "%s", statsBuf);
+    format_module_stats(requests, pmModuleCount, moduleStatsBuf, moduleStatsSize);
+    dprintf(LOGLEVEL_NOTICE, "%s", moduleStatsBuf);
+
+    publisher_stop(&publisher);
+    format_pacer_stats(&sendPacer, statsBuf, sizeof(statsBuf));
+    dprintf(LOGLEVEL_NOTICE, "%s", statsBuf);
+    snapshot_close(&snapshot);
+    aggregator_destroy(&aggregator);
+    schedule_destroy(&schedule);
+    process_windows_destroy(&inputWindows);
+    process_windows_destroy(&outputWindows);
+    free(requests);
+    free(moduleStatsBuf);
+    config_destroy(&config);
     MQTT_disconnect_and_destroy(client);
+    pacer_destroy(&sendPacer);
+    topic_table_destroy(&topicTable);
     adi->CloseDevice(kbusDeviceId);
     adi->Exit();
     return ERROR_SUCCESS;
@@ -0,0 +1,90 @@
+#ifndef HARMONICS_H
+#define HARMONICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collection.h"
+#include "unit_description.h"
+
+/**
+ * @brief The harmonic values of one phase gathered from a ResultSet
+ */
+typedef struct HarmonicSpectrum {
+    uint8_t colID;                              ///< The harmonic analysis collection of the phase
+    size_t count;                               ///< The number of harmonics
+    uint32_t orders[HARMONIC_MAX_ORDER];        ///< The order of each harmonic, ascending
+    uint32_t amplitudes[HARMONIC_MAX_ORDER];    ///< The amplitude of each harmonic in 0.01 % of the fundamental
+} HarmonicSpectrum;
+
+/**
+ * @brief Computes the integer square root, rounded down
+ */
+uint32_t isqrt64(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/**
+ * @brief Gathers the harmonics of one phase from a ResultSet
+ *
+ * Harmonics are taken in the order of the measurement list, which lists them by ascending
+ * order as long as the catalogue entries have been listed that way.
+ *
+ * @param[in] results The ResultSet
+ * @param[in] colID The harmonic analysis collection of the phase
+ * @param[out] spectrum The harmonics of the phase
+ * @retval The number of harmonics found
+ */
+size_t harmonic_spectrum_collect(const ResultSet *results, uint8_t colID, HarmonicSpectrum *spectrum) {
+    spectrum->colID = colID;
+    spectrum->count = 0;
+    for (size_t i = 0; i < results->size && spectrum->count < HARMONIC_MAX_ORDER; i++) {
+        const UnitDescription *description = results->descriptions[i];
+        if (description->colID != colID || !result_included(results, i)) {
+            continue;
+        }
+        spectrum->orders[spectrum->count] = description->metID;
+        spectrum->amplitudes[spectrum->count] = results->values[i];
+        spectrum->count++;
+    }
+    return spectrum->count;
+}
+
+/**
+ * @brief Computes the total harmonic distortion of a spectrum
+ *
+ * As the amplitudes are relative to the fundamental already, this is the root of the sum of
+ * the squared amplitudes of all orders from 2, computed exactly in integers. Each square
+ * fits into 64 bits, and so does their sum for any realistic amplitude.
+ *
+ * @param[in] spectrum The harmonics of a phase
+ * @retval The total harmonic distortion in 0.01 %
+ */
+uint32_t harmonic_thd(const HarmonicSpectrum *spectrum) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < spectrum->count; i++) {
+        if (spectrum->orders[i] >= 2) {
+            sum += (uint64_t)spectrum->amplitudes[i] * spectrum->amplitudes[i];
+        }
+    }
+    // round to the nearest instead of down
+    uint32_t root = isqrt64(sum);
+    return (uint64_t)root * root + root < sum ? root + 1 : root;
+}
+
+#endif
@@ -1,4 +1,10 @@
+#ifndef KBUS_H
+#define KBUS_H
+
 #include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +18,160 @@
 
 #define KBUS_MAINPRIO 40
 
+/**
+ * @brief A contiguous range of bytes in a process image
+ */
+typedef struct ProcessImageRange {
+    size_t offset;
+    size_t length;
+} ProcessImageRange;
+
+/**
+ * @brief The equally sized windows of a process image which are actually used, e.g. those of
+ *        all power measurement modules
+ *
+ * Adjacent windows are coalesced into as few ranges as possible, so they can be copied with
+ * a single call each instead of copying the whole process image.
+ */
+typedef struct ProcessImageWindows {
+    size_t *offsets;                ///< The offset of each window, ascending
+    size_t count;                   ///< The number of windows
+    size_t windowSize;              ///< The size of each window in bytes
+    ProcessImageRange *ranges;      ///< The coalesced ranges covering all windows, ascending
+    size_t rangeCount;              ///< The number of ranges
+    uint8_t *shadow;                ///< The window contents last written, NULL for input images
+    bool written;                   ///< Whether the windows have been written at all
+} ProcessImageWindows;
+
+/**
+ * @brief Compares two process image offsets for qsort()
+ */
+int compare_offsets(const void *a, const void *b) {
+    size_t lhs = *(const size_t *)a, rhs = *(const size_t *)b;
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+/**
+ * @brief Computes the coalesced ranges of a set of process image windows
+ *
+ * @param[out] windows The windows to initialize
+ * @param[in] offsets The offset of each window, in any order
+ * @param[in] count The number of windows
+ * @param[in] windowSize The size of each window in bytes
+ * @param[in] imageSize The size of the process image, for a shadow copy of written windows,
+ *                      or 0 for an input image
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode process_windows_init(ProcessImageWindows *windows, const size_t *offsets, size_t count,
+                               size_t windowSize, size_t imageSize) {
+    memset(windows, 0, sizeof(ProcessImageWindows));
+    windows->offsets = malloc(count * sizeof(size_t));
+    windows->ranges = malloc(count * sizeof(ProcessImageRange));
+    windows->shadow = imageSize > 0 ? malloc(imageSize) : NULL;
+    if (windows->offsets == NULL || windows->ranges == NULL || (imageSize > 0 && windows->shadow == NULL)) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the process image ranges\n");
+        free(windows->offsets);
+        free(windows->ranges);
+        free(windows->shadow);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    memcpy(windows->offsets, offsets, count * sizeof(size_t));
+    qsort(windows->offsets, count, sizeof(size_t), compare_offsets);
+    windows->count = count;
+    windows->windowSize = windowSize;
+
+    for (size_t i = 0; i < count; i++) {
+        ProcessImageRange *last = windows->rangeCount > 0 ? &windows->ranges[windows->rangeCount - 1] : NULL;
+        if (last != NULL && windows->offsets[i] <= last->offset + last->length) {
+            last->length = windows->offsets[i] + windowSize - last->offset;
+        } else {
+            windows->ranges[windows->rangeCount++] = (ProcessImageRange){ windows->offsets[i], windowSize };
+        }
+    }
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Frees the ranges of a set of process image windows
+ */
+void process_windows_destroy(ProcessImageWindows *windows) {
+    free(windows->offsets);
+    free(windows->ranges);
+    free(windows->shadow);
+    memset(windows, 0, sizeof(ProcessImageWindows));
+}
+
+/**
+ * @brief Returns the number of bytes covered by the ranges of a set of process image windows
+ */
+size_t process_windows_size(const ProcessImageWindows *windows) {
+    size_t size = 0;
+    for (size_t i = 0; i < windows->rangeCount; i++) {
+        size += windows->ranges[i].length;
+    }
+    return size;
+}
+
+/**
+ * @brief Reads all windows of the process input image. Must be called between ReadStart and ReadEnd.
+ *
+ * @param[in] adi A pointer to the initialized application interface
+ * @param[in] kbusDeviceId The ID of the KBus device
+ * @param[in] taskId The ID of the task
+ * @param[in] windows The windows to read
+ * @param[out] data The process input image
+ */
+void process_windows_read(tApplicationDeviceInterface *adi, tDeviceId kbusDeviceId, uint32_t taskId,
+                          const ProcessImageWindows *windows, uint8_t *data) {
+    for (size_t i = 0; i < windows->rangeCount; i++) {
+        const ProcessImageRange *range = &windows->ranges[i];
+        adi->ReadBytes(kbusDeviceId, taskId, range->offset, range->length, data + range->offset);
+    }
+}
+
+/**
+ * @brief Writes the windows of the process output image which changed since they were last
+ *        written. Must be called between WriteStart and WriteEnd.
+ *
+ * Runs of adjacent changed windows are written with a single call. The first call writes
+ * all windows.
+ *
+ * @param[in] adi A pointer to the initialized application interface
+ * @param[in] kbusDeviceId The ID of the KBus device
+ * @param[in] taskId The ID of the task
+ * @param[inout] windows The windows to write, with a shadow copy
+ * @param[in] data The process output image
+ * @retval The number of bytes written
+ */
+size_t process_windows_write_changed(tApplicationDeviceInterface *adi, tDeviceId kbusDeviceId, uint32_t taskId,
+                                     ProcessImageWindows *windows, uint8_t *data) {
+    size_t written = 0, runStart = 0, runEnd = 0;
+
+    for (size_t i = 0; i <= windows->count; i++) {
+        size_t offset = i < windows->count ? windows->offsets[i] : SIZE_MAX;
+        bool changed = i < windows->count
+                       && (!windows->written
+                           || memcmp(data + offset, windows->shadow + offset, windows->windowSize) != 0);
+        if (changed && runEnd > runStart && offset <= runEnd) {
+            runEnd = offset + windows->windowSize;
+            continue;
+        }
+        // the run ends here, either at an unchanged window, a gap or the end
+        if (runEnd > runStart) {
+            adi->WriteBytes(kbusDeviceId, taskId, runStart, runEnd - runStart, data + runStart);
+            memcpy(windows->shadow + runStart, data + runStart, runEnd - runStart);
+            written += runEnd - runStart;
+            runStart = runEnd = 0;
+        }
+        if (changed) {
+            runStart = offset;
+            runEnd = offset + windows->windowSize;
+        }
+    }
+    windows->written = true;
+    return written;
+}
+
 /**
  * @brief Sets the state of the PLC application
  *
@@ -71,24 +231,34 @@ ErrorCode get_process_data_size(size_t *inputSize, size_t *outputSize) {
 /**
  * @brief Finds the process data addresses of all power measurement modules
  *
+ * Besides the pointers to the process data of each module, this computes the ranges of the
+ * process images which need to be copied at all, so the process data of other modules is
+ * neither read nor written.
+ *
  * @param[in] inputData A pointer to the allocated input process data
  * @param[in] outputData A pointer to the allocated output process data
+ * @param[in] outputSize The size of the output process data
  * @param[out] count The number of power measurement modules found
  * @param[out] t495Inputs A newly allocated array of pointers to all Type 495/494 process input data
  * @param[out] t495Outputs A newly allocated array of pointers to all Type 495/494 process output data
+ * @param[out] inputWindows The process input data of all modules
+ * @param[out] outputWindows The process output data of all modules
  * @retval ERROR_SUCCESS (0) on success, a different error code otherwise
  */
 ErrorCode get_pm_data_addresses(const void *inputData,
                                 const void *outputData,
+                                size_t outputSize,
                                 size_t *count,
                                 Type495ProcessInput ***t495Inputs,
-                                Type495ProcessOutput ***t495Outputs) {
+                                Type495ProcessOutput ***t495Outputs,
+                                ProcessImageWindows *inputWindows,
+                                ProcessImageWindows *outputWindows) {
     size_t terminalCount;
     uint16_t terminals[LDKC_KBUS_TERMINAL_COUNT_MAX];
     tldkc_KbusInfo_TerminalInfo terminalDescription[LDKC_KBUS_TERMINAL_COUNT_MAX];
 
-    int inputOffsets[LDKC_KBUS_TERMINAL_COUNT_MAX];
-    int outputOffsets[LDKC_KBUS_TERMINAL_COUNT_MAX];
+    size_t inputOffsets[LDKC_KBUS_TERMINAL_COUNT_MAX];
+    size_t outputOffsets[LDKC_KBUS_TERMINAL_COUNT_MAX];
     size_t moduleCount = 0;
 
     if (ldkc_KbusInfo_GetTerminalInfo(OS_ARRAY_SIZE(terminalDescription),
@@ -121,7 +291,7 @@ ErrorCode get_pm_data_addresses(const void *inputData,
         return -ERROR_NO_MODULES;
     }
 
-    dprintf(LOGLEVEL_INFO, "Found %u power measurement modules\n", moduleCount);
+    dprintf(LOGLEVEL_INFO, "Found %zu power measurement modules\n", moduleCount);
 
     *t495Inputs = malloc(sizeof(Type495ProcessInput*) * moduleCount);
     *t495Outputs = malloc(sizeof(Type495ProcessOutput*) * moduleCount);
@@ -131,11 +301,24 @@ ErrorCode get_pm_data_addresses(const void *inputData,
     }
 
     for (size_t i = 0; i < moduleCount; i++) {
-        *t495Inputs[i] = (void *)inputData + inputOffsets[i];
-        *t495Outputs[i] = (void *)outputData + outputOffsets[i];
+        (*t495Inputs)[i] = (void *)inputData + inputOffsets[i];
+        (*t495Outputs)[i] = (void *)outputData + outputOffsets[i];
     }
     *count = moduleCount;
 
+    ErrorCode result = process_windows_init(inputWindows, inputOffsets, moduleCount, sizeof(Type495ProcessInput), 0);
+    if (result != ERROR_SUCCESS) {
+        return result;
+    }
+    result = process_windows_init(outputWindows, outputOffsets, moduleCount, sizeof(Type495ProcessOutput), outputSize);
+    if (result != ERROR_SUCCESS) {
+        process_windows_destroy(inputWindows);
+        return result;
+    }
+    dprintf(LOGLEVEL_INFO, "Copying %zu of the input and %zu of the output bytes in %zu/%zu ranges\n",
+            process_windows_size(inputWindows), process_windows_size(outputWindows),
+            inputWindows->rangeCount, outputWindows->rangeCount);
+
     return ERROR_SUCCESS;
 }
 
@@ -158,7 +341,7 @@ ErrorCode find_and_initialize_kbus(tApplicationDeviceInterface *adi, tDeviceId *
     for (size_t i = 0; i < nrDevicesFound; ++i) {
         if (strcmp(deviceList[i].DeviceName, "libpackbus") == 0) {
             nrKbusFound = i;
-            dprintf(LOGLEVEL_DEBUG, "KBUS device found as device %i\n", i);
+            dprintf(LOGLEVEL_DEBUG, "KBUS device found as device %zu\n", i);
         }
     }
 
@@ -203,3 +386,5 @@ ErrorCode trigger_cycle(tApplicationDeviceInterface *adi, tDeviceId kbusDeviceId
 
     return ERROR_SUCCESS;
 }
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef MODULE_REQUEST_H
+#define MODULE_REQUEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cycle_stats.h"
+#include "process_image.h"
+#include "schedule.h"
+#include "unit_description.h"
+
+#define MODULE_STATS_LINE_LENGTH 80     ///< Upper bound for the length of one line of format_module_stats()
+
+/**
+ * @brief The request state of a single power measurement module
+ *
+ * Every module walks through the schedule on its own. A request stays pending until the
+ * module has answered each of its slots with a stable value, so a module still settling after
+ * a change of the requested IDs keeps its request while all other modules move on. Slots
+ * which have been answered are taken right away, only the others are waited for.
+ *
+ * While a module keeps its request, it mostly repeats the same process input image until it
+ * answers the remaining slots. The image of the last decode is kept, so an identical image
+ * can skip the decode, which would only find the same values again @see module_request_unchanged
+ */
+typedef struct ModuleRequest {
+    size_t cycle;                       ///< The position of the module in the schedule
+    uint8_t colID;                      ///< The collection currently requested from the module @see COL_ID
+    uint8_t metIDs[SCHEDULE_SLOTS];     ///< The measurement IDs currently requested from the module, 0 for unused slots
+    bool pending;                       ///< Whether the request has been made at all
+    uint8_t pendingSlots;               ///< The slots still waiting to be answered, as a bit mask
+    bool decoded;                       ///< Whether lastInput has been decoded for the current request and ResultSet
+    uint8_t lastRejected;               ///< The slots rejected by the last decode, as a bit mask
+    Type495ProcessInput lastInput;      ///< The process input image of the last decode
+    uint64_t retries;                   ///< Number of cycles any request had to wait for another one
+    uint64_t rejects;                   ///< Number of values rejected because of a wrong ID or range
+    struct timespec setStart;           ///< When the current ResultSet of the module was started
+    uint64_t completions;               ///< Number of completed ResultSets
+    uint64_t completionNsTotal;         ///< The total time needed to complete them
+    uint64_t completionNsMax;           ///< The longest time needed to complete one of them
+} ModuleRequest;
+
+/**
+ * @brief Determines which slots of its request a module has answered
+ *
+ * A slot is accepted if the module confirms the requested collection and ID and the value is
+ * within its specified range. Nothing is accepted during a transient reaction of the module. Pending
+ * slots which have been accepted are no longer pending, the others are counted as rejected.
+ *
+ * @param[inout] request The request state of the module
+ * @param[in] input The process input image of the module
+ * @param[in] slotCount The number of slots requested
+ * @param[inout] slotRejects The number of rejected values in each slot, to add to
+ * @retval The accepted slots as a bit mask
+ */
+uint8_t module_request_accept(ModuleRequest *request, const Type495ProcessInput *input, size_t slotCount,
+                              uint64_t *slotRejects) {
+    if (!request->pending) {
+        return 0;
+    }
+    request->lastInput = *input;
+    request->lastRejected = 0;
+    request->decoded = true;
+    if (input->valuesUnstable) {
+        return 0;
+    }
+    uint8_t accepted = 0;
+    for (size_t i = 0; i < slotCount; i++) {
+        const uint8_t slot = 1u << i;
+        if (request->metIDs[i] == 0) {
+            continue;
+        }
+        if (input->colID == request->colID && input->metID[i] == request->metIDs[i]
+            && !process_value_out_of_range(input, i)) {
+            accepted |= slot;
+        } else if (request->pendingSlots & slot) {
+            request->lastRejected |= slot;
+            request->rejects++;
+            slotRejects[i]++;
+        }
+    }
+    request->pendingSlots &= ~accepted;
+    return accepted;
+}
+
+/**
+ * @brief Checks whether a module repeats the process input image of its last decode
+ *
+ * As long as the request and the ResultSet are the same, decoding the same image again would
+ * accept the same slots with the same values, which the ResultSet already holds, and reject
+ * the same slots. Only the rejects are counted again, so the statistics do not depend on
+ * whether the decode was skipped.
+ *
+ * @param[inout] request The request state of the module
+ * @param[in] input The process input image of the module
+ * @param[inout] slotRejects The number of rejected values in each slot, to add to
+ * @retval true if the decode can be skipped, false if the image needs to be decoded
+ */
+bool module_request_unchanged(ModuleRequest *request, const Type495ProcessInput *input, uint64_t *slotRejects) {
+    if (!request->decoded || !process_input_equal(input, &request->lastInput)) {
+        return false;
+    }
+    for (uint8_t rejected = request->lastRejected; rejected != 0; rejected &= rejected - 1) {
+        request->rejects++;
+        slotRejects[__builtin_ctz(rejected)]++;
+    }
+    return true;
+}
+
+/**
+ * @brief Moves a module on to the next request of the schedule
+ *
+ * @param[inout] request The request state of the module
+ * @param[in] schedule The measurement schedule
+ * @param[in] descriptions The UnitDescriptions the schedule has been computed for
+ */
+void module_request_next(ModuleRequest *request, const MeasurementSchedule *schedule, const UnitDescription **descriptions) {
+    const uint8_t *slots = schedule_next(schedule, &request->cycle, &request->colID);
+    request->pendingSlots = 0;
+    request->decoded = false;
+    for (size_t i = 0; i < schedule->slotCount; i++) {
+        if (slots[i] == MEASUREMENT_SLOT_NONE) {
+            request->metIDs[i] = 0;
+        } else {
+            request->metIDs[i] = descriptions[slots[i]]->metID;
+            request->pendingSlots |= 1u << i;
+        }
+    }
+    request->pending = true;
+}
+
+/**
+ * @brief Records the completion of the current ResultSet of a module and starts the next one
+ *
+ * @param[inout] request The request state of the module
+ * @param[in] now The current time, CLOCK_MONOTONIC_RAW
+ * @retval The time needed to complete the ResultSet in nanoseconds
+ */
+uint64_t module_request_completed(ModuleRequest *request, const struct timespec *now) {
+    uint64_t latencyNs = elapsed_ns64(&request->setStart, now);
+    request->completions++;
+    request->completionNsTotal += latencyNs;
+    if (latencyNs > request->completionNsMax) {
+        request->completionNsMax = latencyNs;
+    }
+    request->setStart = *now;
+    // the values of the last decode belong to the completed ResultSet
+    request->decoded = false;
+    return latencyNs;
+}
+
+/**
+ * @brief Formats the completion statistics of all modules as a human-readable table
+ *
+ * The table fits into (moduleCount + 1) * MODULE_STATS_LINE_LENGTH bytes.
+ *
+ * @param[in] requests The request state of each module
+ * @param[in] moduleCount The number of modules
+ * @param[out] buf The buffer to write to
+ * @param[in] bufSize The size of the buffer
+ * @retval The length of the resulting string
+ */
+size_t format_module_stats(const ModuleRequest *requests, size_t moduleCount, char *buf, size_t bufSize) {
+    if (bufSize == 0) {
+        return 0;
+    }
+    int written = snprintf(buf, bufSize, "module   completed   mean [ms]    max [ms]     retries    rejected\n");
+    size_t length = written < 0 ? 0 : (size_t)written < bufSize ? (size_t)written : bufSize - 1;
+
+    for (size_t i = 0; i < moduleCount; i++) {
+        const ModuleRequest *request = &requests[i];
+        double meanMs = request->completions > 0
+                        ? (double)request->completionNsTotal / request->completions / 1000000.0 : 0;
+        written = snprintf(buf + length, bufSize - length, "%-8zu %9llu %11.1f %11.1f %11llu %11llu\n",
+                           i, (unsigned long long)request->completions, meanMs,
+                           request->completionNsMax / 1000000.0, (unsigned long long)request->retries,
+                           (unsigned long long)request->rejects);
+        if (written < 0) {
+            break;
+        }
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    return length;
+}
+
+#endif
@@ -9,6 +9,11 @@
 
 #include "MQTTAsync.h"
 #include "collection.h"
+#include "encoder_pool.h"
+#include "harmonics.h"
+#include "send_pacer.h"
+#include "text_format.h"
+#include "topics.h"
 #include "unit_description.h"
 #include "utils.h"
 #include "protobuf/result_set.pb-c.h"
@@ -20,7 +25,24 @@
  * @param[in] response The response data of the request
  */
 void on_connect_success(void *context, MQTTAsync_successData5 *response) {
-    dprintf(LOGLEVEL_INFO, "Connection to the MQTT broker successful\n");
+    // without a Topic Alias Maximum in the CONNACK, the broker does not accept any aliases
+    int aliasMaximum = 0;
+    if (MQTTProperties_hasProperty(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)) {
+        aliasMaximum = MQTTProperties_getNumericValue(&response->properties, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+    }
+    topic_table_connected(&topicTable, aliasMaximum);
+    dprintf(LOGLEVEL_INFO, "Connection to the MQTT broker successful, %d topic aliases allowed\n", aliasMaximum);
+}
+
+/**
+ * @brief Callback for every (re)connection, including the automatic ones
+ *
+ * @param[in] context Context data previously assigned to the callback
+ * @param[in] cause The reason of the connection
+ */
+void on_connected(void *context, char *cause) {
+    // the aliases of the previous connection are gone, the broker's maximum stays as it was
+    topic_table_connected(&topicTable, -1);
 }
 
 /**
@@ -93,19 +115,23 @@ int on_message_arrived(void *context, char *topicName, int topicLen, MQTTAsync_m
 /**
  * @brief Callback for the message delivery confirmed event
  *
- * @param[in] context The context previously assigned to the response options
+ * @param[in] context The context previously assigned to the response options @see pacer_begin
  * @param[in] response The response data of the request
  */
 void on_send(void *context, MQTTAsync_successData5 *response) {
     dprintf(LOGLEVEL_DEBUG,
             "Message with token value %d delivery confirmed\n",
             response->token);
+    uint64_t tag = pacer_finish(&sendPacer, context, true);
+    if (tag != 0) {
+        topic_table_delivered(&topicTable, tag);
+    }
 }
 
 /**
  * @brief Callback for the message sending failed event
  *
- * @param[in] context The context previously assigned to the response options
+ * @param[in] context The context previously assigned to the response options @see pacer_begin
  * @param[in] response The response data of the request
  */
 void on_send_failure(void *context, MQTTAsync_failureData5 *response) {
@@ -113,17 +139,57 @@ void on_send_failure(void *context, MQTTAsync_failureData5 *response) {
             "Sending message failed for token %d, error code: %d\n",
             response->token,
             response->code);
+    pacer_finish(&sendPacer, context, false);
 }
 
-/* MQTT settings */
-const char *MQTT_ADDRESS = "tcp://192.168.1.80:1883";
-const char *MQTT_TOPIC = "wago/energymeter/results";
-const int MQTT_QOS_DEFAULT = 0;
-const char *MQTT_CLIENT_ID = "IoT-Energy-Meter";
-const int MQTT_KEEPALIVE_S = 20;
+/**
+ * @brief The available payload formats for the measurement results
+ */
+typedef enum PayloadFormat {
+    PAYLOAD_PROTOBUF,           ///< ResultSetMsg as defined in protobuf/result_set.proto
+    PAYLOAD_MEASUREMENT_SET,    ///< MeasurementSetMsg as defined in protobuf/result_set.proto
+    PAYLOAD_TEXT,               ///< Human-readable text @see TEXT_FORMAT_PLAIN
+    PAYLOAD_JSON,               ///< JSON @see TEXT_FORMAT_JSON
+    PAYLOAD_INFLUX              ///< InfluxDB line protocol @see TEXT_FORMAT_INFLUX
+} PayloadFormat;
 
-/// whether the topic has already been sent to the server, so we can use an alias istead
-bool topicSent = false;
+#define MQTT_SETTING_LENGTH 128     ///< Maximum length of the address, client ID and topics, including the terminator
+
+/**
+ * @brief The MQTT settings
+ *
+ * They can only be changed by the configuration file at startup, before the client and the
+ * publisher thread are started, and are read-only from then on. @see config_load
+ */
+typedef struct MqttSettings {
+    char address[MQTT_SETTING_LENGTH];
+    char clientID[MQTT_SETTING_LENGTH];
+    char topicPrefix[MQTT_SETTING_LENGTH];      ///< The prefix of all topics @see TopicTable
+    int qos;
+    int keepAliveS;
+    PayloadFormat payloadFormat;
+    bool deltaEncoding;         ///< Whether MeasurementSetMsgs only contain the changes since the previous message of the module
+    uint32_t keyframeInterval;  ///< Every n-th MeasurementSetMsg is a key frame containing the full values
+    bool reportByException;     ///< Whether to only publish values which changed beyond their deadband @see UnitDescription
+    uint32_t reportHeartbeatS;  ///< The maximum time a value goes unreported, after which it is reported regardless
+    uint32_t maxInFlight;       ///< Messages handed to the client at most before their delivery is confirmed @see SendPacer
+    uint32_t deliveryTargetMs;  ///< The delivery latency above which fewer ResultSets are sent
+} MqttSettings;
+
+MqttSettings mqttSettings = {
+    .address = "tcp://192.168.1.80:1883",
+    .clientID = "IoT-Energy-Meter",
+    .topicPrefix = "wago/energymeter",
+    .qos = 0,
+    .keepAliveS = 20,
+    .payloadFormat = PAYLOAD_PROTOBUF,
+    .deltaEncoding = true,
+    .keyframeInterval = 10,
+    .reportByException = true,
+    .reportHeartbeatS = 60,
+    .maxInFlight = 16,
+    .deliveryTargetMs = 1000
+};
 
 /**
  * @brief Initializes the MQTT client and connects it to the broker.
@@ -137,12 +203,13 @@ MQTTAsync MQTT_init_and_connect() {
     createOpts.restoreMessages = 0;
     // No persistence should be fine. Messages get out of date immediately and
     // we can always get a reference value from the module later.
-    MQTTAsync_createWithOptions(&client, MQTT_ADDRESS, MQTT_CLIENT_ID, MQTTCLIENT_PERSISTENCE_NONE, NULL, &createOpts);
+    MQTTAsync_createWithOptions(&client, mqttSettings.address, mqttSettings.clientID, MQTTCLIENT_PERSISTENCE_NONE, NULL, &createOpts);
     MQTTAsync_setCallbacks(client, NULL, on_connection_lost, on_message_arrived, NULL);
+    MQTTAsync_setConnected(client, NULL, on_connected);
 
     MQTTAsync_connectOptions connOpts = MQTTAsync_connectOptions_initializer5;
     connOpts.context = client;
-    connOpts.keepAliveInterval = 20;
+    connOpts.keepAliveInterval = mqttSettings.keepAliveS;
     connOpts.automaticReconnect = 1;
     connOpts.onSuccess5 = on_connect_success;
     connOpts.onFailure5 = on_connect_failure;
@@ -179,36 +246,50 @@ void MQTT_disconnect_and_destroy(MQTTAsync client) {
 }
 
 /**
- * @brief Turns a ResultSet into a human-readable string to be sent out via MQTT.
+ * @brief Turns a ResultSet into a text message to be sent out via MQTT.
  *
  * @param[in] results A pointer to the completed ResultSet instance
- * @retval The resulting string allocated on the heap
+ * @param[in] format The text format to use
+ * @param[in] pool The encoder pool providing the buffer for the module
+ * @param[out] size The size of the resulting message
+ * @retval A pointer to the buffer containing the message, to be returned to the pool
+ *         with encoder_pool_release(), or NULL on failure
  */
-char *get_MQTT_message_string(ResultSet *results) {
-    char resultBuf[4096];
-    char lineBuf[128];
-    memset(resultBuf, 0, sizeof(resultBuf));
-    memset(lineBuf, 0, sizeof(lineBuf));
-
-    sprintf(resultBuf,
-            "Module Index: %u\nTimestamp: %ld.%ld\n",
-            results->moduleIndex,
-            results->timestamp.tv_sec,
-            (long)(results->timestamp.tv_nsec / 1E6));
-    for (size_t i = 0; i < results->size; i++) {
-        sprintf(lineBuf,
-                "%s: %.2f %s\n",
-                results->descriptions[i]->description,
-                results->values[i],
-                results->descriptions[i]->unit);
-        strcat(resultBuf, lineBuf);
+uint8_t *get_MQTT_text_message(ResultSet *results, TextFormat format, EncoderPool *pool, size_t *size) {
+    size_t maxSize = get_text_max_size(results->descriptions, results->size);
+    uint8_t *buf = encoder_pool_acquire(pool, results->moduleIndex, maxSize);
+    if (buf == NULL) {
+        return NULL;
     }
-    char *result = malloc(strlen(resultBuf) + 1);
-    if (result == NULL) {
+    if (!format_results(results, format, (char *)buf, maxSize, size)) {
+        encoder_pool_release(pool, buf);
         return NULL;
     }
-    strcpy(result, resultBuf);
-    return result;
+    return buf;
+}
+
+/**
+ * @brief Computes an upper bound for the packed size of a ResultSetMsg
+ *
+ * Packs a message with three entries per field, all of which take up the maximum number of
+ * bytes their encoding allows. Used for sizing the encoder buffers.
+ *
+ * @retval The maximum packed size of a ResultSetMsg
+ */
+size_t get_MQTT_protobuf_max_size(void) {
+    ResultSetMsg msg = RESULT_SET_MSG__INIT;
+    uint32_t voltage[3] = { UINT32_MAX, UINT32_MAX, UINT32_MAX };
+    int32_t power[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+    msg.index = UINT32_MAX;
+    msg.timestamp = 1;
+    msg.n_voltage = 3;
+    msg.n_effective_power = 3;
+    msg.n_reactive_power = 3;
+    msg.voltage = voltage;
+    msg.effective_power = power;
+    msg.reactive_power = power;
+    return result_set_msg__get_packed_size(&msg);
 }
 
 /**
@@ -222,12 +303,14 @@ char *get_MQTT_message_string(ResultSet *results) {
  * (this is the price to pay for the small memory footprint).
  * 
  * @param[in] results A pointer to the completed ResultSet instance
+ * @param[in] pool The encoder pool providing the buffer for the module
  * @param[out] size The size of the resulting message
- * @retval A pointer to the buffer containing the packed message
+ * @retval A pointer to the buffer containing the packed message, to be returned to the pool
+ *         with encoder_pool_release(), or NULL on failure
  */
-void *get_MQTT_protobuf_message(ResultSet *results, size_t *size) {
+uint8_t *get_MQTT_protobuf_message(ResultSet *results, EncoderPool *pool, size_t *size) {
     ResultSetMsg msg = RESULT_SET_MSG__INIT;
-    void *buf;
+    uint8_t *buf;
     uint32_t voltage[3];
     int32_t effective_power[3];
     int32_t reactive_power[3];
@@ -238,35 +321,41 @@ void *get_MQTT_protobuf_message(ResultSet *results, size_t *size) {
 
     // Fill the results. We trust that the values for each phase are in correct order
     // and there are no duplicate entries, otherwise this would need to be a lot more complicated
-    // Results are upscaled by a factor of 1000 in order to transmit them as integer values, but
-    // perhaps there could be a cleaner way to do it in the future by getting rid of the intermediary
-    // double altogether
+    // Results are transmitted as integer values in thousandths of their unit, which are converted
+    // from the raw values exactly
     size_t v_i = 0, ep_i = 0, rp_i = 0;
-    for (size_t i = 0; i <= results->size; i++) {
+    for (size_t i = 0; i < results->size; i++) {
+        if (results->descriptions[i]->colID != AC_MEASUREMENT) {
+            continue;
+        }
         MET_ID_AC id = results->descriptions[i]->metID;
-        if (id == VOLTAGE_RMS_L1N || id == VOLTAGE_RMS_L2N || id == VOLTAGE_RMS_L3N) {
-            voltage[v_i] = (uint32_t)(results->values[i] * 1000);
+        // more than three values for one field would not fit into the arrays
+        if ((id == VOLTAGE_RMS_L1N || id == VOLTAGE_RMS_L2N || id == VOLTAGE_RMS_L3N) && v_i < 3) {
+            voltage[v_i] = (uint32_t)rescale_raw_value(result_value(results, i),
+                                                       results->descriptions[i]->scaleExponent, 3);
             v_i++;
         }
-        else if (id == POWER_EFFECTIVE_L1 || id == POWER_EFFECTIVE_L2 || id == POWER_EFFECTIVE_L3) {
-            effective_power[ep_i] = (int32_t)(results->values[i] * 1000);
+        else if ((id == POWER_EFFECTIVE_L1 || id == POWER_EFFECTIVE_L2 || id == POWER_EFFECTIVE_L3) && ep_i < 3) {
+            effective_power[ep_i] = (int32_t)rescale_raw_value(result_value(results, i),
+                                                               results->descriptions[i]->scaleExponent, 3);
             ep_i++;
         }
-        else if (id == POWER_REACTIVE_L1 || id == POWER_REACTIVE_L2 || id == POWER_REACTIVE_L3) {
-            reactive_power[rp_i] = (int32_t)(results->values[i] * 1000);
+        else if ((id == POWER_REACTIVE_L1 || id == POWER_REACTIVE_L2 || id == POWER_REACTIVE_L3) && rp_i < 3) {
+            reactive_power[rp_i] = (int32_t)rescale_raw_value(result_value(results, i),
+                                                              results->descriptions[i]->scaleExponent, 3);
             rp_i++;
         }
     }
 
-    msg.n_voltage = 3;
-    msg.n_effective_power = 3;
-    msg.n_reactive_power = 3;
+    msg.n_voltage = v_i;
+    msg.n_effective_power = ep_i;
+    msg.n_reactive_power = rp_i;
     msg.voltage = voltage;
     msg.effective_power = effective_power;
     msg.reactive_power = reactive_power;
 
     *size = result_set_msg__get_packed_size(&msg);
-    buf = malloc(*size);
+    buf = encoder_pool_acquire(pool, results->moduleIndex, *size);
     if (buf == NULL) {
         return NULL;
     }
@@ -276,54 +365,389 @@ void *get_MQTT_protobuf_message(ResultSet *results, size_t *size) {
 }
 
 /**
- * @brief Sends a ResultSet using MQTT 5
+ * @brief Computes an upper bound for the packed size of a MeasurementSetMsg
+ *
+ * @param[in] size The number of measurements
+ * @retval The maximum packed size of a MeasurementSetMsg with the given number of values
+ */
+size_t get_MQTT_measurement_set_max_size(size_t size) {
+    MeasurementSetMsg msg = MEASUREMENT_SET_MSG__INIT;
+    uint32_t maxIds[RESULT_SET_MAX_VALUES];
+    int64_t maxValues[RESULT_SET_MAX_VALUES];
+
+    if (size > RESULT_SET_MAX_VALUES) {
+        size = RESULT_SET_MAX_VALUES;
+    }
+    for (size_t i = 0; i < size; i++) {
+        maxIds[i] = UINT32_MAX;
+        maxValues[i] = INT64_MIN;
+    }
+    msg.index = UINT32_MAX;
+    msg.timestamp = UINT64_MAX;
+    msg.sequence = UINT32_MAX;
+    msg.n_met_id = size;
+    msg.n_scaling_factor = size;
+    msg.n_value = size;
+    msg.met_id = maxIds;
+    msg.scaling_factor = maxIds;
+    msg.value = maxValues;
+    msg.delta = true;
+    msg.n_min = size;
+    msg.n_max = size;
+    msg.n_last = size;
+    msg.n_count = size;
+    msg.n_col_id = size;
+    msg.col_id = maxIds;
+    msg.min = maxValues;
+    msg.max = maxValues;
+    msg.last = maxValues;
+    msg.count = maxIds;
+    return measurement_set_msg__get_packed_size(&msg);
+}
+
+/**
+ * @brief Checks whether the next MeasurementSetMsg of a module has to be a key frame
+ *
+ * @param[in] delta The delta encoding state of the module
+ * @param[in] size The number of measurements of the ResultSet to pack
+ */
+bool measurement_set_key_frame_due(const DeltaState *delta, size_t size) {
+    return !mqttSettings.deltaEncoding || delta->resync || delta->size != size
+           || delta->sinceKeyFrame + 1 >= mqttSettings.keyframeInterval;
+}
+
+/**
+ * @brief Packs a given ResultSet into a MeasurementSetMsg Protocol buffer
+ *
+ * Unlike ResultSetMsg, this works for any list of measurements. The values are sent as the
+ * raw integers of the process image, which take up only a few bytes as zigzag varints. With
+ * delta encoding, every keyframeInterval-th message is a key frame containing the full values
+ * along with the measurement IDs and scaling factors, and so is the first one after messages
+ * may have been lost. All others contain the differences to the previously sent value of each
+ * measurement, which are usually close to 0. Only the values included according to
+ * result_included() are packed; if these are not all values, their measurement IDs are always
+ * sent along. Aggregated values are sent as their means, followed by the remaining statistics.
+ *
+ * @see MqttSettings
+ *
+ * @param[in] results A pointer to the completed ResultSet instance
+ * @param[in] pool The encoder pool providing the buffer and delta state for the module
+ * @param[out] size The size of the resulting message
+ * @retval A pointer to the buffer containing the packed message, to be returned to the pool
+ *         with encoder_pool_release(), or NULL on failure
+ */
+uint8_t *get_MQTT_measurement_set_message(ResultSet *results, EncoderPool *pool, size_t *size) {
+    MeasurementSetMsg msg = MEASUREMENT_SET_MSG__INIT;
+    uint8_t *buf;
+    uint32_t colIds[RESULT_SET_MAX_VALUES];
+    uint32_t metIds[RESULT_SET_MAX_VALUES];
+    uint32_t scalingFactors[RESULT_SET_MAX_VALUES];
+    int64_t values[RESULT_SET_MAX_VALUES];
+    int64_t mins[RESULT_SET_MAX_VALUES];
+    int64_t maxs[RESULT_SET_MAX_VALUES];
+    int64_t lasts[RESULT_SET_MAX_VALUES];
+    uint32_t counts[RESULT_SET_MAX_VALUES];
+
+    if (results->size > RESULT_SET_MAX_VALUES || results->moduleIndex >= pool->bufferCount) {
+        return NULL;
+    }
+    DeltaState *delta = &pool->deltas[results->moduleIndex];
+
+    size_t count = 0;
+    for (size_t i = 0; i < results->size; i++) {
+        count += result_included(results, i);
+    }
+    bool complete = count == results->size;
+    bool keyFrame = measurement_set_key_frame_due(delta, results->size);
+
+    msg.index = results->moduleIndex;
+    msg.timestamp = (uint64_t)results->timestamp.tv_sec * 1000000000 + results->timestamp.tv_nsec;
+    msg.sequence = delta->sequence;
+    msg.delta = !keyFrame;
+
+    size_t n = 0;
+    bool allAC = true;
+    for (size_t i = 0; i < results->size; i++) {
+        if (!result_included(results, i)) {
+            continue;
+        }
+        const UnitDescription *description = results->descriptions[i];
+        int64_t raw = result_value(results, i);
+        colIds[n] = description->colID;
+        allAC &= description->colID == AC_MEASUREMENT;
+        metIds[n] = description->metID;
+        scalingFactors[n] = description->scalingFactor;
+        values[n] = keyFrame ? raw : raw - delta->previous[i];
+        delta->previous[i] = raw;
+        if (results->aggregates != NULL) {
+            const Aggregate *aggregate = &results->aggregates[i];
+            mins[n] = aggregate->min;
+            maxs[n] = aggregate->max;
+            lasts[n] = aggregate->last;
+            counts[n] = aggregate->count;
+        }
+        n++;
+    }
+    if (keyFrame || !complete) {
+        msg.n_met_id = n;
+        msg.met_id = metIds;
+        if (!allAC) {
+            msg.n_col_id = n;
+            msg.col_id = colIds;
+        }
+    }
+    if (keyFrame) {
+        msg.n_scaling_factor = n;
+        msg.scaling_factor = scalingFactors;
+    }
+    msg.n_value = n;
+    msg.value = values;
+    if (results->aggregates != NULL) {
+        msg.n_min = n;
+        msg.n_max = n;
+        msg.n_last = n;
+        msg.n_count = n;
+        msg.min = mins;
+        msg.max = maxs;
+        msg.last = lasts;
+        msg.count = counts;
+    }
+
+    delta->size = results->size;
+    delta->sinceKeyFrame = keyFrame ? 0 : delta->sinceKeyFrame + 1;
+    delta->resync = false;
+    delta->sequence++;
+
+    *size = measurement_set_msg__get_packed_size(&msg);
+    buf = encoder_pool_acquire(pool, results->moduleIndex, *size);
+    if (buf == NULL) {
+        delta->resync = true;
+        return NULL;
+    }
+
+    measurement_set_msg__pack(&msg, buf);
+    return buf;
+}
+
+/**
+ * @brief Computes an upper bound for the packed size of a HarmonicSpectrumMsg
+ */
+size_t get_MQTT_harmonic_spectrum_max_size(void) {
+    HarmonicSpectrumMsg msg = HARMONIC_SPECTRUM_MSG__INIT;
+    uint32_t maxValues[HARMONIC_MAX_ORDER];
+
+    for (size_t i = 0; i < HARMONIC_MAX_ORDER; i++) {
+        maxValues[i] = UINT32_MAX;
+    }
+    msg.index = UINT32_MAX;
+    msg.timestamp = UINT64_MAX;
+    msg.col_id = UINT32_MAX;
+    msg.thd = UINT32_MAX;
+    msg.n_order = HARMONIC_MAX_ORDER;
+    msg.n_amplitude = HARMONIC_MAX_ORDER;
+    msg.order = maxValues;
+    msg.amplitude = maxValues;
+    return harmonic_spectrum_msg__get_packed_size(&msg);
+}
+
+/**
+ * @brief Packs the harmonics of one phase into a HarmonicSpectrumMsg Protocol buffer
+ *
+ * @param[in] results A pointer to the completed ResultSet instance
+ * @param[in] spectrum The harmonics of the phase gathered from the ResultSet
+ * @param[in] pool The encoder pool providing the buffer for the module
+ * @param[out] size The size of the resulting message
+ * @retval A pointer to the buffer containing the packed message, to be returned to the pool
+ *         with encoder_pool_release(), or NULL on failure
+ */
+uint8_t *get_MQTT_harmonic_spectrum_message(const ResultSet *results, HarmonicSpectrum *spectrum,
+                                            EncoderPool *pool, size_t *size) {
+    HarmonicSpectrumMsg msg = HARMONIC_SPECTRUM_MSG__INIT;
+    uint8_t *buf;
+
+    msg.index = results->moduleIndex;
+    msg.timestamp = (uint64_t)results->timestamp.tv_sec * 1000000000 + results->timestamp.tv_nsec;
+    msg.col_id = spectrum->colID;
+    msg.thd = harmonic_thd(spectrum);
+    msg.n_order = spectrum->count;
+    msg.n_amplitude = spectrum->count;
+    msg.order = spectrum->orders;
+    msg.amplitude = spectrum->amplitudes;
+
+    *size = harmonic_spectrum_msg__get_packed_size(&msg);
+    buf = encoder_pool_acquire(pool, results->moduleIndex, *size);
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    harmonic_spectrum_msg__pack(&msg, buf);
+    return buf;
+}
+
+/**
+ * @brief Checks whether the configured payload format can carry a measurement
+ */
+bool MQTT_payload_carries(const UnitDescription *description) {
+    // a ResultSetMsg only has fields for AC measurements, harmonics are sent as spectra only
+    return mqttSettings.payloadFormat != PAYLOAD_PROTOBUF || description->colID == AC_MEASUREMENT;
+}
+
+/**
+ * @brief Checks whether the configured payload format can represent a subset of the measurements
+ */
+bool MQTT_payload_allows_partial(void) {
+    // the fields of a ResultSetMsg are identified by their position only
+    return mqttSettings.payloadFormat != PAYLOAD_PROTOBUF;
+}
+
+/**
+ * @brief Checks whether the next message of a module has to be a key frame carrying all values
+ *
+ * This is only ever the case for MeasurementSetMsgs with delta encoding, as all other
+ * messages stand on their own anyway.
+ *
+ * @param[in] pool The encoder pool holding the delta encoding state of the modules
+ * @param[in] results The ResultSet to pack next
+ */
+bool MQTT_key_frame_due(const EncoderPool *pool, const ResultSet *results) {
+    return mqttSettings.payloadFormat == PAYLOAD_MEASUREMENT_SET && mqttSettings.deltaEncoding
+           && results->moduleIndex < pool->bufferCount
+           && measurement_set_key_frame_due(&pool->deltas[results->moduleIndex], results->size);
+}
+
+/**
+ * @brief Computes the size of the encoder buffers required for the configured payload format
+ *
+ * @param[in] descriptions The measurements making up each ResultSet
+ * @param[in] size The number of measurements
+ * @retval The maximum size of an encoded message
+ */
+size_t get_MQTT_message_max_size(const UnitDescription **descriptions, size_t size) {
+    size_t maxSize;
+    switch (mqttSettings.payloadFormat) {
+        case PAYLOAD_PROTOBUF:
+            maxSize = get_MQTT_protobuf_max_size();
+            break;
+        case PAYLOAD_MEASUREMENT_SET:
+            maxSize = get_MQTT_measurement_set_max_size(size);
+            break;
+        default:
+            maxSize = get_text_max_size(descriptions, size);
+    }
+    // the same buffers encode the harmonic spectra
+    for (size_t i = 0; i < size; i++) {
+        if (is_harmonic_collection(descriptions[i]->colID)) {
+            size_t spectrumSize = get_MQTT_harmonic_spectrum_max_size();
+            return spectrumSize > maxSize ? spectrumSize : maxSize;
+        }
+    }
+    return maxSize;
+}
+
+/**
+ * @brief Encodes a ResultSet in the configured payload format
+ *
+ * @param[in] results A pointer to the completed ResultSet
+ * @param[in] pool The encoder pool to encode the message with
+ * @param[out] size The size of the resulting message
+ * @retval A pointer to the buffer containing the message, to be returned to the pool with
+ *         encoder_pool_release(), or NULL on failure
+ */
+uint8_t *get_MQTT_message(ResultSet *results, EncoderPool *pool, size_t *size) {
+    uint8_t *msg;
+    switch (mqttSettings.payloadFormat) {
+        case PAYLOAD_TEXT:
+            msg = get_MQTT_text_message(results, TEXT_FORMAT_PLAIN, pool, size);
+            break;
+        case PAYLOAD_JSON:
+            msg = get_MQTT_text_message(results, TEXT_FORMAT_JSON, pool, size);
+            break;
+        case PAYLOAD_INFLUX:
+            msg = get_MQTT_text_message(results, TEXT_FORMAT_INFLUX, pool, size);
+            break;
+        case PAYLOAD_MEASUREMENT_SET:
+            msg = get_MQTT_measurement_set_message(results, pool, size);
+            break;
+        default:
+            msg = get_MQTT_protobuf_message(results, pool, size);
+    }
+    if (msg == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to create the MQTT message\n");
+    }
+    return msg;
+}
+
+/**
+ * @brief Sends a payload to one of the topics using MQTT 5
+ *
+ * The topic is addressed by its alias where the broker allows one. @see TopicTable
+ * Paho copies the payload, so the buffer can be reused right after sending.
  *
  * @param[in] client The properly initialized MQTT client
- * @param[in] results A pointer to the comleted ResultSet
+ * @param[in] topicIndex The number of the topic in topicTable
+ * @param[in] payload The payload
+ * @param[in] length The length of the payload
+ * @param[in] contentEncoding The compression of the payload, sent as the content-encoding user
+ *            property, or NULL if it is not compressed @see Compressor
  * @retval ERROR_SUCCESS on success, another error code otherwise
  */
-ErrorCode send_MQTT5_message(MQTTAsync client, ResultSet *results) {
+ErrorCode send_MQTT5_payload(MQTTAsync client, size_t topicIndex, const void *payload, size_t length,
+                             const char *contentEncoding) {
+    char topic[TOPIC_NAME_LENGTH];
+    uint16_t alias;
+    uint64_t tag = topic_table_resolve(&topicTable, topicIndex, topic, &alias);
+
     MQTTAsync_responseOptions responseOpts = MQTTAsync_responseOptions_initializer;
     responseOpts.onSuccess5 = on_send;
     responseOpts.onFailure5 = on_send_failure;
-    responseOpts.context = client;
+    responseOpts.context = pacer_begin(&sendPacer, tag);
 
-    // Paho will handle the deallocation of msg for us, so we don't have to worry about it
-    size_t msgLength;
-    void *msg = get_MQTT_protobuf_message(results, &msgLength);
-    if (msg == NULL) {
-        dprintf(LOGLEVEL_ERR, "Failed to create the MQTT message\n");
-        return -ERROR_MQTT_MSG_CREATION_FAILED;
-    }
     MQTTProperties messageProps = MQTTProperties_initializer;
-    MQTTProperty aliasProp = {
-        .identifier = MQTTPROPERTY_CODE_TOPIC_ALIAS,
-        .value = { .integer2 = 1 }
-    };
-    messageProps.array = &aliasProp;
-    messageProps.length = sizeof(aliasProp);
-    messageProps.count = 1;
-    messageProps.max_count = 1;
+    MQTTProperty props[2];
+    messageProps.array = props;
+    if (alias != 0) {
+        props[messageProps.count++] = (MQTTProperty) {
+            .identifier = MQTTPROPERTY_CODE_TOPIC_ALIAS,
+            .value = { .integer2 = alias }
+        };
+    }
+    if (contentEncoding != NULL) {
+        MQTTProperty encodingProp = { .identifier = MQTTPROPERTY_CODE_USER_PROPERTY };
+        encodingProp.value.data.data = "content-encoding";
+        encodingProp.value.data.len = strlen(encodingProp.value.data.data);
+        encodingProp.value.value.data = (char *)contentEncoding;
+        encodingProp.value.value.len = strlen(contentEncoding);
+        props[messageProps.count++] = encodingProp;
+    }
+    messageProps.length = messageProps.count * sizeof(MQTTProperty);
+    messageProps.max_count = messageProps.count;
 
     MQTTAsync_message message = MQTTAsync_message_initializer;
-    message.payload = msg;
-    message.payloadlen = msgLength;
-    message.qos = MQTT_QOS_DEFAULT;
+    message.payload = (void *)payload;
+    message.payloadlen = length;
+    message.qos = mqttSettings.qos;
     message.properties = messageProps;
 
-    const char *topic = topicSent ? "" : MQTT_TOPIC;
-
     int pubResult;
     if ((pubResult = MQTTAsync_sendMessage(client, topic, &message, &responseOpts)) != MQTTASYNC_SUCCESS) {
         dprintf(LOGLEVEL_ERR, "Failed to start sendMessage, return code %d\n", pubResult);
+        pacer_finish(&sendPacer, responseOpts.context, false);
         return -ERROR_MQTT_MSG_SEND_FAILED;
-    } else {
-        // this is rather simplistic - would would want to make sure our first message has actually
-        // been received by the server when using this in production
-        topicSent = true;
     }
 
     return ERROR_SUCCESS;
 }
 
+/**
+ * @brief Sends a plain text message to one of the topics
+ *
+ * @param[in] client The properly initialized MQTT client
+ * @param[in] topicIndex The number of the topic in topicTable
+ * @param[in] text The null-terminated message text
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode send_MQTT5_text(MQTTAsync client, size_t topicIndex, const char *text) {
+    return send_MQTT5_payload(client, topicIndex, text, strlen(text), NULL);
+}
+
 #endif
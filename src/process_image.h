@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 /**
  * @brief Reads a uint32 from a buffer where bytes are in ascending order.
@@ -13,9 +14,9 @@
  */
 uint32_t read_uint32(uint8_t *buf) {
     uint32_t result = 0;
-    result |= buf[3] << 24;
-    result |= buf[2] << 16;
-    result |= buf[1] << 8;
+    result |= (uint32_t)buf[3] << 24;
+    result |= (uint32_t)buf[2] << 16;
+    result |= (uint32_t)buf[1] << 8;
     result |= buf[0];
     return result;
 }
@@ -112,23 +113,38 @@ typedef struct Type495ProcessInput {
 } __attribute__((packed)) Type495ProcessInput;
 
 /**
- * @brief Checks whether some measurements in the collection are still unstable or not available
+ * @brief Checks whether a process value is out of the specified value domain
  *
  * @param[in] input The process input image obtained from the module
- * @param[in] iMax The maximum index to check for
+ * @param[in] slot The index of the process value, 0 to 3
  *
- * @retval true if the valuesUnstable flag is set or any of the metIDs are 0, false otherwise
+ * @retval true if the outOfRange flag of the process value is set, false otherwise
  */
-bool results_unstable(Type495ProcessInput *input, const size_t iMax) {
-    if (input->valuesUnstable) {
-        return true;
+bool process_value_out_of_range(const Type495ProcessInput *input, size_t slot) {
+    switch (slot) {
+        case 0: return input->outOfRange1;
+        case 1: return input->outOfRange2;
+        case 2: return input->outOfRange3;
+        case 3: return input->outOfRange4;
+        default: return true;
     }
-    for (size_t i = 0; i < iMax; i++) {
-        if (input->metID[i] == 0) {
-            return true;
-        }
-    }
-    return false;
+}
+
+/**
+ * @brief Checks whether two process input images are identical
+ *
+ * The images are compared in three 64-bit words, which compiles to a few loads and no branches
+ * but the last on any target, instead of a call to memcmp().
+ *
+ * @retval true if all bytes of the images are equal, false otherwise
+ */
+bool process_input_equal(const Type495ProcessInput *a, const Type495ProcessInput *b) {
+    _Static_assert(sizeof(Type495ProcessInput) == 3 * sizeof(uint64_t), "unexpected size of the process input");
+    uint64_t wordsA[3], wordsB[3];
+    // the images are packed and need not be aligned
+    memcpy(wordsA, a, sizeof(wordsA));
+    memcpy(wordsB, b, sizeof(wordsB));
+    return ((wordsA[0] ^ wordsB[0]) | (wordsA[1] ^ wordsB[1]) | (wordsA[2] ^ wordsB[2])) == 0;
 }
 
 #endif
@@ -52,6 +52,141 @@ void   result_set_msg__free_unpacked
   assert(message->base.descriptor == &result_set_msg__descriptor);
   protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
 }
+void   measurement_set_msg__init
+                     (MeasurementSetMsg         *message)
+{
+  static const MeasurementSetMsg init_value = MEASUREMENT_SET_MSG__INIT;
+  *message = init_value;
+}
+size_t measurement_set_msg__get_packed_size
+                     (const MeasurementSetMsg *message)
+{
+  assert(message->base.descriptor == &measurement_set_msg__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t measurement_set_msg__pack
+                     (const MeasurementSetMsg *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &measurement_set_msg__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t measurement_set_msg__pack_to_buffer
+                     (const MeasurementSetMsg *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &measurement_set_msg__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+MeasurementSetMsg *
+       measurement_set_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (MeasurementSetMsg *)
+     protobuf_c_message_unpack (&measurement_set_msg__descriptor,
+                                allocator, len, data);
+}
+void   measurement_set_msg__free_unpacked
+                     (MeasurementSetMsg *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &measurement_set_msg__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
+void   harmonic_spectrum_msg__init
+                     (HarmonicSpectrumMsg         *message)
+{
+  static const HarmonicSpectrumMsg init_value = HARMONIC_SPECTRUM_MSG__INIT;
+  *message = init_value;
+}
+size_t harmonic_spectrum_msg__get_packed_size
+                     (const HarmonicSpectrumMsg *message)
+{
+  assert(message->base.descriptor == &harmonic_spectrum_msg__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t harmonic_spectrum_msg__pack
+                     (const HarmonicSpectrumMsg *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &harmonic_spectrum_msg__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t harmonic_spectrum_msg__pack_to_buffer
+                     (const HarmonicSpectrumMsg *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &harmonic_spectrum_msg__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+HarmonicSpectrumMsg *
+       harmonic_spectrum_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (HarmonicSpectrumMsg *)
+     protobuf_c_message_unpack (&harmonic_spectrum_msg__descriptor,
+                                allocator, len, data);
+}
+void   harmonic_spectrum_msg__free_unpacked
+                     (HarmonicSpectrumMsg *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &harmonic_spectrum_msg__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
+void   batch_msg__init
+                     (BatchMsg         *message)
+{
+  static const BatchMsg init_value = BATCH_MSG__INIT;
+  *message = init_value;
+}
+size_t batch_msg__get_packed_size
+                     (const BatchMsg *message)
+{
+  assert(message->base.descriptor == &batch_msg__descriptor);
+  return protobuf_c_message_get_packed_size ((const ProtobufCMessage*)(message));
+}
+size_t batch_msg__pack
+                     (const BatchMsg *message,
+                      uint8_t       *out)
+{
+  assert(message->base.descriptor == &batch_msg__descriptor);
+  return protobuf_c_message_pack ((const ProtobufCMessage*)message, out);
+}
+size_t batch_msg__pack_to_buffer
+                     (const BatchMsg *message,
+                      ProtobufCBuffer *buffer)
+{
+  assert(message->base.descriptor == &batch_msg__descriptor);
+  return protobuf_c_message_pack_to_buffer ((const ProtobufCMessage*)message, buffer);
+}
+BatchMsg *
+       batch_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data)
+{
+  return (BatchMsg *)
+     protobuf_c_message_unpack (&batch_msg__descriptor,
+                                allocator, len, data);
+}
+void   batch_msg__free_unpacked
+                     (BatchMsg *message,
+                      ProtobufCAllocator *allocator)
+{
+  if(!message)
+    return;
+  assert(message->base.descriptor == &batch_msg__descriptor);
+  protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
+}
 static const ProtobufCFieldDescriptor result_set_msg__field_descriptors[5] =
 {
   {
@@ -142,3 +277,364 @@ const ProtobufCMessageDescriptor result_set_msg__descriptor =
   (ProtobufCMessageInit) result_set_msg__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
+static const ProtobufCFieldDescriptor measurement_set_msg__field_descriptors[12] =
+{
+  {
+    "index",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(MeasurementSetMsg, index),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "timestamp",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_FIXED64,
+    0,   /* quantifier_offset */
+    offsetof(MeasurementSetMsg, timestamp),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "sequence",
+    3,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(MeasurementSetMsg, sequence),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "met_id",
+    4,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(MeasurementSetMsg, n_met_id),
+    offsetof(MeasurementSetMsg, met_id),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "scaling_factor",
+    5,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(MeasurementSetMsg, n_scaling_factor),
+    offsetof(MeasurementSetMsg, scaling_factor),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "value",
+    6,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_SINT64,
+    offsetof(MeasurementSetMsg, n_value),
+    offsetof(MeasurementSetMsg, value),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "delta",
+    7,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(MeasurementSetMsg, delta),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "min",
+    8,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_SINT64,
+    offsetof(MeasurementSetMsg, n_min),
+    offsetof(MeasurementSetMsg, min),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "max",
+    9,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_SINT64,
+    offsetof(MeasurementSetMsg, n_max),
+    offsetof(MeasurementSetMsg, max),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "last",
+    10,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_SINT64,
+    offsetof(MeasurementSetMsg, n_last),
+    offsetof(MeasurementSetMsg, last),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "count",
+    11,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(MeasurementSetMsg, n_count),
+    offsetof(MeasurementSetMsg, count),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "col_id",
+    12,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(MeasurementSetMsg, n_col_id),
+    offsetof(MeasurementSetMsg, col_id),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned measurement_set_msg__field_indices_by_name[] = {
+  11,   /* field[11] = col_id */
+  10,   /* field[10] = count */
+  6,   /* field[6] = delta */
+  0,   /* field[0] = index */
+  9,   /* field[9] = last */
+  8,   /* field[8] = max */
+  3,   /* field[3] = met_id */
+  7,   /* field[7] = min */
+  4,   /* field[4] = scaling_factor */
+  2,   /* field[2] = sequence */
+  1,   /* field[1] = timestamp */
+  5,   /* field[5] = value */
+};
+static const ProtobufCIntRange measurement_set_msg__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 12 }
+};
+const ProtobufCMessageDescriptor measurement_set_msg__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "MeasurementSetMsg",
+  "MeasurementSetMsg",
+  "MeasurementSetMsg",
+  "",
+  sizeof(MeasurementSetMsg),
+  12,
+  measurement_set_msg__field_descriptors,
+  measurement_set_msg__field_indices_by_name,
+  1,  measurement_set_msg__number_ranges,
+  (ProtobufCMessageInit) measurement_set_msg__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor harmonic_spectrum_msg__field_descriptors[6] =
+{
+  {
+    "index",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(HarmonicSpectrumMsg, index),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "timestamp",
+    2,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_FIXED64,
+    0,   /* quantifier_offset */
+    offsetof(HarmonicSpectrumMsg, timestamp),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "col_id",
+    3,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(HarmonicSpectrumMsg, col_id),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "thd",
+    4,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(HarmonicSpectrumMsg, thd),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "order",
+    5,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(HarmonicSpectrumMsg, n_order),
+    offsetof(HarmonicSpectrumMsg, order),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "amplitude",
+    6,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_UINT32,
+    offsetof(HarmonicSpectrumMsg, n_amplitude),
+    offsetof(HarmonicSpectrumMsg, amplitude),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned harmonic_spectrum_msg__field_indices_by_name[] = {
+  5,   /* field[5] = amplitude */
+  2,   /* field[2] = col_id */
+  0,   /* field[0] = index */
+  4,   /* field[4] = order */
+  3,   /* field[3] = thd */
+  1,   /* field[1] = timestamp */
+};
+static const ProtobufCIntRange harmonic_spectrum_msg__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 6 }
+};
+const ProtobufCMessageDescriptor harmonic_spectrum_msg__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "HarmonicSpectrumMsg",
+  "HarmonicSpectrumMsg",
+  "HarmonicSpectrumMsg",
+  "",
+  sizeof(HarmonicSpectrumMsg),
+  6,
+  harmonic_spectrum_msg__field_descriptors,
+  harmonic_spectrum_msg__field_indices_by_name,
+  1,  harmonic_spectrum_msg__number_ranges,
+  (ProtobufCMessageInit) harmonic_spectrum_msg__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
+static const ProtobufCFieldDescriptor batch_msg__field_descriptors[4] =
+{
+  {
+    "timestamp",
+    1,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_FIXED64,
+    0,   /* quantifier_offset */
+    offsetof(BatchMsg, timestamp),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "timestamp_offset",
+    2,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_SINT64,
+    offsetof(BatchMsg, n_timestamp_offset),
+    offsetof(BatchMsg, timestamp_offset),
+    NULL,
+    NULL,
+    0 | PROTOBUF_C_FIELD_FLAG_PACKED,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "result_set",
+    3,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_MESSAGE,
+    offsetof(BatchMsg, n_result_set),
+    offsetof(BatchMsg, result_set),
+    &result_set_msg__descriptor,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "measurement_set",
+    4,
+    PROTOBUF_C_LABEL_REPEATED,
+    PROTOBUF_C_TYPE_MESSAGE,
+    offsetof(BatchMsg, n_measurement_set),
+    offsetof(BatchMsg, measurement_set),
+    &measurement_set_msg__descriptor,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+};
+static const unsigned batch_msg__field_indices_by_name[] = {
+  3,   /* field[3] = measurement_set */
+  2,   /* field[2] = result_set */
+  0,   /* field[0] = timestamp */
+  1,   /* field[1] = timestamp_offset */
+};
+static const ProtobufCIntRange batch_msg__number_ranges[1 + 1] =
+{
+  { 1, 0 },
+  { 0, 4 }
+};
+const ProtobufCMessageDescriptor batch_msg__descriptor =
+{
+  PROTOBUF_C__MESSAGE_DESCRIPTOR_MAGIC,
+  "BatchMsg",
+  "BatchMsg",
+  "BatchMsg",
+  "",
+  sizeof(BatchMsg),
+  4,
+  batch_msg__field_descriptors,
+  batch_msg__field_indices_by_name,
+  1,  batch_msg__number_ranges,
+  (ProtobufCMessageInit) batch_msg__init,
+  NULL,NULL,NULL    /* reserved[123] */
+};
@@ -16,6 +16,9 @@ PROTOBUF_C__BEGIN_DECLS
 
 
 typedef struct _ResultSetMsg ResultSetMsg;
+typedef struct _MeasurementSetMsg MeasurementSetMsg;
+typedef struct _HarmonicSpectrumMsg HarmonicSpectrumMsg;
+typedef struct _BatchMsg BatchMsg;
 
 
 /* --- enums --- */
@@ -40,6 +43,84 @@ struct  _ResultSetMsg
     , 0, 0, 0,NULL, 0,NULL, 0,NULL }
 
 
+struct  _MeasurementSetMsg
+{
+  ProtobufCMessage base;
+  uint32_t index;
+  /*
+   * nanoseconds since the epoch
+   */
+  uint64_t timestamp;
+  uint32_t sequence;
+  size_t n_met_id;
+  uint32_t *met_id;
+  size_t n_scaling_factor;
+  uint32_t *scaling_factor;
+  size_t n_value;
+  int64_t *value;
+  protobuf_c_boolean delta;
+  /*
+   * statistics over the aggregation windows, in the same order as the values, which then hold
+   * the means. Only present if the values have been aggregated, never delta encoded.
+   */
+  size_t n_min;
+  int64_t *min;
+  size_t n_max;
+  int64_t *max;
+  size_t n_last;
+  int64_t *last;
+  size_t n_count;
+  uint32_t *count;
+  size_t n_col_id;
+  uint32_t *col_id;
+};
+#define MEASUREMENT_SET_MSG__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&measurement_set_msg__descriptor) \
+    , 0, 0, 0, 0,NULL, 0,NULL, 0,NULL, 0, 0,NULL, 0,NULL, 0,NULL, 0,NULL, 0,NULL }
+
+
+struct  _HarmonicSpectrumMsg
+{
+  ProtobufCMessage base;
+  uint32_t index;
+  /*
+   * nanoseconds since the epoch
+   */
+  uint64_t timestamp;
+  /*
+   * the harmonic analysis collection of the phase
+   */
+  uint32_t col_id;
+  uint32_t thd;
+  size_t n_order;
+  uint32_t *order;
+  size_t n_amplitude;
+  uint32_t *amplitude;
+};
+#define HARMONIC_SPECTRUM_MSG__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&harmonic_spectrum_msg__descriptor) \
+    , 0, 0, 0, 0, 0,NULL, 0,NULL }
+
+
+struct  _BatchMsg
+{
+  ProtobufCMessage base;
+  /*
+   * nanoseconds since the epoch
+   */
+  uint64_t timestamp;
+  size_t n_timestamp_offset;
+  int64_t *timestamp_offset;
+  size_t n_result_set;
+  ResultSetMsg **result_set;
+  size_t n_measurement_set;
+  MeasurementSetMsg **measurement_set;
+};
+#define BATCH_MSG__INIT \
+ { PROTOBUF_C_MESSAGE_INIT (&batch_msg__descriptor) \
+    , 0, 0,NULL, 0,NULL, 0,NULL }
+
+
 /* ResultSetMsg methods */
 void   result_set_msg__init
                      (ResultSetMsg         *message);
@@ -59,11 +140,77 @@ ResultSetMsg *
 void   result_set_msg__free_unpacked
                      (ResultSetMsg *message,
                       ProtobufCAllocator *allocator);
+/* MeasurementSetMsg methods */
+void   measurement_set_msg__init
+                     (MeasurementSetMsg         *message);
+size_t measurement_set_msg__get_packed_size
+                     (const MeasurementSetMsg   *message);
+size_t measurement_set_msg__pack
+                     (const MeasurementSetMsg   *message,
+                      uint8_t             *out);
+size_t measurement_set_msg__pack_to_buffer
+                     (const MeasurementSetMsg   *message,
+                      ProtobufCBuffer     *buffer);
+MeasurementSetMsg *
+       measurement_set_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   measurement_set_msg__free_unpacked
+                     (MeasurementSetMsg *message,
+                      ProtobufCAllocator *allocator);
+/* HarmonicSpectrumMsg methods */
+void   harmonic_spectrum_msg__init
+                     (HarmonicSpectrumMsg         *message);
+size_t harmonic_spectrum_msg__get_packed_size
+                     (const HarmonicSpectrumMsg   *message);
+size_t harmonic_spectrum_msg__pack
+                     (const HarmonicSpectrumMsg   *message,
+                      uint8_t             *out);
+size_t harmonic_spectrum_msg__pack_to_buffer
+                     (const HarmonicSpectrumMsg   *message,
+                      ProtobufCBuffer     *buffer);
+HarmonicSpectrumMsg *
+       harmonic_spectrum_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   harmonic_spectrum_msg__free_unpacked
+                     (HarmonicSpectrumMsg *message,
+                      ProtobufCAllocator *allocator);
+/* BatchMsg methods */
+void   batch_msg__init
+                     (BatchMsg         *message);
+size_t batch_msg__get_packed_size
+                     (const BatchMsg   *message);
+size_t batch_msg__pack
+                     (const BatchMsg   *message,
+                      uint8_t             *out);
+size_t batch_msg__pack_to_buffer
+                     (const BatchMsg   *message,
+                      ProtobufCBuffer     *buffer);
+BatchMsg *
+       batch_msg__unpack
+                     (ProtobufCAllocator  *allocator,
+                      size_t               len,
+                      const uint8_t       *data);
+void   batch_msg__free_unpacked
+                     (BatchMsg *message,
+                      ProtobufCAllocator *allocator);
 /* --- per-message closures --- */
 
 typedef void (*ResultSetMsg_Closure)
                  (const ResultSetMsg *message,
                   void *closure_data);
+typedef void (*MeasurementSetMsg_Closure)
+                 (const MeasurementSetMsg *message,
+                  void *closure_data);
+typedef void (*HarmonicSpectrumMsg_Closure)
+                 (const HarmonicSpectrumMsg *message,
+                  void *closure_data);
+typedef void (*BatchMsg_Closure)
+                 (const BatchMsg *message,
+                  void *closure_data);
 
 /* --- services --- */
 
@@ -71,6 +218,9 @@ typedef void (*ResultSetMsg_Closure)
 /* --- descriptors --- */
 
 extern const ProtobufCMessageDescriptor result_set_msg__descriptor;
+extern const ProtobufCMessageDescriptor measurement_set_msg__descriptor;
+extern const ProtobufCMessageDescriptor harmonic_spectrum_msg__descriptor;
+extern const ProtobufCMessageDescriptor batch_msg__descriptor;
 
 PROTOBUF_C__END_DECLS
 
@@ -0,0 +1,662 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "MQTTAsync.h"
+#include "aggregation.h"
+#include "batch.h"
+#include "compression.h"
+#include "cycle_stats.h"
+#include "encoder_pool.h"
+#include "mqtt.h"
+#include "report_filter.h"
+#include "send_pacer.h"
+#include "spool.h"
+#include "unit_description.h"
+#include "utils.h"
+
+#define PUBLISH_QUEUE_CAPACITY 64   ///< Number of frames the queue can hold, must be a power of two
+#define PUBLISHER_IDLE_TIMEOUT_MS 1000
+#define SPOOL_DRAIN_INTERVAL_MS 50  ///< How often the publisher sends from the store-and-forward buffer while it drains
+#define SPOOL_BACKLOG_CHECK_S 60    ///< How often the publisher checks whether the backlog shrinks while connected
+#define STATS_PUBLISH_INTERVAL_S 60
+#define STATS_BUFFER_SIZE 2048
+
+/**
+ * @brief A self-contained copy of a completed ResultSet
+ */
+typedef struct ResultFrame {
+    const UnitDescription **descriptions;        ///< The descriptions of the values, shared with the ResultSet
+    size_t size;                                 ///< The number of values
+    size_t moduleIndex;                          ///< Index of the power measurement module on the bus
+    struct timespec timestamp;                   ///< The timestamp when the set was completed
+    uint32_t values[RESULT_SET_MAX_VALUES];      ///< The raw result values
+    bool included[RESULT_SET_MAX_VALUES];        ///< Whether each value is present
+    bool aggregated;                             ///< Whether aggregates holds the statistics of the values
+    Aggregate aggregates[RESULT_SET_MAX_VALUES]; ///< The statistics of the values, if aggregated
+} ResultFrame;
+
+/**
+ * @brief A lock-free single-producer/single-consumer ring of ResultFrames
+ *
+ * The main loop is the only producer and the publisher thread the only consumer. When the
+ * ring is full, the producer drops the oldest frame by advancing the tail itself. The
+ * consumer therefore copies a frame out first and only keeps it if it can still claim it
+ * afterwards; otherwise the frame has been dropped (and possibly overwritten) in between.
+ */
+typedef struct PublishQueue {
+    ResultFrame slots[PUBLISH_QUEUE_CAPACITY];
+    atomic_size_t head;         ///< Position of the next frame to write, only changed by the producer
+    atomic_size_t tail;         ///< Position of the next frame to read
+    atomic_ullong dropped;      ///< Number of frames dropped because the queue was full
+} PublishQueue;
+
+/**
+ * @brief The state of the publisher thread
+ */
+typedef struct Publisher {
+    PublishQueue queue;
+    sem_t available;            ///< Posted whenever new data is available
+    pthread_t thread;
+    MQTTAsync client;
+    EncoderPool encoders;       ///< Buffers for encoding the frames, one per module
+    ReportFilter filter;        ///< Selects the values worth publishing
+    atomic_bool running;
+    atomic_ullong published;    ///< Number of frames handed to the MQTT client
+    atomic_bool statsPending;   ///< Whether stats holds a snapshot not published yet
+    CycleStats stats;           ///< Snapshot of the cycle statistics to publish
+    Spool spool;                ///< The store-and-forward buffer, if enabled
+    unsigned drainRate;         ///< Messages per second sent from the buffer, besides the current ones
+    double drainTokens;         ///< The messages which may be sent from the buffer right now
+    struct timespec lastDrain;  ///< When drainTokens has last been topped up
+    uint64_t queuedBehind;      ///< Messages stored while connected since the last drain, only to keep the order
+    uint64_t lastBacklog;       ///< The number of messages in the buffer at the last check
+    struct timespec lastBacklogCheck; ///< When lastBacklog has been taken
+    bool outageSinceCheck;      ///< Whether the client has been disconnected since then
+    uint64_t replayed;          ///< Number of messages sent from the buffer
+    uint64_t spoolDropped;      ///< The messages dropped from the buffer, as last seen
+    Batch batch;                ///< The ResultSets waiting to be sent together, if batching is enabled
+    Compressor compressor;      ///< Compresses the payloads on their way to the MQTT client, if enabled
+    bool connected;             ///< Whether the client was connected at the last pass
+    bool held;                  ///< Whether frames were left queued at the last pass as the window was full
+} Publisher;
+
+/**
+ * @brief Appends a frame to the queue, dropping the oldest frame if it is full. Producer only.
+ *
+ * @param[in] queue The queue
+ * @param[in] results The completed ResultSet to copy into the queue
+ * @retval true if an older frame had to be dropped, false otherwise
+ */
+bool publish_queue_push(PublishQueue *queue, const ResultSet *results) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    bool dropped = false;
+
+    if (head - tail == PUBLISH_QUEUE_CAPACITY) {
+        // if this fails, the consumer has just taken the oldest frame and there is room again
+        if (atomic_compare_exchange_strong_explicit(&queue->tail, &tail, tail + 1,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            dropped = true;
+        }
+    }
+
+    ResultFrame *frame = &queue->slots[head % PUBLISH_QUEUE_CAPACITY];
+    frame->descriptions = results->descriptions;
+    frame->size = results->size;
+    frame->moduleIndex = results->moduleIndex;
+    frame->timestamp = results->timestamp;
+    memcpy(frame->values, results->values, sizeof(uint32_t) * results->size);
+    for (size_t i = 0; i < results->size; i++) {
+        frame->included[i] = result_included(results, i);
+    }
+    frame->aggregated = results->aggregates != NULL;
+    if (frame->aggregated) {
+        memcpy(frame->aggregates, results->aggregates, sizeof(Aggregate) * results->size);
+    }
+
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return dropped;
+}
+
+/**
+ * @brief Returns the number of frames in the queue
+ */
+size_t publish_queue_depth(PublishQueue *queue) {
+    return atomic_load_explicit(&queue->head, memory_order_acquire)
+           - atomic_load_explicit(&queue->tail, memory_order_acquire);
+}
+
+/**
+ * @brief Takes the oldest frame from the queue. Consumer only.
+ *
+ * @param[in] queue The queue
+ * @param[out] frame The frame to copy the oldest entry to
+ * @retval true if a frame was taken, false if the queue is empty
+ */
+bool publish_queue_pop(PublishQueue *queue, ResultFrame *frame) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    while (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        memcpy(frame, &queue->slots[tail % PUBLISH_QUEUE_CAPACITY], sizeof(ResultFrame));
+        if (atomic_compare_exchange_strong_explicit(&queue->tail, &tail, tail + 1,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            return true;
+        }
+        // the producer dropped this frame while we were copying it, tail now holds the next one
+    }
+    return false;
+}
+
+/**
+ * @brief Hands a completed ResultSet over to the publisher thread
+ *
+ * This only copies the values and never blocks, so it is safe to call from the main loop.
+ *
+ * @param[in] publisher The running publisher
+ * @param[in] results The completed ResultSet
+ */
+void publisher_enqueue(Publisher *publisher, const ResultSet *results) {
+    publish_queue_push(&publisher->queue, results);
+    sem_post(&publisher->available);
+}
+
+/**
+ * @brief Hands a snapshot of the cycle statistics over to the publisher thread
+ *
+ * The snapshot is skipped if the previous one has not been published yet.
+ *
+ * @param[in] publisher The running publisher
+ * @param[in] stats The current cycle statistics
+ */
+void publisher_submit_stats(Publisher *publisher, const CycleStats *stats) {
+    if (atomic_load_explicit(&publisher->statsPending, memory_order_acquire)) {
+        return;
+    }
+    memcpy(&publisher->stats, stats, sizeof(CycleStats));
+    atomic_store_explicit(&publisher->statsPending, true, memory_order_release);
+    sem_post(&publisher->available);
+}
+
+/**
+ * @brief Hands a message to the MQTT client, compressed if that is enabled and worth it
+ *
+ * Messages are stored uncompressed in the store-and-forward buffer and compressed when they
+ * are finally sent, so the content-encoding user property always goes along with them.
+ *
+ * @param[in] publisher The publisher
+ * @param[in] topic The number of the topic of the message @see TopicTable
+ * @param[in] msg The encoded message
+ * @param[in] length The length of the message
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode publisher_transmit(Publisher *publisher, size_t topic, const uint8_t *msg, size_t length) {
+    size_t compressedLength;
+    const uint8_t *compressed = compressor_apply(&publisher->compressor, msg, length, &compressedLength);
+    if (compressed != NULL) {
+        return send_MQTT5_payload(publisher->client, topic, compressed, compressedLength,
+                                  COMPRESSION_CONTENT_ENCODING);
+    }
+    return send_MQTT5_payload(publisher->client, topic, msg, length, NULL);
+}
+
+/**
+ * @brief Makes the next messages key frames if the store-and-forward buffer had to drop any
+ */
+void publisher_check_spool_drops(Publisher *publisher) {
+    if (publisher->spool.dropped != publisher->spoolDropped) {
+        publisher->spoolDropped = publisher->spool.dropped;
+        encoder_pool_resync(&publisher->encoders);
+    }
+}
+
+/**
+ * @brief Sends an encoded message, or stores it while it cannot be sent
+ *
+ * Without a store-and-forward buffer, messages which cannot be sent are lost. With it, they
+ * are appended to the buffer, and so are all messages while the buffer still holds older
+ * ones, so they are sent in order. Whenever a message is lost, the next messages are key
+ * frames, so the receivers do not apply later differences to values they have never seen.
+ *
+ * @param[in] publisher The publisher
+ * @param[in] topic The number of the topic of the message @see TopicTable
+ * @param[in] msg The encoded message
+ * @param[in] length The length of the message
+ * @retval true if the message has been handed to the MQTT client, false otherwise
+ */
+bool publisher_output(Publisher *publisher, size_t topic, const uint8_t *msg, size_t length) {
+    const bool spooling = spool_enabled(&publisher->spool);
+    const bool connected = MQTTAsync_isConnected(publisher->client);
+    if (connected && (!spooling || spool_empty(&publisher->spool))) {
+        if (publisher_transmit(publisher, topic, msg, length) == ERROR_SUCCESS) {
+            return true;
+        }
+    }
+    if (spooling) {
+        if (connected) {
+            publisher->queuedBehind++;
+        }
+        if (spool_append(&publisher->spool, topic_key(&topicTable, topic), msg, length)) {
+            publisher_check_spool_drops(publisher);
+            return false;
+        }
+    }
+    encoder_pool_resync(&publisher->encoders);
+    return false;
+}
+
+/**
+ * @brief Sends the frames collected in the batch as one message
+ *
+ * @param[in] publisher The publisher
+ */
+void publisher_flush_batch(Publisher *publisher) {
+    const size_t frames = publisher->batch.frames;
+    if (frames == 0) {
+        return;
+    }
+    size_t length;
+    const uint8_t *msg = batch_finish(&publisher->batch, &length);
+    if (publisher_output(publisher, topic_batch_index(&topicTable), msg, length)) {
+        atomic_fetch_add_explicit(&publisher->published, frames, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Sends the ResultSet of a module, or adds it to the batch
+ *
+ * A full batch is sent before the frame is added if the frame would take it beyond
+ * max_bytes, or right after if the frame is the last one it may hold.
+ *
+ * @param[in] publisher The publisher
+ * @param[in] results The ResultSet, whose timestamp is cleared if the batch carries it
+ */
+void publisher_send_results(Publisher *publisher, ResultSet *results) {
+    Batch *batch = &publisher->batch;
+    const bool batching = batch->buf != NULL;
+    const struct timespec timestamp = results->timestamp;
+    // a zero timestamp is left out of the protocol buffers
+    if (batching && batch_shares_timestamps(batch)) {
+        results->timestamp = (struct timespec) { 0, 0 };
+    }
+
+    size_t msgLength;
+    uint8_t *msg = get_MQTT_message(results, &publisher->encoders, &msgLength);
+    if (msg == NULL) {
+        return;
+    }
+    if (!batching) {
+        if (publisher_output(publisher, topic_index(&topicTable, results->moduleIndex, TOPIC_STREAM_AC),
+                             msg, msgLength)) {
+            atomic_fetch_add_explicit(&publisher->published, 1, memory_order_relaxed);
+        }
+    } else {
+        if (!batch_fits(batch, &timestamp, msgLength)) {
+            publisher_flush_batch(publisher);
+        }
+        if (batch_fits(batch, &timestamp, msgLength)) {
+            batch_add(batch, &timestamp, msg, msgLength);
+            if (batch_full(batch)) {
+                publisher_flush_batch(publisher);
+            }
+        } else {
+            dprintf(LOGLEVEL_ERR, "The ResultSet of module %zu is too large for a batch\n", results->moduleIndex);
+        }
+    }
+    encoder_pool_release(&publisher->encoders, msg);
+}
+
+/**
+ * @brief Sends the harmonic spectrum of each phase contained in a ResultSet
+ *
+ * Every phase with any harmonic values in the ResultSet is sent as a HarmonicSpectrumMsg to
+ * the harmonics topic of the module, whichever payload format is configured for the ResultSets.
+ *
+ * @param[in] publisher The publisher
+ * @param[in] results A pointer to the completed ResultSet
+ */
+void publisher_send_harmonics(Publisher *publisher, const ResultSet *results) {
+    static const uint8_t phases[HARMONIC_PHASE_COUNT] = {
+        HARMONIC_ANALYSIS_L1, HARMONIC_ANALYSIS_L2, HARMONIC_ANALYSIS_L3
+    };
+    HarmonicSpectrum spectrum;
+
+    for (size_t phase = 0; phase < HARMONIC_PHASE_COUNT; phase++) {
+        if (harmonic_spectrum_collect(results, phases[phase], &spectrum) == 0) {
+            continue;
+        }
+        size_t msgLength;
+        uint8_t *msg = get_MQTT_harmonic_spectrum_message(results, &spectrum, &publisher->encoders, &msgLength);
+        if (msg == NULL) {
+            dprintf(LOGLEVEL_ERR, "Failed to create the MQTT message\n");
+            return;
+        }
+        publisher_output(publisher, topic_index(&topicTable, results->moduleIndex, TOPIC_STREAM_HARMONICS),
+                         msg, msgLength);
+        encoder_pool_release(&publisher->encoders, msg);
+    }
+}
+
+/**
+ * @brief Warns if the store-and-forward buffer keeps growing although the client is connected
+ *
+ * @param[in] publisher The publisher
+ * @param[in] now The current time
+ */
+void publisher_check_backlog(Publisher *publisher, const struct timespec *now) {
+    if (elapsed_ns64(&publisher->lastBacklogCheck, now) / 1000000000 < SPOOL_BACKLOG_CHECK_S) {
+        return;
+    }
+    const uint64_t backlog = spool_count(&publisher->spool);
+    if (!publisher->outageSinceCheck && MQTTAsync_isConnected(publisher->client) && backlog > publisher->lastBacklog) {
+        dprintf(LOGLEVEL_WARNING, "Spooled messages grew from %llu to %llu while connected\n",
+                (unsigned long long)publisher->lastBacklog, (unsigned long long)backlog);
+    }
+    publisher->lastBacklog = backlog;
+    publisher->lastBacklogCheck = *now;
+    publisher->outageSinceCheck = false;
+}
+
+/**
+ * @brief Sends messages from the store-and-forward buffer, oldest first
+ *
+ * While the buffer is not empty, the current messages are stored behind the older ones to
+ * keep the order. They are sent as they arrive, and drainRate messages per second on top of
+ * them, so the backlog shrinks at that rate without flooding the broker.
+ *
+ * @param[in] publisher The publisher
+ */
+void publisher_drain(Publisher *publisher) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    publisher->drainTokens += elapsed_ns(&publisher->lastDrain, &now) / 1e9 * publisher->drainRate;
+    if (publisher->drainTokens > publisher->drainRate) {
+        publisher->drainTokens = publisher->drainRate;
+    }
+    publisher->drainTokens += publisher->queuedBehind;
+    publisher->queuedBehind = 0;
+    publisher->lastDrain = now;
+
+    uint32_t key;
+    size_t topic;
+    const uint8_t *msg;
+    size_t length;
+    while (publisher->drainTokens >= 1 && MQTTAsync_isConnected(publisher->client)
+           && pacer_window_open(&sendPacer) && spool_peek(&publisher->spool, &key, &msg, &length)) {
+        // stored before a restart with more modules than there are now
+        if (!topic_from_key(&topicTable, key, &topic)) {
+            spool_drop_oldest(&publisher->spool);
+            continue;
+        }
+        if (publisher_transmit(publisher, topic, msg, length) != ERROR_SUCCESS) {
+            break;
+        }
+        spool_consume(&publisher->spool);
+        publisher->drainTokens -= 1;
+        publisher->replayed++;
+    }
+    publisher_check_spool_drops(publisher);
+    publisher_check_backlog(publisher, &now);
+}
+
+/**
+ * @brief The main function of the publisher thread, encoding and sending all queued frames
+ *
+ * @param[in] arg A pointer to the Publisher
+ */
+void *publisher_run(void *arg) {
+    Publisher *publisher = arg;
+    ResultFrame frame;
+    char statsBuf[STATS_BUFFER_SIZE];
+
+    for (;;) {
+        // come back in time to keep draining the store-and-forward buffer, or to send the frames
+        // held back once the window opens again
+        const bool draining = spool_enabled(&publisher->spool) && !spool_empty(&publisher->spool)
+                              && MQTTAsync_isConnected(publisher->client);
+        uint64_t timeoutMs = publisher->held ? PACER_RETRY_INTERVAL_MS
+                             : draining ? SPOOL_DRAIN_INTERVAL_MS : PUBLISHER_IDLE_TIMEOUT_MS;
+        // and in time to send the batch once its oldest frame is due
+        const uint64_t batchDueMs = batch_remaining_ms(&publisher->batch);
+        if (batchDueMs < timeoutMs) {
+            timeoutMs = batchDueMs;
+        }
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timespec_add_ns(&timeout, timeoutMs * 1000000);
+        if (sem_timedwait(&publisher->available, &timeout) != 0 && errno != ETIMEDOUT && errno != EINTR) {
+            dprintf(LOGLEVEL_ERR, "Waiting for the publish queue failed\n");
+        }
+        // the producer has stopped before we are told to, so one last pass empties the queue
+        bool stopping = !atomic_load(&publisher->running);
+
+        // the client may never report on the messages in flight when the connection was lost
+        const bool connected = MQTTAsync_isConnected(publisher->client);
+        if (publisher->connected && !connected) {
+            pacer_reset(&sendPacer);
+        }
+        // and messages may have been lost along with the connection
+        if (!publisher->connected && connected) {
+            encoder_pool_resync(&publisher->encoders);
+        }
+        if (!connected) {
+            publisher->outageSinceCheck = true;
+        }
+        publisher->connected = connected;
+
+        publisher->held = false;
+        for (;;) {
+            // leave the frames queued while the client is still busy with the earlier messages
+            if (connected && !stopping && !pacer_window_open(&sendPacer)) {
+                publisher->held = true;
+                break;
+            }
+            if (!publish_queue_pop(&publisher->queue, &frame)) {
+                break;
+            }
+            if (!spool_enabled(&publisher->spool) && !connected) {
+                continue;
+            }
+            ResultSet results = {
+                .descriptions = frame.descriptions,
+                .size = frame.size,
+                .moduleIndex = frame.moduleIndex,
+                .values = frame.values,
+                .timestamp = frame.timestamp,
+                .validity = frame.included,
+                .aggregates = frame.aggregated ? frame.aggregates : NULL
+            };
+            // spectra are sent complete, before unchanged harmonics are filtered out
+            publisher_send_harmonics(publisher, &results);
+            for (size_t i = 0; i < frame.size; i++) {
+                frame.included[i] &= MQTT_payload_carries(frame.descriptions[i]);
+            }
+            // a key frame carries every present value, so the receivers can start over from it
+            if (!report_filter_apply(&publisher->filter, &results, frame.included, MQTT_payload_allows_partial(),
+                                     MQTT_key_frame_due(&publisher->encoders, &results))) {
+                continue;
+            }
+            publisher_send_results(publisher, &results);
+        }
+        if (stopping || batch_remaining_ms(&publisher->batch) == 0) {
+            publisher_flush_batch(publisher);
+        }
+
+        if (spool_enabled(&publisher->spool)) {
+            publisher_drain(publisher);
+            spool_sync(&publisher->spool, false);
+        }
+        pacer_adjust(&sendPacer);
+
+        if (atomic_load_explicit(&publisher->statsPending, memory_order_acquire)) {
+            size_t length = format_cycle_stats(&publisher->stats, statsBuf, sizeof(statsBuf));
+            snprintf(statsBuf + length, sizeof(statsBuf) - length,
+                     "published: %llu, dropped: %llu, suppressed: %llu, encoder heap allocations: %llu\n"
+                     "spooled: %llu, replayed: %llu, dropped from spool: %llu, queued: %zu, batches: %llu\n",
+                     (unsigned long long)atomic_load(&publisher->published),
+                     (unsigned long long)atomic_load(&publisher->queue.dropped),
+                     (unsigned long long)atomic_load(&publisher->filter.suppressed),
+                     (unsigned long long)atomic_load(&publisher->encoders.heapAllocations),
+                     (unsigned long long)publisher->spool.spooled, (unsigned long long)publisher->replayed,
+                     (unsigned long long)publisher->spool.dropped, publish_queue_depth(&publisher->queue),
+                     (unsigned long long)publisher->batch.sent);
+            length = strlen(statsBuf);
+            length += format_pacer_stats(&sendPacer, statsBuf + length, sizeof(statsBuf) - length);
+            format_compression_stats(&publisher->compressor, statsBuf + length, sizeof(statsBuf) - length);
+            atomic_store_explicit(&publisher->statsPending, false, memory_order_release);
+            if (MQTTAsync_isConnected(publisher->client)) {
+                send_MQTT5_text(publisher->client, topic_status_index(&topicTable), statsBuf);
+            }
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Starts the publisher thread
+ *
+ * By default the thread runs with normal (non real-time) priority, so encoding and sending
+ * the messages never competes with the main loop. It runs on the CPUs of the calling thread.
+ *
+ * @param[out] publisher The publisher to initialize
+ * @param[in] client The MQTT client to publish with
+ * @param[in] descriptions The UnitDescriptions of the measurements
+ * @param[in] size The number of measurements
+ * @param[in] moduleCount The number of power measurement modules
+ * @param[in] priority The SCHED_FIFO priority of the thread, 0 for SCHED_OTHER
+ * @param[in] spoolSettings The settings of the store-and-forward buffer
+ * @param[in] batchSettings The settings of the batching of ResultSets
+ * @param[in] compressionSettings The settings of the payload compression
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode publisher_start(Publisher *publisher, MQTTAsync client, const UnitDescription **descriptions, size_t size,
+                          size_t moduleCount, int priority, const SpoolSettings *spoolSettings,
+                          const BatchSettings *batchSettings, const CompressionSettings *compressionSettings) {
+    memset(publisher, 0, sizeof(Publisher));
+    publisher->client = client;
+    publisher->spool.fd = -1;
+    atomic_store(&publisher->running, true);
+    ErrorCode result = encoder_pool_init(&publisher->encoders, moduleCount, get_MQTT_message_max_size(descriptions, size));
+    if (result != ERROR_SUCCESS) {
+        return result;
+    }
+    result = report_filter_init(&publisher->filter, descriptions, size, moduleCount, mqttSettings.reportByException,
+                                mqttSettings.reportHeartbeatS);
+    if (result != ERROR_SUCCESS) {
+        encoder_pool_destroy(&publisher->encoders);
+        return result;
+    }
+    size_t maxMessageLength = publisher->encoders.bufferSize;
+    if (batchSettings->enabled) {
+        result = batch_init(&publisher->batch, batchSettings, mqttSettings.payloadFormat, publisher->encoders.bufferSize);
+        if (result != ERROR_SUCCESS) {
+            report_filter_destroy(&publisher->filter);
+            encoder_pool_destroy(&publisher->encoders);
+            return result;
+        }
+        maxMessageLength = batch_max_length(&publisher->batch);
+    }
+    result = compressor_init(&publisher->compressor, compressionSettings, maxMessageLength);
+    if (result != ERROR_SUCCESS) {
+        batch_destroy(&publisher->batch);
+        report_filter_destroy(&publisher->filter);
+        encoder_pool_destroy(&publisher->encoders);
+        return result;
+    }
+    if (spoolSettings->path[0] != '\0') {
+        // messages larger than an encoder buffer or a batch are rare enough not to be worth storing
+        result = spool_open(&publisher->spool, spoolSettings, maxMessageLength);
+        if (result != ERROR_SUCCESS) {
+            compressor_destroy(&publisher->compressor);
+            batch_destroy(&publisher->batch);
+            report_filter_destroy(&publisher->filter);
+            encoder_pool_destroy(&publisher->encoders);
+            return result;
+        }
+        publisher->drainRate = spoolSettings->drainRate;
+        clock_gettime(CLOCK_MONOTONIC, &publisher->lastDrain);
+        publisher->lastBacklogCheck = publisher->lastDrain;
+    }
+    if (sem_init(&publisher->available, 0, 0) != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to initialize the publisher semaphore\n");
+        spool_close(&publisher->spool);
+        compressor_destroy(&publisher->compressor);
+        batch_destroy(&publisher->batch);
+        report_filter_destroy(&publisher->filter);
+        encoder_pool_destroy(&publisher->encoders);
+        return -ERROR_THREAD_CREATION_FAILED;
+    }
+
+    // threads inherit the SCHED_FIFO policy of the main thread unless told otherwise
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = priority };
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, priority > 0 ? SCHED_FIFO : SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    int createResult = pthread_create(&publisher->thread, &attr, publisher_run, publisher);
+    pthread_attr_destroy(&attr);
+    if (createResult != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to start the publisher thread, return code %d\n", createResult);
+        sem_destroy(&publisher->available);
+        spool_close(&publisher->spool);
+        compressor_destroy(&publisher->compressor);
+        batch_destroy(&publisher->batch);
+        report_filter_destroy(&publisher->filter);
+        encoder_pool_destroy(&publisher->encoders);
+        return -ERROR_THREAD_CREATION_FAILED;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Stops the publisher thread after it has sent all remaining frames
+ *
+ * @param[in] publisher The running publisher
+ */
+void publisher_stop(Publisher *publisher) {
+    atomic_store(&publisher->running, false);
+    sem_post(&publisher->available);
+    pthread_join(publisher->thread, NULL);
+    sem_destroy(&publisher->available);
+    dprintf(LOGLEVEL_INFO,
+            "Publisher stopped, %llu frames published, %llu dropped, %llu suppressed, "
+            "%llu encoder heap allocations\n",
+            (unsigned long long)atomic_load(&publisher->published),
+            (unsigned long long)atomic_load(&publisher->queue.dropped),
+            (unsigned long long)atomic_load(&publisher->filter.suppressed),
+            (unsigned long long)atomic_load(&publisher->encoders.heapAllocations));
+    if (spool_enabled(&publisher->spool)) {
+        dprintf(LOGLEVEL_INFO, "%llu messages spooled, %llu replayed, %llu dropped from the spool\n",
+                (unsigned long long)publisher->spool.spooled, (unsigned long long)publisher->replayed,
+                (unsigned long long)publisher->spool.dropped);
+    }
+    if (publisher->compressor.enabled) {
+        char compressionBuf[256];
+        format_compression_stats(&publisher->compressor, compressionBuf, sizeof(compressionBuf));
+        dprintf(LOGLEVEL_INFO, "%s", compressionBuf);
+    }
+    spool_close(&publisher->spool);
+    compressor_destroy(&publisher->compressor);
+    batch_destroy(&publisher->batch);
+    report_filter_destroy(&publisher->filter);
+    encoder_pool_destroy(&publisher->encoders);
+}
+
+#endif
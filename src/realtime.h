@@ -0,0 +1,120 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "utils.h"
+
+#define RT_STACK_PREFAULT_SIZE (256 * 1024)     ///< Stack of the main thread touched at startup
+#define RT_HEAP_PREFAULT_SIZE (4 * 1024 * 1024) ///< Heap reserved and touched at startup
+#define RT_CPU_ANY -1                           ///< Do not pin a thread to a CPU
+
+/**
+ * @brief The settings of the real-time mode
+ *
+ * Without the real-time mode, only the main thread runs with SCHED_FIFO, as it always has.
+ * With it, memory is locked and prefaulted, and the cycle thread as well as the MQTT client
+ * and publisher threads run on their own CPUs with explicit priorities.
+ */
+typedef struct RealtimeConfig {
+    bool enabled;
+    int cycleCpu;               ///< The CPU of the main loop, RT_CPU_ANY for any
+    int cyclePriority;          ///< The SCHED_FIFO priority of the main loop
+    int backgroundCpu;          ///< The CPU of the MQTT client and publisher threads, RT_CPU_ANY for any
+    int backgroundPriority;     ///< The SCHED_FIFO priority of these, 0 for SCHED_OTHER
+} RealtimeConfig;
+
+/**
+ * @brief Touches the stack down to RT_STACK_PREFAULT_SIZE below the caller
+ *
+ * Not inlined, so the array really lives below the frame of the caller.
+ */
+__attribute__((noinline)) void rt_prefault_stack(void) {
+    volatile unsigned char stack[RT_STACK_PREFAULT_SIZE];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * @brief Locks all current and future memory of the process and prefaults the stack and heap
+ *
+ * The heap is kept from shrinking and from serving large allocations with separate mappings,
+ * so a reserve which has been touched once is reused by later allocations instead of taking
+ * new page faults. Threads created afterwards get their stacks locked and faulted in as
+ * they are mapped.
+ *
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode rt_lock_memory(void) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to lock the memory: %s\n", strerror(errno));
+        return -ERROR_REALTIME_SETUP_FAILED;
+    }
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    rt_prefault_stack();
+    unsigned char *reserve = malloc(RT_HEAP_PREFAULT_SIZE);
+    if (reserve == NULL) {
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    for (size_t i = 0; i < RT_HEAP_PREFAULT_SIZE; i += 4096) {
+        reserve[i] = 0;
+    }
+    free(reserve);
+    dprintf(LOGLEVEL_INFO, "Memory locked, %d KiB of stack and %d KiB of heap prefaulted\n",
+            RT_STACK_PREFAULT_SIZE / 1024, RT_HEAP_PREFAULT_SIZE / 1024);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Moves the calling thread to a CPU and scheduling priority
+ *
+ * Threads created afterwards inherit both, unless they set their own.
+ *
+ * @param[in] cpu The CPU to run on, RT_CPU_ANY to leave the affinity as it is
+ * @param[in] priority The SCHED_FIFO priority, 0 for SCHED_OTHER
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode rt_place_thread(int cpu, int priority) {
+    if (cpu != RT_CPU_ANY) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (result != 0) {
+            dprintf(LOGLEVEL_ERR, "Failed to pin the thread to CPU %d: %s\n", cpu, strerror(result));
+            return -ERROR_REALTIME_SETUP_FAILED;
+        }
+    }
+    struct sched_param param = { .sched_priority = priority };
+    int result = pthread_setschedparam(pthread_self(), priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+    if (result != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to set the scheduling priority %d: %s\n", priority, strerror(result));
+        return -ERROR_REALTIME_SETUP_FAILED;
+    }
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Returns the number of page faults the calling thread has taken so far
+ */
+uint64_t rt_thread_page_faults(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        return 0;
+    }
+    return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+}
+
+#endif
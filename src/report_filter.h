@@ -0,0 +1,173 @@
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aggregation.h"
+#include "unit_description.h"
+#include "utils.h"
+
+/**
+ * @brief The last reported values of a single module
+ */
+typedef struct ReportState {
+    int64_t lastReported[RESULT_SET_MAX_VALUES];    ///< The raw values at the time they were last reported
+    time_t reportedAt[RESULT_SET_MAX_VALUES];       ///< When each value was last reported
+    bool reported[RESULT_SET_MAX_VALUES];           ///< Whether each value has been reported yet
+} ReportState;
+
+/**
+ * @brief The deadband of a measurement in raw values @see UnitDescription
+ */
+typedef struct Deadband {
+    int64_t absolute;       ///< The absolute deadband, scaled like the raw values
+    int64_t relativePpm;    ///< The relative deadband in parts per million
+} Deadband;
+
+/**
+ * @brief Decides which values of a ResultSet are worth publishing
+ */
+typedef struct ReportFilter {
+    ReportState *states;                        ///< The state of each module
+    size_t moduleCount;                         ///< The number of modules
+    Deadband deadbands[RESULT_SET_MAX_VALUES];  ///< The deadband of each measurement
+    bool byException;                           ///< Whether values are only reported once they changed beyond their deadband
+    time_t heartbeatS;                          ///< The maximum time a value goes unreported
+    atomic_ullong suppressed;                   ///< Number of ResultSets which did not need to be published at all
+} ReportFilter;
+
+/**
+ * @brief Allocates the state of a report filter
+ *
+ * The deadbands of the measurements are converted to raw values once, so filtering the
+ * values compares integers only.
+ *
+ * @param[out] filter The filter to initialize
+ * @param[in] descriptions The UnitDescriptions of the measurements
+ * @param[in] size The number of measurements, at most RESULT_SET_MAX_VALUES
+ * @param[in] moduleCount The number of power measurement modules
+ * @param[in] byException Whether to only report values which changed beyond their deadband
+ * @param[in] heartbeatS The maximum time a value goes unreported, regardless of its deadband
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode report_filter_init(ReportFilter *filter, const UnitDescription **descriptions, size_t size,
+                             size_t moduleCount, bool byException, unsigned heartbeatS) {
+    if (size > RESULT_SET_MAX_VALUES) {
+        return -ERROR_TOO_MANY_MEASUREMENTS;
+    }
+    for (size_t i = 0; i < size; i++) {
+        filter->deadbands[i].absolute = llround(descriptions[i]->absoluteDeadband * descriptions[i]->scalingFactor);
+        filter->deadbands[i].relativePpm = llround(descriptions[i]->relativeDeadband * 1000000);
+    }
+    filter->states = calloc(moduleCount, sizeof(ReportState));
+    if (filter->states == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the report filter\n");
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    filter->moduleCount = moduleCount;
+    filter->byException = byException;
+    filter->heartbeatS = heartbeatS;
+    atomic_init(&filter->suppressed, 0);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Frees the state of a report filter
+ */
+void report_filter_destroy(ReportFilter *filter) {
+    free(filter->states);
+    filter->states = NULL;
+    filter->moduleCount = 0;
+}
+
+/**
+ * @brief Checks whether a raw value has moved beyond the deadband of its measurement
+ *
+ * The deadband is the larger of the absolute and the relative deadband, so a value is
+ * reported once it changed by more than both. Without any deadband, every change is reported.
+ * Raw values have 32 bits, so none of the products can overflow.
+ */
+bool exceeds_deadband(const Deadband *deadband, int64_t last, int64_t value) {
+    int64_t change = llabs(value - last);
+    return change > deadband->absolute && change * 1000000 > deadband->relativePpm * llabs(last);
+}
+
+/**
+ * @brief Checks whether a value of a ResultSet has changed since it was last reported
+ *
+ * For aggregated values, a short excursion hardly moves the mean of the window, so the value is
+ * also reported if its minimum or maximum left the deadband around the last reported mean.
+ */
+bool report_filter_changed(const ReportFilter *filter, const ReportState *state, const ResultSet *results,
+                           size_t i) {
+    const Deadband *deadband = &filter->deadbands[i];
+    const int64_t last = state->lastReported[i];
+    if (exceeds_deadband(deadband, last, result_value(results, i))) {
+        return true;
+    }
+    const Aggregate *aggregate = result_aggregate(results, i);
+    return aggregate != NULL
+           && (exceeds_deadband(deadband, last, aggregate->min) || exceeds_deadband(deadband, last, aggregate->max));
+}
+
+/**
+ * @brief Selects the values of a completed ResultSet which need to be published
+ *
+ * A value is selected if it has never been reported, its heartbeat has expired or it changed
+ * beyond its deadband since it was last reported (see report_filter_changed()). If the payload
+ * format cannot represent a subset of the values, either all present values or none are selected.
+ *
+ * @param[in] filter The report filter
+ * @param[in] results The completed ResultSet
+ * @param[inout] included Whether each value is present, in the order of the ResultSet. Values
+ *                        which have not been selected are set to false.
+ * @param[in] allowPartial Whether a subset of the present values may be selected
+ * @param[in] reportAll Whether to select all present values regardless, e.g. for a key frame
+ * @retval true if anything needs to be published, false otherwise
+ */
+bool report_filter_apply(ReportFilter *filter, const ResultSet *results, bool *included, bool allowPartial,
+                         bool reportAll) {
+    if (results->moduleIndex >= filter->moduleCount || results->size > RESULT_SET_MAX_VALUES) {
+        return false;
+    }
+    ReportState *state = &filter->states[results->moduleIndex];
+    const time_t now = results->timestamp.tv_sec;
+    bool present[RESULT_SET_MAX_VALUES];
+    size_t presentCount = 0, count = 0;
+
+    for (size_t i = 0; i < results->size; i++) {
+        present[i] = included[i];
+        presentCount += present[i];
+        included[i] = present[i]
+                      && (reportAll || !filter->byException || !state->reported[i]
+                          || now - state->reportedAt[i] >= filter->heartbeatS
+                          || report_filter_changed(filter, state, results, i));
+        count += included[i];
+    }
+
+    if (count == 0) {
+        atomic_fetch_add_explicit(&filter->suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+    if (!allowPartial && count < presentCount) {
+        memcpy(included, present, sizeof(bool) * results->size);
+    }
+
+    for (size_t i = 0; i < results->size; i++) {
+        if (included[i]) {
+            state->lastReported[i] = result_value(results, i);
+            state->reportedAt[i] = now;
+            state->reported[i] = true;
+        }
+    }
+    return true;
+}
+
+#endif
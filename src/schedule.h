@@ -0,0 +1,256 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unit_description.h"
+#include "utils.h"
+
+#define SCHEDULE_SLOTS 4            ///< Number of measurements a module provides per cycle
+#define SCHEDULE_MAX_CYCLES 1200    ///< Upper bound for the length of a schedule, 60 s at 50 ms
+
+/**
+ * @brief The precomputed assignment of measurements to the request slots of each cycle
+ *
+ * Measurements without a sample period are requested round-robin in every slot which is not
+ * needed otherwise, and a ResultSet is complete once all of them have been received.
+ * Measurements with a sample period are requested about once per period, in consecutive
+ * cycles for each collection and staggered so the collections do not all fall into the same
+ * cycle, and are included in whichever ResultSet is completed next.
+ *
+ * A module answers for a single collection at a time, so every cycle only requests
+ * measurements of one collection; cycles of other collections are only interleaved when
+ * their measurements are due. The schedule is computed once at startup and then repeated, so
+ * which measurement is requested in which cycle is fixed and costs nothing to decide at
+ * runtime.
+ */
+typedef struct MeasurementSchedule {
+    uint8_t (*slots)[SCHEDULE_SLOTS];       ///< The list index requested in each slot of each cycle,
+                                            ///< MEASUREMENT_SLOT_NONE for unused slots
+    uint8_t *collections;                   ///< The collection requested in each cycle @see COL_ID
+    size_t length;                          ///< The number of cycles after which the schedule repeats
+    size_t slotCount;                       ///< The number of slots used at most in a cycle
+    bool required[RESULT_SET_MAX_VALUES];   ///< Whether a ResultSet needs the value to be complete
+    size_t requiredCount;                   ///< The number of required values
+    size_t completionMinCycles;             ///< The minimum number of cycles to complete a ResultSet
+} MeasurementSchedule;
+
+/**
+ * @brief The state while computing a schedule
+ */
+typedef struct ScheduleBuilder {
+    const UnitDescription **descriptions;   ///< The measurements to schedule
+    size_t size;                            ///< The number of measurements
+    size_t slotCount;                       ///< The number of slots per cycle
+    size_t periods[RESULT_SET_MAX_VALUES];  ///< The sample period of each measurement in cycles, 0 if it has none
+    size_t nextDue[RESULT_SET_MAX_VALUES];  ///< The cycle each sampled measurement is due in
+    size_t fast[RESULT_SET_MAX_VALUES];     ///< The measurements without a sample period, grouped by collection
+    size_t fastCount;                       ///< The number of measurements without a sample period
+    size_t fastCursor;                      ///< The position of the next of these in fast
+} ScheduleBuilder;
+
+/**
+ * @brief Checks whether a measurement is already requested in one of the first n slots of a cycle
+ */
+bool schedule_slots_contain(const uint8_t *slots, size_t n, size_t index) {
+    for (size_t i = 0; i < n; i++) {
+        if (slots[i] == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the sampled measurement to request next
+ *
+ * @param[in] builder The schedule builder
+ * @param[in] slots The measurements already requested in the current cycle
+ * @param[in] n The number of these
+ * @param[in] colID Only consider measurements of this collection, 0 for any collection
+ * @param[in] dueBy Only consider measurements due by this cycle
+ * @retval The list index of the measurement due first, or MEASUREMENT_SLOT_NONE if there is none
+ */
+size_t schedule_find_due(const ScheduleBuilder *builder, const uint8_t *slots, size_t n, uint8_t colID,
+                         size_t dueBy) {
+    size_t found = MEASUREMENT_SLOT_NONE;
+    for (size_t i = 0; i < builder->size; i++) {
+        if (builder->periods[i] == 0 || schedule_slots_contain(slots, n, i) || builder->nextDue[i] > dueBy
+            || (colID != 0 && builder->descriptions[i]->colID != colID)) {
+            continue;
+        }
+        if (found == MEASUREMENT_SLOT_NONE || builder->nextDue[i] < builder->nextDue[found]) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Computes the requests of a single cycle
+ *
+ * The cycle requests the collection of the sampled measurement overdue the longest, or of
+ * the next measurement without a sample period if none is due. It first gets the sampled
+ * measurements of that collection which are due, then the next measurements without a
+ * sample period as long as they belong to the collection. Remaining slots are used to
+ * request sampled measurements of the collection early.
+ *
+ * @param[inout] builder The schedule builder
+ * @param[in] cycle The cycle to compute
+ * @param[out] slots The list index for each slot, MEASUREMENT_SLOT_NONE for unused slots
+ * @retval The collection to request
+ */
+uint8_t schedule_build_cycle(ScheduleBuilder *builder, size_t cycle, uint8_t *slots) {
+    size_t n = 0, index;
+
+    memset(slots, MEASUREMENT_SLOT_NONE, SCHEDULE_SLOTS);
+    index = schedule_find_due(builder, slots, 0, 0, cycle);
+    if (index == MEASUREMENT_SLOT_NONE) {
+        index = builder->fastCount > 0 ? builder->fast[builder->fastCursor]
+                                       : schedule_find_due(builder, slots, 0, 0, SIZE_MAX);
+    }
+    const uint8_t colID = builder->descriptions[index]->colID;
+
+    while (n < builder->slotCount
+           && (index = schedule_find_due(builder, slots, n, colID, cycle)) != MEASUREMENT_SLOT_NONE) {
+        slots[n++] = index;
+        builder->nextDue[index] = cycle + builder->periods[index];
+    }
+    while (n < builder->slotCount && builder->fastCount > 0) {
+        index = builder->fast[builder->fastCursor];
+        if (builder->descriptions[index]->colID != colID || schedule_slots_contain(slots, n, index)) {
+            break;
+        }
+        slots[n++] = index;
+        builder->fastCursor = (builder->fastCursor + 1) % builder->fastCount;
+    }
+    while (n < builder->slotCount
+           && (index = schedule_find_due(builder, slots, n, colID, SIZE_MAX)) != MEASUREMENT_SLOT_NONE) {
+        slots[n++] = index;
+        builder->nextDue[index] = cycle + builder->periods[index];
+    }
+    return colID;
+}
+
+/**
+ * @brief Computes the schedule for a list of measurements
+ *
+ * @param[out] schedule The schedule to compute
+ * @param[in] descriptions The UnitDescriptions of the measurements
+ * @param[in] size The number of measurements, at most RESULT_SET_MAX_VALUES
+ * @param[in] cycleTimeUs The cycle time in microseconds
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode schedule_init(MeasurementSchedule *schedule, const UnitDescription **descriptions, size_t size,
+                        unsigned cycleTimeUs) {
+    if (size == 0 || size > RESULT_SET_MAX_VALUES) {
+        return -ERROR_TOO_MANY_MEASUREMENTS;
+    }
+    ScheduleBuilder builder = {
+        .descriptions = descriptions,
+        .size = size,
+        .slotCount = size < SCHEDULE_SLOTS ? size : SCHEDULE_SLOTS
+    };
+    size_t sampledCount = 0, longestPeriod = 1;
+    size_t collectionOffsets[COLLECTION_COUNT + 1];
+    size_t collectionsSampled = 0;
+
+    memset(collectionOffsets, 0xFF, sizeof(collectionOffsets));
+    for (size_t i = 0; i < size; i++) {
+        uint64_t periodUs = (uint64_t)descriptions[i]->samplePeriodMs * 1000;
+        builder.periods[i] = (periodUs + cycleTimeUs - 1) / cycleTimeUs;
+        if (builder.periods[i] > SCHEDULE_MAX_CYCLES) {
+            builder.periods[i] = SCHEDULE_MAX_CYCLES;
+        }
+        schedule->required[i] = builder.periods[i] == 0;
+        const size_t collection = collection_slot(descriptions[i]->colID);
+        if (builder.periods[i] > 0 && collectionOffsets[collection] == SIZE_MAX) {
+            collectionOffsets[collection] = collectionsSampled++;
+        }
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (builder.periods[i] > 0) {
+            // spread the first requests of the collections evenly over their period, while the
+            // measurements of one collection, e.g. a spectrum, are read in consecutive cycles
+            const size_t collection = collection_slot(descriptions[i]->colID);
+            builder.nextDue[i] = collectionOffsets[collection] * builder.periods[i] / collectionsSampled;
+            sampledCount++;
+            if (builder.periods[i] > longestPeriod) {
+                longestPeriod = builder.periods[i];
+            }
+        }
+    }
+    // group the measurements without a sample period by collection, keeping their order otherwise
+    for (size_t collection = 0; collection <= COLLECTION_COUNT; collection++) {
+        for (size_t i = 0; i < size; i++) {
+            if (builder.periods[i] == 0 && collection_slot(descriptions[i]->colID) == collection) {
+                builder.fast[builder.fastCount++] = i;
+            }
+        }
+    }
+
+    schedule->slotCount = builder.slotCount;
+    schedule->requiredCount = builder.fastCount;
+    schedule->completionMinCycles = builder.fastCount > 0
+                                    ? (builder.fastCount + builder.slotCount - 1) / builder.slotCount : 1;
+    if (sampledCount > 0) {
+        schedule->length = longestPeriod;
+    } else {
+        // without sampled measurements, the schedule repeats exactly once the rotation is back at its start
+        uint8_t scratch[SCHEDULE_SLOTS];
+        schedule->length = 0;
+        do {
+            schedule_build_cycle(&builder, schedule->length++, scratch);
+        } while (builder.fastCursor != 0 && schedule->length < SCHEDULE_MAX_CYCLES);
+    }
+
+    schedule->slots = malloc(schedule->length * sizeof(*schedule->slots));
+    schedule->collections = malloc(schedule->length);
+    if (schedule->slots == NULL || schedule->collections == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to allocate the measurement schedule\n");
+        free(schedule->slots);
+        free(schedule->collections);
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    for (size_t cycle = 0; cycle < schedule->length; cycle++) {
+        schedule->collections[cycle] = schedule_build_cycle(&builder, cycle, schedule->slots[cycle]);
+    }
+
+    dprintf(LOGLEVEL_INFO, "Measurement schedule: %zu required, %zu sampled, repeating every %zu cycles\n",
+            builder.fastCount, sampledCount, schedule->length);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Frees a schedule
+ */
+void schedule_destroy(MeasurementSchedule *schedule) {
+    free(schedule->slots);
+    free(schedule->collections);
+    schedule->slots = NULL;
+    schedule->collections = NULL;
+    schedule->length = 0;
+}
+
+/**
+ * @brief Returns the measurements to request next and advances a position in the schedule
+ *
+ * @param[in] schedule The schedule
+ * @param[inout] cycle The position in the schedule
+ * @param[out] colID The collection to request
+ * @retval The list index of the measurement for each of the slotCount slots, MEASUREMENT_SLOT_NONE for unused slots
+ */
+const uint8_t *schedule_next(const MeasurementSchedule *schedule, size_t *cycle, uint8_t *colID) {
+    const uint8_t *slots = schedule->slots[*cycle];
+    *colID = schedule->collections[*cycle];
+    if (++*cycle >= schedule->length) {
+        *cycle = 0;
+    }
+    return slots;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef SEND_PACER_H
+#define SEND_PACER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cycle_stats.h"
+#include "utils.h"
+
+#define PACER_SLOT_COUNT 256            ///< Send times kept for the messages in flight, more than the largest window
+#define PACER_MAX_IN_FLIGHT 128         ///< The largest window which can be configured
+#define PACER_BUDGET_UNIT 1000          ///< The send budget counts thousandths of a ResultSet per cycle
+#define PACER_MIN_BUDGET 10             ///< The budget never drops below one ResultSet every 100 cycles
+#define PACER_ADJUST_INTERVAL_MS 1000   ///< How often the budget is adapted to the delivery latency
+#define PACER_RETRY_INTERVAL_MS 10      ///< How often the publisher checks a full window again
+
+/**
+ * @brief The send time of a message in flight
+ */
+typedef struct PacerSlot {
+    atomic_uint serial;         ///< The serial number of the message which took the slot last
+    struct timespec sentAt;     ///< When it was handed to the MQTT client
+    uint64_t tag;               ///< What the sender wants back on delivery @see pacer_finish
+} PacerSlot;
+
+/**
+ * @brief Paces the messages handed to the MQTT client by how fast they are delivered
+ *
+ * Every message handed to the client is in flight until the client confirms its delivery
+ * or reports a failure. While maxInFlight messages are in flight, the publisher keeps its
+ * frames queued instead of letting the client's own queue grow on a slow uplink.
+ *
+ * The pacer also sets how many completed ResultSets the main loop hands over per cycle. This
+ * budget is halved whenever the delivery latency exceeds its target, the window has been full
+ * or deliveries have stalled since the last adjustment, and raised again step by step while
+ * deliveries are fast. Results held back this way stay with their module and are handed
+ * over in a later cycle with the values read in between.
+ *
+ * Messages are sent by the publisher thread only. Deliveries are confirmed on the thread of
+ * the MQTT client and the budget is read by the main loop.
+ */
+typedef struct SendPacer {
+    PacerSlot slots[PACER_SLOT_COUNT];
+    uint32_t nextSerial;            ///< The serial number of the next message, publisher only
+    atomic_uint resetSerial;        ///< Messages sent before this one were given up on a disconnect
+    atomic_uint inFlight;           ///< Messages handed to the client and neither delivered nor failed
+    atomic_ullong delivered;        ///< Messages confirmed by the client
+    atomic_ullong failed;           ///< Messages the client failed to send
+    uint32_t maxInFlight;           ///< The window of messages in flight
+    uint32_t targetUs;              ///< The delivery latency above which the budget is reduced
+    atomic_uint latencyUs;          ///< The moving average of the delivery latency
+    pthread_mutex_t deliveryLock;   ///< Protects delivery, which is recorded and read on different threads
+    LatencyHistogram delivery;      ///< The delivery latency in microseconds
+    atomic_uint budget;             ///< ResultSets the main loop may hand over per cycle, in PACER_BUDGET_UNITs
+    uint32_t maxBudget;             ///< The budget when deliveries are fast
+    bool windowFull;                ///< Whether the window has been full since the last adjustment, publisher only
+    uint64_t lastDelivered;         ///< The messages delivered up to the last adjustment, publisher only
+    struct timespec lastAdjust;     ///< When the budget has last been adjusted, publisher only
+} SendPacer;
+
+/// The pacer of the MQTT client, as its callbacks only get a context pointer, which carries the serial number
+SendPacer sendPacer;
+
+/**
+ * @brief Initializes a pacer with the full budget
+ *
+ * @param[out] pacer The pacer to initialize
+ * @param[in] maxSendCount The number of ResultSets the main loop may hand over per cycle at most
+ * @param[in] maxInFlight The window of messages in flight, at most PACER_MAX_IN_FLIGHT
+ * @param[in] targetMs The delivery latency above which the budget is reduced
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode pacer_init(SendPacer *pacer, uint32_t maxSendCount, uint32_t maxInFlight, uint32_t targetMs) {
+    memset(pacer, 0, sizeof(SendPacer));
+    if (pthread_mutex_init(&pacer->deliveryLock, NULL) != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to initialize the send pacer\n");
+        return -ERROR_THREAD_CREATION_FAILED;
+    }
+    pacer->maxInFlight = maxInFlight < PACER_MAX_IN_FLIGHT ? maxInFlight : PACER_MAX_IN_FLIGHT;
+    pacer->targetUs = targetMs * 1000;
+    pacer->maxBudget = maxSendCount * PACER_BUDGET_UNIT;
+    atomic_store(&pacer->budget, pacer->maxBudget);
+    clock_gettime(CLOCK_MONOTONIC, &pacer->lastAdjust);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Releases the resources of a pacer
+ */
+void pacer_destroy(SendPacer *pacer) {
+    pthread_mutex_destroy(&pacer->deliveryLock);
+}
+
+/**
+ * @brief Takes note of a message about to be handed to the MQTT client
+ *
+ * @param[in] pacer The pacer
+ * @param[in] tag A value returned by pacer_finish() once the message has been delivered
+ * @retval The context to pass to the response callbacks of the message @see pacer_finish
+ */
+void *pacer_begin(SendPacer *pacer, uint64_t tag) {
+    uint32_t serial = pacer->nextSerial++;
+    PacerSlot *slot = &pacer->slots[serial % PACER_SLOT_COUNT];
+    clock_gettime(CLOCK_MONOTONIC, &slot->sentAt);
+    slot->tag = tag;
+    atomic_store_explicit(&slot->serial, serial, memory_order_release);
+    atomic_fetch_add_explicit(&pacer->inFlight, 1, memory_order_relaxed);
+    return (void *)(uintptr_t)serial;
+}
+
+/**
+ * @brief Takes note of a message which has been delivered or could not be sent
+ *
+ * Messages given up on a disconnect have already left the window, so finishing them late
+ * only counts them.
+ *
+ * @param[in] pacer The pacer
+ * @param[in] context The context returned for the message by pacer_begin()
+ * @param[in] delivered Whether the message has been delivered
+ * @retval The tag passed to pacer_begin() for a delivered message, 0 otherwise or if the
+ *         message has been given up on so long ago that its slot has been taken again
+ */
+uint64_t pacer_finish(SendPacer *pacer, void *context, bool delivered) {
+    const uint32_t serial = (uint32_t)(uintptr_t)context;
+    uint64_t tag = 0;
+    if (!delivered) {
+        atomic_fetch_add_explicit(&pacer->failed, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&pacer->delivered, 1, memory_order_relaxed);
+        // a slot which has been taken again belongs to a message long given up on
+        PacerSlot *slot = &pacer->slots[serial % PACER_SLOT_COUNT];
+        if (atomic_load_explicit(&slot->serial, memory_order_acquire) == serial) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            // on a congested uplink this can take longer than elapsed_ns() covers
+            int64_t us = (int64_t)(now.tv_sec - slot->sentAt.tv_sec) * 1000000
+                         + (now.tv_nsec - slot->sentAt.tv_nsec) / 1000;
+            uint32_t latencyUs = us < 0 ? 0 : us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+            uint32_t average = atomic_load_explicit(&pacer->latencyUs, memory_order_relaxed);
+            atomic_store_explicit(&pacer->latencyUs, average - average / 8 + latencyUs / 8, memory_order_relaxed);
+            pthread_mutex_lock(&pacer->deliveryLock);
+            histogram_record(&pacer->delivery, latencyUs);
+            pthread_mutex_unlock(&pacer->deliveryLock);
+            tag = slot->tag;
+        }
+    }
+
+    if ((int32_t)(serial - atomic_load_explicit(&pacer->resetSerial, memory_order_acquire)) < 0) {
+        return tag;
+    }
+    unsigned inFlight = atomic_load_explicit(&pacer->inFlight, memory_order_relaxed);
+    while (inFlight > 0 && !atomic_compare_exchange_weak_explicit(&pacer->inFlight, &inFlight, inFlight - 1,
+                                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return tag;
+}
+
+/**
+ * @brief Gives up on all messages in flight, after the connection has been lost
+ *
+ * The client may never report on them, which would keep the window closed for good.
+ */
+void pacer_reset(SendPacer *pacer) {
+    atomic_store_explicit(&pacer->resetSerial, pacer->nextSerial, memory_order_release);
+    atomic_store_explicit(&pacer->inFlight, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Checks whether another message may be handed to the MQTT client. Publisher only.
+ */
+bool pacer_window_open(SendPacer *pacer) {
+    if (atomic_load_explicit(&pacer->inFlight, memory_order_relaxed) < pacer->maxInFlight) {
+        return true;
+    }
+    pacer->windowFull = true;
+    return false;
+}
+
+/**
+ * @brief Adapts the send budget of the main loop to the delivery latency. Publisher only.
+ *
+ * Does nothing until PACER_ADJUST_INTERVAL_MS have passed since the last adjustment. The
+ * budget is halved on congestion and raised by an eighth of the full budget once the
+ * latency is down to half of its target.
+ */
+void pacer_adjust(SendPacer *pacer) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (elapsed_ns(&pacer->lastAdjust, &now) < (uint32_t)PACER_ADJUST_INTERVAL_MS * 1000000) {
+        return;
+    }
+    pacer->lastAdjust = now;
+
+    const uint64_t delivered = atomic_load_explicit(&pacer->delivered, memory_order_relaxed);
+    const bool stalled = delivered == pacer->lastDelivered
+                         && atomic_load_explicit(&pacer->inFlight, memory_order_relaxed) > 0;
+    const uint32_t latencyUs = atomic_load_explicit(&pacer->latencyUs, memory_order_relaxed);
+    const uint32_t budget = atomic_load_explicit(&pacer->budget, memory_order_relaxed);
+    uint32_t adjusted = budget;
+
+    if (pacer->windowFull || stalled || latencyUs > pacer->targetUs) {
+        adjusted = budget / 2 > PACER_MIN_BUDGET ? budget / 2 : PACER_MIN_BUDGET;
+    } else if (latencyUs <= pacer->targetUs / 2 && budget < pacer->maxBudget) {
+        const uint32_t step = pacer->maxBudget / 8 > PACER_MIN_BUDGET ? pacer->maxBudget / 8 : PACER_MIN_BUDGET;
+        adjusted = pacer->maxBudget - budget > step ? budget + step : pacer->maxBudget;
+    }
+    if (adjusted != budget) {
+        dprintf(LOGLEVEL_DEBUG, "Send budget %.2f ResultSets per cycle, delivery latency %.1fms\n",
+                (double)adjusted / PACER_BUDGET_UNIT, latencyUs / 1000.0);
+        atomic_store_explicit(&pacer->budget, adjusted, memory_order_relaxed);
+    }
+    pacer->windowFull = false;
+    pacer->lastDelivered = delivered;
+}
+
+/**
+ * @brief Returns how many ResultSets the main loop may hand over per cycle, in PACER_BUDGET_UNITs
+ */
+uint32_t pacer_cycle_budget(SendPacer *pacer) {
+    return atomic_load_explicit(&pacer->budget, memory_order_relaxed);
+}
+
+/**
+ * @brief Formats the delivery latency and the state of the pacer as a human-readable table
+ *
+ * @param[in] pacer The pacer
+ * @param[out] buf The buffer to write to
+ * @param[in] bufSize The size of the buffer
+ * @retval The length of the resulting string
+ */
+size_t format_pacer_stats(SendPacer *pacer, char *buf, size_t bufSize) {
+    if (bufSize == 0) {
+        return 0;
+    }
+    int written = snprintf(buf, bufSize,
+                           "message        p50       p90       p99      p999       min       max [ms]\n");
+    size_t length = written < 0 ? 0 : (size_t)written < bufSize ? (size_t)written : bufSize - 1;
+    pthread_mutex_lock(&pacer->deliveryLock);
+    length += format_histogram_line(buf + length, bufSize - length, "delivery", &pacer->delivery);
+    pthread_mutex_unlock(&pacer->deliveryLock);
+    written = snprintf(buf + length, bufSize - length,
+                       "in flight: %u of %u, delivered: %llu, failed: %llu, send budget: %.2f per cycle\n",
+                       atomic_load(&pacer->inFlight), pacer->maxInFlight,
+                       (unsigned long long)atomic_load(&pacer->delivered),
+                       (unsigned long long)atomic_load(&pacer->failed),
+                       (double)pacer_cycle_budget(pacer) / PACER_BUDGET_UNIT);
+    if (written > 0) {
+        length += (size_t)written < bufSize - length ? (size_t)written : bufSize - length - 1;
+    }
+    return length;
+}
+
+#endif
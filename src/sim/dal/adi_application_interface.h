@@ -0,0 +1,65 @@
+#ifndef SIM_ADI_APPLICATION_INTERFACE_H
+#define SIM_ADI_APPLICATION_INTERFACE_H
+
+/*
+ * Host-side stand-in for the DAL application device interface of the PFC Firmware SDK.
+ * Only the parts used by the energy meter are declared here, the implementation lives
+ * in sim/kbus_sim.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DAL_SUCCESS 0
+#define DAL_FAILURE -1
+
+#define OS_ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef int32_t tDalResult;
+typedef int32_t tDeviceId;
+
+/**
+ * @brief Name and ID of a device known to the DAL
+ */
+typedef struct tDeviceInfo {
+    tDeviceId DeviceId;
+    const char *DeviceName;
+} tDeviceInfo;
+
+/**
+ * @brief The possible states of the PLC application
+ */
+typedef enum tApplicationState {
+    ApplicationState_Unconfigured,
+    ApplicationState_Running,
+    ApplicationState_Stopped
+} tApplicationState;
+
+typedef struct tApplicationStateChangedEvent {
+    tApplicationState State;
+} tApplicationStateChangedEvent;
+
+/**
+ * @brief The function table making up the application device interface
+ */
+typedef struct tApplicationDeviceInterface {
+    tDalResult (*Init)(void);
+    tDalResult (*Exit)(void);
+    tDalResult (*ScanDevices)(void);
+    tDalResult (*GetDeviceList)(size_t listSize, tDeviceInfo *deviceList, size_t *deviceCount);
+    tDalResult (*OpenDevice)(tDeviceId deviceId);
+    tDalResult (*CloseDevice)(tDeviceId deviceId);
+    tDalResult (*ApplicationStateChanged)(tApplicationStateChangedEvent event);
+    tDalResult (*CallDeviceSpecificFunction)(const char *functionName, void *retval, ...);
+    tDalResult (*WatchdogTrigger)(void);
+    tDalResult (*ReadStart)(tDeviceId deviceId, uint32_t taskId);
+    tDalResult (*ReadBytes)(tDeviceId deviceId, uint32_t taskId, uint32_t offset, uint32_t size, void *data);
+    tDalResult (*ReadEnd)(tDeviceId deviceId, uint32_t taskId);
+    tDalResult (*WriteStart)(tDeviceId deviceId, uint32_t taskId);
+    tDalResult (*WriteBytes)(tDeviceId deviceId, uint32_t taskId, uint32_t offset, uint32_t size, void *data);
+    tDalResult (*WriteEnd)(tDeviceId deviceId, uint32_t taskId);
+} tApplicationDeviceInterface;
+
+tApplicationDeviceInterface *adi_GetApplicationInterface(void);
+
+#endif
@@ -0,0 +1,534 @@
+#ifndef KBUS_SIM_H
+#define KBUS_SIM_H
+
+/*
+ * A simulated ADI/KBus backend for running the energy meter on a regular Linux host.
+ *
+ * It implements the parts of the DAL application device interface and the KBus info
+ * functions used by the program on top of a configurable terminal list. Power measurement
+ * modules behave roughly like a real 750-494/495: they echo the requested collection and
+ * measurement IDs, need a few cycles to settle after the requested IDs change, and fill
+ * their process values with plausible readings.
+ *
+ * The simulation is configured using the following environment variables:
+ *   SIM_PM_MODULES         number of 750-494/495 modules (default 1)
+ *   SIM_493_MODULES        number of (unsupported) 750-493 modules (default 0)
+ *   SIM_FILLER_MODULES     number of non-PM analog/digital modules (default 0)
+ *   SIM_SETTLE_CYCLES      extra cycles a module stays unstable after a colID or metID change (default 0)
+ *   SIM_UNSTABLE_PERMILLE  chance of a spurious valuesUnstable flag per module and cycle (default 0)
+ *   SIM_OUT_OF_RANGE_PERMILLE chance of a process value being flagged out of range per slot and cycle (default 0)
+ *   SIM_PUSH_US            simulated duration of a KBus push in microseconds (default 0)
+ *   SIM_CYCLES             stop the program after this many cycles, 0 runs forever (default 0)
+ *   SIM_FULL_SPEED         if set to 1, run the main loop without waiting for the cycle time
+ */
+
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dal/adi_application_interface.h>
+#include <ldkc_kbus_information.h>
+
+#include "../collection.h"
+#include "../process_image.h"
+#include "../utils.h"
+
+#define SIM_DEVICE_ID 1
+#define SIM_PM_IMAGE_SIZE sizeof(Type495ProcessInput)
+#define SIM_493_IMAGE_SIZE 12
+#define SIM_ANALOG_FILLER_IMAGE_SIZE 8
+#define SIM_DIGITAL_FILLER_BITS 8
+
+/**
+ * @brief State of a single simulated terminal
+ */
+typedef struct SimTerminal {
+    uint16_t type;              ///< The terminal type as reported in the terminal list (e.g. 495)
+    tldkc_KbusInfo_TerminalInfo info; ///< Position and size of the terminal in the process images
+    uint8_t requestedColID;     ///< The collection requested during the last push
+    uint8_t requestedMetID[4];  ///< The measurement IDs requested during the last push
+    unsigned settleRemaining;   ///< Cycles left until the values are stable again
+    uint32_t energy[4];         ///< Running energy counters, one per slot
+} SimTerminal;
+
+/**
+ * @brief State of the simulated KBus
+ */
+typedef struct SimBus {
+    SimTerminal terminals[LDKC_KBUS_TERMINAL_COUNT_MAX];
+    size_t terminalCount;
+    tldkc_KbusInfo_Status status;
+    uint8_t *inputImage;
+    uint8_t *outputImage;
+    size_t inputSize;
+    size_t outputSize;
+    unsigned settleCycles;
+    unsigned unstablePermille;
+    unsigned outOfRangePermille;
+    unsigned long pushUs;
+    unsigned long maxCycles;
+    bool fullSpeed;
+    unsigned long cycles;
+    struct timespec startTime;
+    unsigned int randomState;
+} SimBus;
+
+SimBus simBus;
+
+/**
+ * @brief Reads an unsigned number from an environment variable
+ *
+ * @param[in] name The name of the variable
+ * @param[in] fallback The value to use if the variable is not set
+ * @retval The value of the variable, or fallback if it is not set
+ */
+unsigned long sim_env(const char *name, unsigned long fallback) {
+    const char *value = getenv(name);
+    return value == NULL || *value == '\0' ? fallback : strtoul(value, NULL, 10);
+}
+
+/**
+ * @brief Whether the main loop should run without waiting for the cycle time
+ */
+bool sim_full_speed(void) {
+    return simBus.fullSpeed;
+}
+
+/**
+ * @brief Appends a terminal of the given type to the simulated bus
+ *
+ * Analog and complex modules are mapped to the start of the process images in the order
+ * they appear on the bus, digital modules are packed bitwise after them, just like on a PFC.
+ * Offsets of the digital modules are fixed up in sim_layout() once all sizes are known.
+ */
+void sim_add_terminal(uint16_t type) {
+    if (simBus.terminalCount == LDKC_KBUS_TERMINAL_COUNT_MAX) {
+        return;
+    }
+    SimTerminal *terminal = &simBus.terminals[simBus.terminalCount++];
+    memset(terminal, 0, sizeof(SimTerminal));
+    terminal->type = type;
+
+    switch (type) {
+        case 494:
+        case 495:
+            terminal->info.SizeInput_bits = SIM_PM_IMAGE_SIZE * 8;
+            terminal->info.SizeOutput_bits = SIM_PM_IMAGE_SIZE * 8;
+            break;
+        case 493:
+            terminal->info.SizeInput_bits = SIM_493_IMAGE_SIZE * 8;
+            terminal->info.SizeOutput_bits = SIM_493_IMAGE_SIZE * 8;
+            break;
+        case 455:
+            terminal->info.SizeInput_bits = SIM_ANALOG_FILLER_IMAGE_SIZE * 8;
+            break;
+        case 430:
+            terminal->info.SizeInput_bits = SIM_DIGITAL_FILLER_BITS;
+            break;
+        case 530:
+            terminal->info.SizeOutput_bits = SIM_DIGITAL_FILLER_BITS;
+            break;
+    }
+}
+
+/**
+ * @brief Whether a terminal type is mapped into the digital part of the process image
+ */
+bool sim_is_digital(uint16_t type) {
+    return type == 430 || type == 530;
+}
+
+/**
+ * @brief Assigns process image offsets to all terminals and computes the bus status
+ */
+void sim_layout(void) {
+    uint16_t analogIn = 0, analogOut = 0, digitalIn = 0, digitalOut = 0;
+
+    for (size_t i = 0; i < simBus.terminalCount; i++) {
+        SimTerminal *terminal = &simBus.terminals[i];
+        if (sim_is_digital(terminal->type)) {
+            continue;
+        }
+        terminal->info.OffsetInput_bits = analogIn;
+        terminal->info.OffsetOutput_bits = analogOut;
+        analogIn += terminal->info.SizeInput_bits;
+        analogOut += terminal->info.SizeOutput_bits;
+    }
+    for (size_t i = 0; i < simBus.terminalCount; i++) {
+        SimTerminal *terminal = &simBus.terminals[i];
+        if (!sim_is_digital(terminal->type)) {
+            continue;
+        }
+        terminal->info.OffsetInput_bits = analogIn + digitalIn;
+        terminal->info.OffsetOutput_bits = analogOut + digitalOut;
+        digitalIn += terminal->info.SizeInput_bits;
+        digitalOut += terminal->info.SizeOutput_bits;
+    }
+
+    simBus.status.TerminalCount = simBus.terminalCount;
+    simBus.status.BitCountAnalogInput = analogIn;
+    simBus.status.BitCountAnalogOutput = analogOut;
+    simBus.status.BitCountDigitalInput = digitalIn;
+    simBus.status.BitCountDigitalOutput = digitalOut;
+
+    // same computation as get_process_data_size(), so the program's images match ours
+    simBus.inputSize = (analogIn / 8) + (digitalIn / 8 + 1);
+    simBus.outputSize = (analogOut / 8) + (digitalOut / 8 + 1);
+}
+
+/**
+ * @brief Produces a plausible raw process value for a measurement
+ *
+ * The values are scaled like the ones of a real module where the scaling is known
+ * (see unit_description.h) and vary slowly over time and between modules.
+ *
+ * @param[in] terminal The terminal to produce the value for
+ * @param[in] slot The process value slot (0-3)
+ * @param[in] metID The requested measurement ID
+ * @retval The raw process value
+ */
+uint32_t sim_measurement_value(SimTerminal *terminal, size_t slot, uint8_t metID) {
+    double phase = (double)simBus.cycles / 100 + (terminal - simBus.terminals);
+    double wave = sin(phase + metID);
+    double noise = (double)(rand_r(&simBus.randomState) % 1000) / 1000 - 0.5;
+
+    switch (metID) {
+        case VOLTAGE_RMS_L1N ... VOLTAGE_RMS_L3N:
+        case VOLTAGE_RMS_MAX_L1N ... VOLTAGE_MEAN_L3N:
+            return (uint32_t)((230 + 3 * wave + noise) * 100);
+        case VOLTAGE_RMS_L1L2 ... VOLTAGE_RMS_L2L2:
+            return (uint32_t)((400 + 5 * wave + noise) * 100);
+        case VOLTAGE_PEAK_L1N ... VOLTAGE_PEAK_L3N:
+            return (uint32_t)((325 + 4 * wave + noise) * 100);
+        case CURRENT_RMS_L1 ... CURRENT_RMS_L3:
+        case CURRENT_RMS_MAX_L1 ... CURRENT_MEAN_L3:
+        case CURRENT_PEAK_L1 ... CURRENT_RMS_N:
+            return (uint32_t)((5 + 2 * wave + noise / 10) * 10000);
+        case POWER_EFFECTIVE_L1 ... POWER_EFFECTIVE_L3:
+        case POWER_EFFECTIVE_MAX_L1 ... POWER_EFFECTIVE_MIN_L3:
+            return (uint32_t)(int32_t)((1150 + 800 * wave + 10 * noise) * 100);
+        case POWER_REACTIVE_L1 ... POWER_REACTIVE_L3:
+            return (uint32_t)(int32_t)((200 * wave + 5 * noise) * 100);
+        case POWER_APPARENT_L1 ... POWER_APPARENT_L3:
+            return (uint32_t)((1200 + 800 * fabs(wave) + 10 * noise) * 100);
+        case ENERGY_ACTIVE_L1 ... ENERGY_APPARENT_L3:
+            terminal->energy[slot] += 1 + rand_r(&simBus.randomState) % 3;
+            return terminal->energy[slot];
+        case LINE_FREQUENCY_L1 ... LINE_FREQUENCY_L3:
+        case LINE_FREQUENCY_MAX_L1 ... LINE_FREQUENCY_MIN_L3:
+            return (uint32_t)((50 + wave / 20) * 100);
+        case PHASE_ANGLE_PHI_L1 ... PHASE_ANGLE_PHI_L3:
+            return (uint32_t)(int32_t)((10 * wave) * 100);
+        case COS_PHI_L1 ... POWER_FACTOR_LF_L3:
+            return (uint32_t)(int32_t)((0.95 + wave / 20) * 1000);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Produces a plausible harmonic amplitude
+ *
+ * The fundamental is 100 %, odd harmonics decay with their order and even ones are small.
+ *
+ * @param[in] order The order of the harmonic
+ * @retval The raw process value in 0.01 % of the fundamental
+ */
+uint32_t sim_harmonic_value(uint8_t order) {
+    if (order == 0 || order > HARMONIC_MAX_ORDER) {
+        return 0;
+    }
+    if (order == 1) {
+        return 10000;
+    }
+    double noise = (double)(rand_r(&simBus.randomState) % 1000) / 1000 - 0.5;
+    double amplitude = (order % 2 ? 2000.0 : 200.0) / order + 10 * noise;
+    return amplitude > 0 ? (uint32_t)amplitude : 0;
+}
+
+/**
+ * @brief Advances a simulated power measurement module by one bus cycle
+ *
+ * The module picks up the request from its output window and answers in its input window.
+ */
+void sim_step_pm_module(SimTerminal *terminal) {
+    Type495ProcessOutput *output =
+        (Type495ProcessOutput *)(simBus.outputImage + terminal->info.OffsetOutput_bits / 8);
+    Type495ProcessInput *input =
+        (Type495ProcessInput *)(simBus.inputImage + terminal->info.OffsetInput_bits / 8);
+
+    if (terminal->requestedColID != output->colID
+        || memcmp(terminal->requestedMetID, output->metID, sizeof(output->metID)) != 0) {
+        terminal->requestedColID = output->colID;
+        memcpy(terminal->requestedMetID, output->metID, sizeof(output->metID));
+        terminal->settleRemaining = simBus.settleCycles;
+    }
+
+    memset(input, 0, sizeof(Type495ProcessInput));
+    input->commMethod = output->commMethod;
+    input->statusRequest = output->statusRequest;
+    input->colID = output->colID;
+
+    if (terminal->settleRemaining > 0) {
+        // a transient reaction is in progress: no confirmed IDs and no values yet
+        terminal->settleRemaining--;
+        input->valuesUnstable = 1;
+        return;
+    }
+
+    if (simBus.unstablePermille > 0 &&
+        (unsigned)(rand_r(&simBus.randomState) % 1000) < simBus.unstablePermille) {
+        input->valuesUnstable = 1;
+    }
+
+    // the module does not confirm any measurements from a collection it doesn't know
+    if (output->colID != AC_MEASUREMENT && !is_harmonic_collection(output->colID)) {
+        return;
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        uint32_t value = output->colID == AC_MEASUREMENT ? sim_measurement_value(terminal, i, output->metID[i])
+                                                         : sim_harmonic_value(output->metID[i]);
+        input->metID[i] = output->metID[i];
+        input->processValue[i][0] = value & 0xFF;
+        input->processValue[i][1] = (value >> 8) & 0xFF;
+        input->processValue[i][2] = (value >> 16) & 0xFF;
+        input->processValue[i][3] = (value >> 24) & 0xFF;
+    }
+
+    if (simBus.outOfRangePermille > 0) {
+        input->outOfRange1 = (unsigned)(rand_r(&simBus.randomState) % 1000) < simBus.outOfRangePermille;
+        input->outOfRange2 = (unsigned)(rand_r(&simBus.randomState) % 1000) < simBus.outOfRangePermille;
+        input->outOfRange3 = (unsigned)(rand_r(&simBus.randomState) % 1000) < simBus.outOfRangePermille;
+        input->outOfRange4 = (unsigned)(rand_r(&simBus.randomState) % 1000) < simBus.outOfRangePermille;
+    }
+}
+
+/**
+ * @brief Simulates a KBus push: exchanges the process data of all modules
+ */
+tDalResult sim_push(void) {
+    struct timespec pushStart, now;
+    clock_gettime(CLOCK_MONOTONIC, &pushStart);
+
+    for (size_t i = 0; i < simBus.terminalCount; i++) {
+        if (simBus.terminals[i].type == 494 || simBus.terminals[i].type == 495) {
+            sim_step_pm_module(&simBus.terminals[i]);
+        }
+    }
+
+    // busy-wait for the remainder of the configured bus cycle, sleeping would be far too coarse
+    if (simBus.pushUs > 0) {
+        do {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while ((now.tv_sec - pushStart.tv_sec) * 1000000 +
+                 (now.tv_nsec - pushStart.tv_nsec) / 1000 < (long)simBus.pushUs);
+    }
+
+    simBus.cycles++;
+    if (simBus.maxCycles > 0 && simBus.cycles == simBus.maxCycles) {
+        raise(SIGINT);
+    }
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_Init(void) {
+    memset(&simBus, 0, sizeof(SimBus));
+    simBus.settleCycles = sim_env("SIM_SETTLE_CYCLES", 0);
+    simBus.unstablePermille = sim_env("SIM_UNSTABLE_PERMILLE", 0);
+    simBus.outOfRangePermille = sim_env("SIM_OUT_OF_RANGE_PERMILLE", 0);
+    simBus.pushUs = sim_env("SIM_PUSH_US", 0);
+    simBus.maxCycles = sim_env("SIM_CYCLES", 0);
+    simBus.fullSpeed = sim_env("SIM_FULL_SPEED", 0) != 0;
+    simBus.randomState = 1;
+
+    size_t pmModules = sim_env("SIM_PM_MODULES", 1);
+    size_t modules493 = sim_env("SIM_493_MODULES", 0);
+    size_t fillerModules = sim_env("SIM_FILLER_MODULES", 0);
+    const uint16_t fillerTypes[] = { 455, 430, 530 };
+
+    // spread the filler modules between the PM modules, so their windows are not contiguous
+    size_t filler = 0;
+    for (size_t i = 0; i < pmModules; i++) {
+        sim_add_terminal(i % 2 == 0 ? 495 : 494);
+        if (filler < fillerModules) {
+            sim_add_terminal(fillerTypes[filler++ % OS_ARRAY_SIZE(fillerTypes)]);
+        }
+    }
+    for (size_t i = 0; i < modules493; i++) {
+        sim_add_terminal(493);
+    }
+    while (filler < fillerModules) {
+        sim_add_terminal(fillerTypes[filler++ % OS_ARRAY_SIZE(fillerTypes)]);
+    }
+    sim_layout();
+
+    simBus.inputImage = calloc(simBus.inputSize, 1);
+    simBus.outputImage = calloc(simBus.outputSize, 1);
+    if (simBus.inputImage == NULL || simBus.outputImage == NULL) {
+        return DAL_FAILURE;
+    }
+
+    dprintf(LOGLEVEL_NOTICE,
+            "Simulating %zu terminals (%zu PM, %zu 750-493, %zu filler), image sizes %zu/%zu bytes\n",
+            simBus.terminalCount, pmModules, modules493, fillerModules,
+            simBus.inputSize, simBus.outputSize);
+    clock_gettime(CLOCK_MONOTONIC, &simBus.startTime);
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_Exit(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - simBus.startTime.tv_sec) +
+                     (now.tv_nsec - simBus.startTime.tv_nsec) / 1E9;
+    dprintf(LOGLEVEL_NOTICE,
+            "Simulated %lu KBus cycles in %.3fs (%.1fus per cycle)\n",
+            simBus.cycles, elapsed, simBus.cycles ? elapsed * 1E6 / simBus.cycles : 0);
+
+    free(simBus.inputImage);
+    free(simBus.outputImage);
+    simBus.inputImage = NULL;
+    simBus.outputImage = NULL;
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_ScanDevices(void) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_GetDeviceList(size_t listSize, tDeviceInfo *deviceList, size_t *deviceCount) {
+    if (listSize < sizeof(tDeviceInfo)) {
+        *deviceCount = 0;
+        return DAL_FAILURE;
+    }
+    deviceList[0].DeviceId = SIM_DEVICE_ID;
+    deviceList[0].DeviceName = "libpackbus";
+    *deviceCount = 1;
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_OpenDevice(tDeviceId deviceId) {
+    return deviceId == SIM_DEVICE_ID ? DAL_SUCCESS : DAL_FAILURE;
+}
+
+tDalResult sim_CloseDevice(tDeviceId deviceId) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_ApplicationStateChanged(tApplicationStateChangedEvent event) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_CallDeviceSpecificFunction(const char *functionName, void *retval, ...) {
+    if (strcmp(functionName, "libpackbus_Push") != 0) {
+        return DAL_FAILURE;
+    }
+    *(uint32_t *)retval = sim_push();
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_WatchdogTrigger(void) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_ReadStart(tDeviceId deviceId, uint32_t taskId) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_ReadBytes(tDeviceId deviceId, uint32_t taskId, uint32_t offset, uint32_t size, void *data) {
+    if (offset + size > simBus.inputSize) {
+        return DAL_FAILURE;
+    }
+    memcpy(data, simBus.inputImage + offset, size);
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_ReadEnd(tDeviceId deviceId, uint32_t taskId) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_WriteStart(tDeviceId deviceId, uint32_t taskId) {
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_WriteBytes(tDeviceId deviceId, uint32_t taskId, uint32_t offset, uint32_t size, void *data) {
+    if (offset + size > simBus.outputSize) {
+        return DAL_FAILURE;
+    }
+    memcpy(simBus.outputImage + offset, data, size);
+    return DAL_SUCCESS;
+}
+
+tDalResult sim_WriteEnd(tDeviceId deviceId, uint32_t taskId) {
+    return DAL_SUCCESS;
+}
+
+tApplicationDeviceInterface simAdi = {
+    .Init = sim_Init,
+    .Exit = sim_Exit,
+    .ScanDevices = sim_ScanDevices,
+    .GetDeviceList = sim_GetDeviceList,
+    .OpenDevice = sim_OpenDevice,
+    .CloseDevice = sim_CloseDevice,
+    .ApplicationStateChanged = sim_ApplicationStateChanged,
+    .CallDeviceSpecificFunction = sim_CallDeviceSpecificFunction,
+    .WatchdogTrigger = sim_WatchdogTrigger,
+    .ReadStart = sim_ReadStart,
+    .ReadBytes = sim_ReadBytes,
+    .ReadEnd = sim_ReadEnd,
+    .WriteStart = sim_WriteStart,
+    .WriteBytes = sim_WriteBytes,
+    .WriteEnd = sim_WriteEnd
+};
+
+tApplicationDeviceInterface *adi_GetApplicationInterface(void) {
+    return &simAdi;
+}
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_Create(void) {
+    return KbusInfo_Ok;
+}
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_Destroy(void) {
+    return KbusInfo_Ok;
+}
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetStatus(tldkc_KbusInfo_Status *status) {
+    *status = simBus.status;
+    return KbusInfo_Ok;
+}
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetTerminalInfo(size_t maxCount,
+                                                    tldkc_KbusInfo_TerminalInfo *terminalInfo,
+                                                    size_t *terminalCount) {
+    size_t count = simBus.terminalCount < maxCount ? simBus.terminalCount : maxCount;
+    for (size_t i = 0; i < count; i++) {
+        terminalInfo[i] = simBus.terminals[i].info;
+    }
+    if (terminalCount != NULL) {
+        *terminalCount = count;
+    }
+    return KbusInfo_Ok;
+}
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetTerminalList(size_t maxCount,
+                                                    uint16_t *terminals,
+                                                    size_t *terminalCount) {
+    size_t count = simBus.terminalCount < maxCount ? simBus.terminalCount : maxCount;
+    for (size_t i = 0; i < count; i++) {
+        terminals[i] = simBus.terminals[i].type;
+    }
+    if (terminalCount != NULL) {
+        *terminalCount = count;
+    }
+    return KbusInfo_Ok;
+}
+
+#endif
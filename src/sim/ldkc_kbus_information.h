@@ -0,0 +1,55 @@
+#ifndef SIM_LDKC_KBUS_INFORMATION_H
+#define SIM_LDKC_KBUS_INFORMATION_H
+
+/*
+ * Host-side stand-in for the KBus information DBus interface of the PFC Firmware SDK.
+ * The implementation lives in sim/kbus_sim.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LDKC_KBUS_TERMINAL_COUNT_MAX 255
+
+typedef enum tldkc_KbusInfo_Result {
+    KbusInfo_Ok = 0,
+    KbusInfo_Failed = 1
+} tldkc_KbusInfo_Result;
+
+/**
+ * @brief Overall state of the KBus including the process image bit counts
+ */
+typedef struct tldkc_KbusInfo_Status {
+    uint8_t KbusBitCount;
+    uint16_t TerminalCount;
+    uint16_t ErrorCode;
+    uint16_t ErrorArg;
+    uint16_t ErrorPos;
+    uint16_t BitCountAnalogInput;
+    uint16_t BitCountAnalogOutput;
+    uint16_t BitCountDigitalInput;
+    uint16_t BitCountDigitalOutput;
+} tldkc_KbusInfo_Status;
+
+/**
+ * @brief Position and size of a terminal's data in the process images
+ */
+typedef struct tldkc_KbusInfo_TerminalInfo {
+    uint16_t OffsetInput_bits;
+    uint16_t SizeInput_bits;
+    uint16_t OffsetOutput_bits;
+    uint16_t SizeOutput_bits;
+    uint8_t AdditionalInfo;
+} tldkc_KbusInfo_TerminalInfo;
+
+tldkc_KbusInfo_Result ldkc_KbusInfo_Create(void);
+tldkc_KbusInfo_Result ldkc_KbusInfo_Destroy(void);
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetStatus(tldkc_KbusInfo_Status *status);
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetTerminalInfo(size_t maxCount,
+                                                    tldkc_KbusInfo_TerminalInfo *terminalInfo,
+                                                    size_t *terminalCount);
+tldkc_KbusInfo_Result ldkc_KbusInfo_GetTerminalList(size_t maxCount,
+                                                    uint16_t *terminals,
+                                                    size_t *terminalCount);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef SIM_LDKC_KBUS_REGISTER_COMMUNICATION_H
+#define SIM_LDKC_KBUS_REGISTER_COMMUNICATION_H
+
+/*
+ * Host-side stand-in for the KBus register communication interface of the PFC Firmware SDK.
+ * Register communication is not used by the energy meter, so there is nothing to provide here.
+ */
+
+#endif
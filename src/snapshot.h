@@ -0,0 +1,199 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "snapshot_layout.h"
+#include "unit_description.h"
+#include "utils.h"
+
+#define SNAPSHOT_NAME_LENGTH 64     ///< Maximum length of the name of the segment, including the terminator
+
+/**
+ * @brief The latest measurements of all modules in POSIX shared memory, for local consumers
+ *
+ * The main loop stores every value it reads from a module, so other processes on the PLC can
+ * read the latest values without going through the broker @see snapshot_reader.h. Storing
+ * costs a few plain stores per value and two atomic increments per module and cycle; the
+ * values of a module are published together once the module has been handled. The segment
+ * is created anew on every start and removed on exit.
+ *
+ * The snapshot is only written by the main loop.
+ */
+typedef struct Snapshot {
+    uint8_t *map;               ///< The mapped segment, NULL if the snapshot is disabled
+    size_t size;
+    SnapshotHeader *header;
+    size_t valueCount;
+    char name[SNAPSHOT_NAME_LENGTH];
+    uint64_t cycleNs;           ///< The timestamp of the values of the current cycle
+    size_t pending[RESULT_SET_MAX_VALUES];  ///< The values stored in copy 0 of the current module, but not in copy 1
+    size_t pendingCount;
+} Snapshot;
+
+/**
+ * @brief Returns the module at a position within the segment
+ */
+SnapshotModule *snapshot_module(const Snapshot *snapshot, size_t module) {
+    return (SnapshotModule *)(snapshot->map + snapshot->header->modulesOffset
+                              + module * snapshot->header->moduleStride);
+}
+
+/**
+ * @brief Returns a copy of the values of a module
+ */
+SnapshotValue *snapshot_copy(const Snapshot *snapshot, size_t module, size_t copy) {
+    return (SnapshotValue *)(snapshot_module(snapshot, module) + 1) + copy * snapshot->valueCount;
+}
+
+/**
+ * @brief Creates the shared-memory segment
+ *
+ * @param[out] snapshot The snapshot to initialize
+ * @param[in] name The name of the segment, e.g. "/energymeter", or an empty string to disable
+ *            the snapshot
+ * @param[in] descriptions The UnitDescriptions of the measurements
+ * @param[in] valueCount The number of measurements
+ * @param[in] moduleCount The number of power measurement modules
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode snapshot_open(Snapshot *snapshot, const char *name, const UnitDescription **descriptions, size_t valueCount,
+                        size_t moduleCount) {
+    memset(snapshot, 0, sizeof(Snapshot));
+    if (name[0] == '\0') {
+        return ERROR_SUCCESS;
+    }
+    const size_t measurementsOffset = sizeof(SnapshotHeader);
+    const size_t modulesOffset = (measurementsOffset + valueCount * sizeof(SnapshotMeasurement) + 63) & ~(size_t)63;
+    const size_t moduleStride = (sizeof(SnapshotModule) + 2 * valueCount * sizeof(SnapshotValue) + 63) & ~(size_t)63;
+    snapshot->size = modulesOffset + moduleCount * moduleStride;
+    snapshot->valueCount = valueCount;
+
+    // readers still holding a segment of an earlier run keep it until they open the new one
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, snapshot->size) != 0) {
+        dprintf(LOGLEVEL_ERR, "Failed to create the snapshot %s: %s\n", name, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(name);
+        }
+        return -ERROR_SNAPSHOT_FAILED;
+    }
+    void *map = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        dprintf(LOGLEVEL_ERR, "Failed to map the snapshot %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return -ERROR_SNAPSHOT_FAILED;
+    }
+    snapshot->map = map;
+    snapshot->header = map;
+    strncpy(snapshot->name, name, SNAPSHOT_NAME_LENGTH - 1);
+
+    // the segment starts out zeroed, so all values are invalid until they are first read
+    SnapshotHeader *header = snapshot->header;
+    header->version = SNAPSHOT_VERSION;
+    header->moduleCount = moduleCount;
+    header->valueCount = valueCount;
+    header->measurementsOffset = measurementsOffset;
+    header->modulesOffset = modulesOffset;
+    header->moduleStride = moduleStride;
+    header->writerPid = getpid();
+    header->size = snapshot->size;
+    SnapshotMeasurement *measurements = (SnapshotMeasurement *)(snapshot->map + measurementsOffset);
+    for (size_t i = 0; i < valueCount; i++) {
+        measurements[i] = (SnapshotMeasurement) {
+            .colID = descriptions[i]->colID,
+            .metID = descriptions[i]->metID,
+            .scaleExponent = descriptions[i]->scaleExponent,
+            .isUnsigned = descriptions[i]->isUnsigned,
+            .scalingFactor = descriptions[i]->scalingFactor
+        };
+    }
+    atomic_store_explicit(&header->running, 1, memory_order_relaxed);
+    atomic_store_explicit(&header->magic, SNAPSHOT_MAGIC, memory_order_release);
+    dprintf(LOGLEVEL_INFO, "Sharing the latest values in %s (%zu bytes)\n", name, snapshot->size);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Marks the snapshot as abandoned and removes the segment
+ */
+void snapshot_close(Snapshot *snapshot) {
+    if (snapshot->map == NULL) {
+        return;
+    }
+    atomic_store_explicit(&snapshot->header->running, 0, memory_order_release);
+    munmap(snapshot->map, snapshot->size);
+    shm_unlink(snapshot->name);
+    snapshot->map = NULL;
+}
+
+/**
+ * @brief Takes the timestamp for the values read in this cycle
+ */
+void snapshot_cycle(Snapshot *snapshot) {
+    if (snapshot->map == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_TAI, &now);
+    snapshot->cycleNs = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Stores the latest value of a measurement of a module
+ *
+ * The value becomes visible to readers with snapshot_module_done(), together with all other
+ * values of the module stored before.
+ *
+ * @param[in] snapshot The snapshot
+ * @param[in] module The index of the module
+ * @param[in] index The position of the measurement
+ * @param[in] value The value, sign-extended according to the measurement @see raw_value
+ */
+void snapshot_store(Snapshot *snapshot, size_t module, size_t index, int64_t value) {
+    if (snapshot->map == NULL) {
+        return;
+    }
+    if (snapshot->pendingCount == 0) {
+        // odd: readers switch over to copy 1
+        atomic_fetch_add_explicit(&snapshot_module(snapshot, module)->sequence, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+    snapshot_copy(snapshot, module, 0)[index] = (SnapshotValue) { .value = value, .timestampNs = snapshot->cycleNs };
+    snapshot->pending[snapshot->pendingCount++] = index;
+}
+
+/**
+ * @brief Publishes the values of a module stored since the last call
+ *
+ * @param[in] snapshot The snapshot
+ * @param[in] module The index of the module
+ */
+void snapshot_module_done(Snapshot *snapshot, size_t module) {
+    if (snapshot->pendingCount == 0) {
+        return;
+    }
+    // even: readers switch back to copy 0, which is complete now
+    atomic_fetch_add_explicit(&snapshot_module(snapshot, module)->sequence, 1, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    SnapshotValue *updated = snapshot_copy(snapshot, module, 0);
+    SnapshotValue *copy = snapshot_copy(snapshot, module, 1);
+    for (size_t i = 0; i < snapshot->pendingCount; i++) {
+        copy[snapshot->pending[i]] = updated[snapshot->pending[i]];
+    }
+    snapshot->pendingCount = 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Prints the latest measurements of a running energymeter from its shared-memory snapshot,
+ * as an example for other programs using snapshot_reader.h.
+ *
+ * Usage: energymeter-snapshot [-i <interval in ms>] [name]
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "snapshot_reader.h"
+
+#define DEFAULT_NAME "/energymeter"
+
+/**
+ * @brief Prints the values of all modules
+ */
+static void print_snapshot(const SnapshotReader *reader, SnapshotValue *values) {
+    struct timespec now;
+    clock_gettime(CLOCK_TAI, &now);
+    const uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+    for (size_t module = 0; module < snapshot_reader_module_count(reader); module++) {
+        snapshot_read_module(reader, module, values);
+        printf("Module %zu\n", module);
+        for (size_t i = 0; i < snapshot_reader_value_count(reader); i++) {
+            const SnapshotMeasurement *measurement = snapshot_reader_measurement(reader, i);
+            if (values[i].timestampNs == 0) {
+                printf("  %3u/%-3u            -\n", measurement->colID, measurement->metID);
+                continue;
+            }
+            double value = values[i].value;
+            for (unsigned e = 0; e < measurement->scaleExponent; e++) {
+                value /= 10;
+            }
+            printf("  %3u/%-3u %14.4f  (%.1f ms ago)\n", measurement->colID, measurement->metID, value,
+                   nowNs > values[i].timestampNs ? (nowNs - values[i].timestampNs) / 1e6 : 0.0);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long intervalMs = 0;
+    int option;
+    while ((option = getopt(argc, argv, "i:")) != -1) {
+        if (option == 'i') {
+            intervalMs = strtol(optarg, NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [-i <interval in ms>] [name]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    const char *name = optind < argc ? argv[optind] : DEFAULT_NAME;
+
+    SnapshotReader reader;
+    if (!snapshot_reader_open(&reader, name)) {
+        fprintf(stderr, "Failed to open the snapshot %s: %s\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    SnapshotValue *values = calloc(snapshot_reader_value_count(&reader), sizeof(SnapshotValue));
+    if (values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        snapshot_reader_close(&reader);
+        return EXIT_FAILURE;
+    }
+    do {
+        print_snapshot(&reader, values);
+        if (!snapshot_reader_alive(&reader)) {
+            fprintf(stderr, "The energymeter (pid %u) is no longer running\n", reader.header->writerPid);
+            break;
+        }
+        if (intervalMs > 0) {
+            struct timespec pause = { intervalMs / 1000, (intervalMs % 1000) * 1000000 };
+            nanosleep(&pause, NULL);
+        }
+    } while (intervalMs > 0);
+
+    free(values);
+    snapshot_reader_close(&reader);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+#ifndef SNAPSHOT_LAYOUT_H
+#define SNAPSHOT_LAYOUT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * The layout of the shared-memory snapshot of the latest measurements, shared by the writer
+ * in the energymeter (snapshot.h) and the reader library for other processes
+ * (snapshot_reader.h). Readers must not depend on anything else of this program.
+ *
+ * The segment starts with a SnapshotHeader, followed by a SnapshotMeasurement for each value
+ * of a module and a SnapshotModule for each module, at the offsets given in the header. Every
+ * SnapshotModule holds two copies of the latest values of the module, which the writer
+ * updates one after the other: while the sequence number is odd, it is updating copy 0 and
+ * readers take copy 1, while it is even the other way round. A reader therefore never waits
+ * for the writer, and only repeats a read if the sequence number changed meanwhile, which
+ * takes the writer about a full update.
+ */
+
+#define SNAPSHOT_MAGIC 0x50414E53   ///< Set last once the segment is ready
+#define SNAPSHOT_VERSION 1
+
+/**
+ * @brief The header at the start of the segment
+ */
+typedef struct SnapshotHeader {
+    atomic_uint magic;          ///< SNAPSHOT_MAGIC once the segment has been set up
+    uint32_t version;
+    uint32_t moduleCount;       ///< The number of power measurement modules
+    uint32_t valueCount;        ///< The number of measurements of each module
+    uint32_t measurementsOffset;///< The offset of the SnapshotMeasurements from the start of the segment
+    uint32_t modulesOffset;     ///< The offset of the first SnapshotModule
+    uint32_t moduleStride;      ///< The distance between two SnapshotModules
+    uint32_t writerPid;         ///< The process ID of the energymeter
+    atomic_uint running;        ///< Cleared when the energymeter exits, readers then open the segment again
+    uint32_t reserved;
+    uint64_t size;              ///< The size of the segment
+} SnapshotHeader;
+
+/**
+ * @brief Describes the values at one position of every module
+ *
+ * The measurement value is value / 10^scaleExponent in its unit, as with UnitDescription.
+ */
+typedef struct SnapshotMeasurement {
+    uint8_t colID;              ///< The collection of the measurement, see COL_ID in collection.h
+    uint8_t metID;              ///< The measurement ID within the collection, e.g. MET_ID_AC
+    uint8_t scaleExponent;
+    uint8_t isUnsigned;
+    int32_t scalingFactor;
+} SnapshotMeasurement;
+
+/**
+ * @brief The latest value of a measurement of a module
+ */
+typedef struct SnapshotValue {
+    int64_t value;              ///< The value from the process image, sign-extended
+    uint64_t timestampNs;       ///< When it was read, in CLOCK_TAI nanoseconds, 0 if it never was. A module
+                                ///< repeating an unchanged process image does not count as read again
+} SnapshotValue;
+
+/**
+ * @brief The values of a module, followed by two copies of valueCount SnapshotValues
+ */
+typedef struct SnapshotModule {
+    atomic_uint sequence;       ///< Incremented before each copy is updated
+    uint32_t reserved;
+} SnapshotModule;
+
+#endif
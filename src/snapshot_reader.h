@@ -0,0 +1,204 @@
+#ifndef SNAPSHOT_READER_H
+#define SNAPSHOT_READER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot_layout.h"
+
+#define SNAPSHOT_NOT_FOUND SIZE_MAX ///< Returned by snapshot_reader_find() for measurements not in the snapshot
+
+/**
+ * @brief Read access to the latest measurements of the energymeter for other processes
+ *
+ * Include this header and snapshot_layout.h, which do not depend on anything else of the
+ * energymeter, and link with -lrt on older C libraries. Reads never block the energymeter
+ * and never wait for it. The snapshot stays readable after the energymeter has exited, but
+ * is no longer updated; snapshot_reader_alive() tells when to open it again.
+ *
+ * Example, reading the RMS voltage L1-N of module 0:
+ * @code
+ * SnapshotReader reader;
+ * if (snapshot_reader_open(&reader, "/energymeter")) {
+ *     size_t index = snapshot_reader_find(&reader, 0, 4);
+ *     SnapshotValue value;
+ *     if (index != SNAPSHOT_NOT_FOUND && snapshot_read_value(&reader, 0, index, &value)
+ *         && value.timestampNs != 0) {
+ *         ... value.value / 10^snapshot_reader_measurement(&reader, index)->scaleExponent volts
+ *     }
+ *     snapshot_reader_close(&reader);
+ * }
+ * @endcode
+ */
+typedef struct SnapshotReader {
+    const uint8_t *map;
+    size_t size;
+    const SnapshotHeader *header;
+} SnapshotReader;
+
+/**
+ * @brief Opens the snapshot of a running energymeter
+ *
+ * @param[out] reader The reader to initialize
+ * @param[in] name The name of the snapshot, as set in the [snapshot] section of its configuration
+ * @retval true on success, false with errno set otherwise, e.g. to ENOENT if there is no
+ *         snapshot of that name or EAGAIN if it is still being set up
+ */
+bool snapshot_reader_open(SnapshotReader *reader, const char *name) {
+    memset(reader, 0, sizeof(SnapshotReader));
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return false;
+    }
+    if ((size_t)fileStat.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        errno = EAGAIN;
+        return false;
+    }
+    void *map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const SnapshotHeader *header = map;
+    // the magic is set last, after everything else of the header
+    if (atomic_load_explicit((atomic_uint *)&header->magic, memory_order_acquire) != SNAPSHOT_MAGIC
+        || header->version != SNAPSHOT_VERSION || header->size > (uint64_t)fileStat.st_size) {
+        munmap(map, fileStat.st_size);
+        errno = atomic_load((atomic_uint *)&header->magic) == SNAPSHOT_MAGIC ? EPROTO : EAGAIN;
+        return false;
+    }
+    reader->map = map;
+    reader->size = fileStat.st_size;
+    reader->header = header;
+    return true;
+}
+
+/**
+ * @brief Unmaps the snapshot
+ */
+void snapshot_reader_close(SnapshotReader *reader) {
+    if (reader->map != NULL) {
+        munmap((void *)reader->map, reader->size);
+        reader->map = NULL;
+    }
+}
+
+/**
+ * @brief Checks whether the energymeter is still updating the snapshot
+ *
+ * If not, it has exited, and the snapshot needs to be opened again once it is back.
+ */
+bool snapshot_reader_alive(const SnapshotReader *reader) {
+    return atomic_load_explicit((atomic_uint *)&reader->header->running, memory_order_acquire) != 0;
+}
+
+/**
+ * @brief Returns the number of modules in the snapshot
+ */
+size_t snapshot_reader_module_count(const SnapshotReader *reader) {
+    return reader->header->moduleCount;
+}
+
+/**
+ * @brief Returns the number of measurements of each module
+ */
+size_t snapshot_reader_value_count(const SnapshotReader *reader) {
+    return reader->header->valueCount;
+}
+
+/**
+ * @brief Returns the description of the measurement at a position
+ */
+const SnapshotMeasurement *snapshot_reader_measurement(const SnapshotReader *reader, size_t index) {
+    return (const SnapshotMeasurement *)(reader->map + reader->header->measurementsOffset) + index;
+}
+
+/**
+ * @brief Finds the position of a measurement
+ *
+ * @param[in] reader The reader
+ * @param[in] colID The collection of the measurement
+ * @param[in] metID The ID of the measurement within its collection
+ * @retval The position of the measurement, or SNAPSHOT_NOT_FOUND if it is not measured
+ */
+size_t snapshot_reader_find(const SnapshotReader *reader, uint8_t colID, uint8_t metID) {
+    for (size_t i = 0; i < reader->header->valueCount; i++) {
+        const SnapshotMeasurement *measurement = snapshot_reader_measurement(reader, i);
+        if (measurement->colID == colID && measurement->metID == metID) {
+            return i;
+        }
+    }
+    return SNAPSHOT_NOT_FOUND;
+}
+
+/**
+ * @brief Copies values of a module, all taken from the same update @see snapshot_layout.h
+ *
+ * @param[in] reader The reader
+ * @param[in] module The index of the module
+ * @param[in] first The position of the first value to copy
+ * @param[in] count The number of values to copy
+ * @param[out] values The buffer for the values
+ * @retval true on success, false if there is no such module or value
+ */
+bool snapshot_read_values(const SnapshotReader *reader, size_t module, size_t first, size_t count,
+                          SnapshotValue *values) {
+    const SnapshotHeader *header = reader->header;
+    if (module >= header->moduleCount || first > header->valueCount || count > header->valueCount - first) {
+        return false;
+    }
+    const uint8_t *base = reader->map + header->modulesOffset + module * header->moduleStride;
+    atomic_uint *sequence = &((SnapshotModule *)base)->sequence;
+    const SnapshotValue *copies = (const SnapshotValue *)(base + sizeof(SnapshotModule));
+
+    for (;;) {
+        const unsigned before = atomic_load_explicit(sequence, memory_order_acquire);
+        // copy 0 while the sequence is even, copy 1 while the writer updates copy 0
+        memcpy(values, copies + (before & 1) * header->valueCount + first, count * sizeof(SnapshotValue));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(sequence, memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Copies all values of a module, taken from the same update
+ *
+ * @param[in] reader The reader
+ * @param[in] module The index of the module
+ * @param[out] values A buffer for snapshot_reader_value_count() values
+ * @retval true on success, false if there is no such module
+ */
+bool snapshot_read_module(const SnapshotReader *reader, size_t module, SnapshotValue *values) {
+    return snapshot_read_values(reader, module, 0, reader->header->valueCount, values);
+}
+
+/**
+ * @brief Copies the latest value of a measurement of a module
+ *
+ * @param[in] reader The reader
+ * @param[in] module The index of the module
+ * @param[in] index The position of the measurement @see snapshot_reader_find
+ * @param[out] value The value, whose timestampNs is 0 if it has never been read
+ * @retval true on success, false if there is no such module or measurement
+ */
+bool snapshot_read_value(const SnapshotReader *reader, size_t module, size_t index, SnapshotValue *value) {
+    return snapshot_read_values(reader, module, index, 1, value);
+}
+
+#endif
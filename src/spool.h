@@ -0,0 +1,434 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cycle_stats.h"
+#include "utils.h"
+
+#define SPOOL_PATH_LENGTH 128           ///< Maximum length of the path of the ring file, including the terminator
+#define SPOOL_MAGIC 0x4C4F4F53          ///< Identifies the header of a ring file
+#define SPOOL_RECORD_MAGIC 0x43524C53   ///< Marks the start of every record
+#define SPOOL_VERSION 3                 ///< Earlier versions identified the topics differently
+#define SPOOL_HEADER_AREA 4096          ///< The header page in front of the data area
+#define SPOOL_HEADER_SLOT 2048          ///< Distance of the two header copies within the header page
+#define SPOOL_ALIGNMENT 8               ///< Records start at multiples of this
+
+/**
+ * @brief The settings of the store-and-forward buffer @see config_load
+ */
+typedef struct SpoolSettings {
+    char path[SPOOL_PATH_LENGTH];   ///< The ring file, empty to disable the buffer
+    size_t sizeKiB;                 ///< The size of the data area of the ring file
+    unsigned drainRate;             ///< Messages per second sent from the buffer after a reconnect, besides the current ones
+    unsigned syncIntervalMs;        ///< How often written records are flushed to the file
+} SpoolSettings;
+
+/**
+ * @brief The header of the ring file
+ *
+ * The file holds two copies of the header, which are written alternately, so one of them is
+ * always intact even if the power fails while writing the other. The valid copy with the
+ * highest generation is the current one. The positions are logical byte offsets counting up
+ * forever; the physical offset in the data area is the position modulo the capacity.
+ */
+typedef struct SpoolHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;      ///< The size of the data area in bytes
+    uint64_t generation;    ///< Incremented with every header written
+    uint64_t head;          ///< The position after the newest record
+    uint64_t tail;          ///< The position of the oldest record
+    uint64_t tailSequence;  ///< The sequence number of the oldest record
+    uint64_t headSequence;  ///< The sequence number of the next record
+    uint32_t reserved;
+    uint32_t crc;           ///< CRC-32 of all fields above
+} SpoolHeader;
+
+/**
+ * @brief The header of a record in the ring file, followed by the payload
+ */
+typedef struct SpoolRecord {
+    uint32_t magic;
+    uint32_t length;        ///< The length of the payload
+    uint64_t sequence;      ///< Consecutive over all records ever written
+    uint32_t topic;         ///< The key of the topic, which does not depend on the number of modules @see topic_key
+    uint32_t crc;           ///< CRC-32 of the fields above and the payload
+} SpoolRecord;
+
+/**
+ * @brief A store-and-forward buffer for MQTT messages on a memory-mapped ring file
+ *
+ * Messages which cannot be sent are appended to the ring, dropping the oldest ones when it is
+ * full, and sent oldest first once the connection is back. Records are written to the mapping
+ * and flushed in batches, first the data and then a header with the new positions. When the
+ * ring is full, this happens right before the oldest records are overwritten. After a power
+ * loss, the ring therefore holds exactly the records up to the last flush, which are found
+ * from the header alone. Records sent after the last flush are sent again, so every
+ * record is delivered at least once.
+ *
+ * The buffer is only used by the publisher thread.
+ */
+typedef struct Spool {
+    int fd;
+    uint8_t *map;               ///< The mapping of the whole file
+    uint8_t *data;              ///< The data area within the mapping
+    uint64_t capacity;
+    SpoolHeader state;          ///< The current positions, written to the file on every flush
+    bool dirty;                 ///< Whether state differs from the last header written
+    unsigned syncIntervalMs;
+    struct timespec lastSync;
+    uint8_t *scratch;           ///< The oldest record is copied here, as it may wrap around the end of the ring
+    size_t scratchSize;
+    uint64_t spooled;           ///< Number of records appended
+    uint64_t dropped;           ///< Number of records dropped because the ring was full or corrupt
+} Spool;
+
+/**
+ * @brief Computes the CRC-32 (IEEE 802.3) of a buffer
+ *
+ * @param[in] crc The CRC of the preceding data, 0 to start
+ * @param[in] buf The data
+ * @param[in] length The length of the data
+ * @retval The CRC including the data
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t length) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+    const uint8_t *bytes = buf;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Returns the space a record takes up in the ring, including its header and padding
+ */
+uint64_t spool_record_size(size_t length) {
+    return (sizeof(SpoolRecord) + length + SPOOL_ALIGNMENT - 1) & ~(uint64_t)(SPOOL_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Copies data into the ring at a logical position, wrapping around its end
+ */
+void spool_write_at(Spool *spool, uint64_t position, const void *src, size_t length) {
+    size_t offset = position % spool->capacity;
+    size_t first = length < spool->capacity - offset ? length : spool->capacity - offset;
+    memcpy(spool->data + offset, src, first);
+    memcpy(spool->data, (const uint8_t *)src + first, length - first);
+}
+
+/**
+ * @brief Copies data out of the ring from a logical position, wrapping around its end
+ */
+void spool_read_at(const Spool *spool, uint64_t position, void *dst, size_t length) {
+    size_t offset = position % spool->capacity;
+    size_t first = length < spool->capacity - offset ? length : spool->capacity - offset;
+    memcpy(dst, spool->data + offset, first);
+    memcpy((uint8_t *)dst + first, spool->data, length - first);
+}
+
+/**
+ * @brief Checks whether a header copy is intact and fits the ring
+ */
+bool spool_header_valid(const SpoolHeader *header, uint64_t capacity) {
+    return header->magic == SPOOL_MAGIC && header->version == SPOOL_VERSION && header->capacity == capacity
+           && header->crc == crc32_update(0, header, offsetof(SpoolHeader, crc))
+           && header->tail <= header->head && header->head - header->tail <= capacity
+           && header->tailSequence <= header->headSequence
+           && header->tail % SPOOL_ALIGNMENT == 0 && header->head % SPOOL_ALIGNMENT == 0;
+}
+
+/**
+ * @brief Writes the current positions to the older header copy and flushes it
+ */
+void spool_write_header(Spool *spool) {
+    spool->state.generation++;
+    spool->state.crc = crc32_update(0, &spool->state, offsetof(SpoolHeader, crc));
+    memcpy(spool->map + (spool->state.generation % 2) * SPOOL_HEADER_SLOT, &spool->state, sizeof(SpoolHeader));
+    msync(spool->map, SPOOL_HEADER_AREA, MS_SYNC);
+}
+
+/**
+ * @brief Flushes the records written and the current positions to the file
+ *
+ * The data is flushed before the header pointing to it, so a header never refers to records
+ * which have not reached the file yet. To limit the wear of the flash, this only happens once
+ * per sync interval unless forced.
+ *
+ * @param[inout] spool The buffer
+ * @param[in] force Whether to flush regardless of the sync interval
+ */
+void spool_sync(Spool *spool, bool force) {
+    struct timespec now;
+    if (!spool->dirty) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!force && elapsed_ns(&spool->lastSync, &now) / 1000000 < spool->syncIntervalMs) {
+        return;
+    }
+    msync(spool->data, spool->capacity, MS_SYNC);
+    spool_write_header(spool);
+    spool->dirty = false;
+    spool->lastSync = now;
+}
+
+/**
+ * @brief Opens the ring file, creating or resizing it as needed
+ *
+ * Records left over from before are kept if the file has the configured size and one of its
+ * header copies is intact, otherwise the ring starts out empty.
+ *
+ * @param[out] spool The buffer to open
+ * @param[in] settings The settings of the buffer
+ * @param[in] maxRecordLength The maximum length of a message
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode spool_open(Spool *spool, const SpoolSettings *settings, size_t maxRecordLength) {
+    memset(spool, 0, sizeof(Spool));
+    spool->fd = -1;
+    spool->capacity = (uint64_t)settings->sizeKiB * 1024;
+    spool->syncIntervalMs = settings->syncIntervalMs;
+    spool->scratchSize = maxRecordLength;
+    const off_t fileSize = SPOOL_HEADER_AREA + spool->capacity;
+
+    spool->fd = open(settings->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat fileStat;
+    if (spool->fd < 0 || fstat(spool->fd, &fileStat) != 0
+        || (fileStat.st_size != fileSize && ftruncate(spool->fd, fileSize) != 0)) {
+        dprintf(LOGLEVEL_ERR, "Failed to open the spool file %s: %s\n", settings->path, strerror(errno));
+        if (spool->fd >= 0) {
+            close(spool->fd);
+        }
+        return -ERROR_SPOOL_FAILED;
+    }
+    spool->map = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0);
+    spool->scratch = malloc(maxRecordLength);
+    if (spool->map == MAP_FAILED || spool->scratch == NULL) {
+        dprintf(LOGLEVEL_ERR, "Failed to map the spool file %s: %s\n", settings->path, strerror(errno));
+        if (spool->map != MAP_FAILED) {
+            munmap(spool->map, fileSize);
+        }
+        free(spool->scratch);
+        close(spool->fd);
+        return -ERROR_SPOOL_FAILED;
+    }
+    spool->data = spool->map + SPOOL_HEADER_AREA;
+
+    // recover from whichever header copy is intact and newer, nothing else needs to be read
+    const SpoolHeader *copies[2] = {
+        (const SpoolHeader *)spool->map, (const SpoolHeader *)(spool->map + SPOOL_HEADER_SLOT)
+    };
+    const SpoolHeader *current = NULL;
+    for (size_t i = 0; i < 2; i++) {
+        if (spool_header_valid(copies[i], spool->capacity)
+            && (current == NULL || copies[i]->generation > current->generation)) {
+            current = copies[i];
+        }
+    }
+    if (current != NULL) {
+        spool->state = *current;
+        dprintf(LOGLEVEL_INFO, "Spool file %s holds %llu bytes of messages\n", settings->path,
+                (unsigned long long)(current->head - current->tail));
+    } else {
+        spool->state = (SpoolHeader) {
+            .magic = SPOOL_MAGIC,
+            .version = SPOOL_VERSION,
+            .capacity = spool->capacity
+        };
+        spool_write_header(spool);
+        dprintf(LOGLEVEL_INFO, "Spool file %s initialized with %llu KiB\n", settings->path,
+                (unsigned long long)settings->sizeKiB);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &spool->lastSync);
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Flushes and closes the ring file
+ */
+void spool_close(Spool *spool) {
+    if (spool->fd < 0) {
+        return;
+    }
+    spool_sync(spool, true);
+    munmap(spool->map, SPOOL_HEADER_AREA + spool->capacity);
+    close(spool->fd);
+    free(spool->scratch);
+    spool->fd = -1;
+}
+
+/**
+ * @brief Checks whether the buffer is open
+ */
+bool spool_enabled(const Spool *spool) {
+    return spool->fd >= 0;
+}
+
+/**
+ * @brief Checks whether the buffer holds no messages
+ */
+bool spool_empty(const Spool *spool) {
+    return spool->state.head == spool->state.tail;
+}
+
+/**
+ * @brief Returns the number of messages in the buffer
+ */
+uint64_t spool_count(const Spool *spool) {
+    return spool->state.headSequence - spool->state.tailSequence;
+}
+
+/**
+ * @brief Discards all records, after the file has been found damaged
+ *
+ * As the records behind a damaged record header cannot be located anymore, none of them can
+ * be kept.
+ */
+void spool_discard(Spool *spool) {
+    dprintf(LOGLEVEL_ERR, "Spool file damaged, discarding %llu bytes of messages\n",
+            (unsigned long long)(spool->state.head - spool->state.tail));
+    spool->dropped += spool->state.headSequence - spool->state.tailSequence;
+    spool->state.tail = spool->state.head;
+    spool->state.tailSequence = spool->state.headSequence;
+    spool->dirty = true;
+}
+
+/**
+ * @brief Reads the header of the oldest record and checks whether it can be trusted
+ *
+ * @param[in] spool The buffer, which must not be empty
+ * @param[out] record The header of the oldest record
+ * @retval true if the record is in place and within the ring, false if the file is damaged
+ */
+bool spool_tail_record(const Spool *spool, SpoolRecord *record) {
+    spool_read_at(spool, spool->state.tail, record, sizeof(SpoolRecord));
+    return record->magic == SPOOL_RECORD_MAGIC && record->length <= spool->scratchSize
+           && spool_record_size(record->length) <= spool->state.head - spool->state.tail
+           && record->sequence == spool->state.tailSequence;
+}
+
+/**
+ * @brief Drops the oldest record, or all of them if it cannot be located
+ */
+void spool_drop_oldest(Spool *spool) {
+    SpoolRecord record;
+    if (!spool_tail_record(spool, &record)) {
+        // its length cannot be trusted, so the next record cannot be found
+        spool_discard(spool);
+        return;
+    }
+    spool->state.tail += spool_record_size(record.length);
+    spool->state.tailSequence++;
+    spool->dropped++;
+    spool->dirty = true;
+}
+
+/**
+ * @brief Appends a message to the buffer, dropping the oldest ones if it is full
+ *
+ * @param[inout] spool The buffer
+ * @param[in] topic The key of the topic of the message @see topic_key
+ * @param[in] payload The payload of the message
+ * @param[in] length The length of the payload
+ * @retval true if the message has been appended, false if it is too large
+ */
+bool spool_append(Spool *spool, uint32_t topic, const void *payload, size_t length) {
+    const uint64_t size = spool_record_size(length);
+    if (length > spool->scratchSize || size > spool->capacity) {
+        spool->dropped++;
+        return false;
+    }
+    if (spool->capacity - (spool->state.head - spool->state.tail) < size) {
+        while (spool->capacity - (spool->state.head - spool->state.tail) < size) {
+            spool_drop_oldest(spool);
+        }
+        // the file must no longer refer to the dropped records before they are overwritten
+        spool_sync(spool, true);
+    }
+    SpoolRecord record = {
+        .magic = SPOOL_RECORD_MAGIC,
+        .length = length,
+        .sequence = spool->state.headSequence,
+        .topic = topic
+    };
+    record.crc = crc32_update(crc32_update(0, &record, offsetof(SpoolRecord, crc)), payload, length);
+    spool_write_at(spool, spool->state.head, &record, sizeof(record));
+    spool_write_at(spool, spool->state.head + sizeof(record), payload, length);
+    spool->state.head += size;
+    spool->state.headSequence++;
+    spool->spooled++;
+    spool->dirty = true;
+    return true;
+}
+
+/**
+ * @brief Reads the oldest message without removing it
+ *
+ * A record which fails its checks means the file has been damaged. As the records behind it
+ * cannot be located anymore, the whole buffer is discarded then.
+ *
+ * @param[inout] spool The buffer
+ * @param[out] topic The key of the topic of the message
+ * @param[out] payload The payload, valid until the next call changing the buffer
+ * @param[out] length The length of the payload
+ * @retval true if there is a message, false if the buffer is empty
+ */
+bool spool_peek(Spool *spool, uint32_t *topic, const uint8_t **payload, size_t *length) {
+    while (!spool_empty(spool)) {
+        SpoolRecord record;
+        if (!spool_tail_record(spool, &record)) {
+            spool_discard(spool);
+            return false;
+        }
+        spool_read_at(spool, spool->state.tail + sizeof(record), spool->scratch, record.length);
+        if (record.crc == crc32_update(crc32_update(0, &record, offsetof(SpoolRecord, crc)), spool->scratch,
+                                       record.length)) {
+            *topic = record.topic;
+            *payload = spool->scratch;
+            *length = record.length;
+            return true;
+        }
+        // the record itself is in place, only its contents are damaged, so skip just this one
+        dprintf(LOGLEVEL_WARNING, "Spooled message %llu damaged, dropping it\n",
+                (unsigned long long)record.sequence);
+        spool_drop_oldest(spool);
+    }
+    return false;
+}
+
+/**
+ * @brief Removes the oldest message after it has been sent
+ */
+void spool_consume(Spool *spool) {
+    SpoolRecord record;
+    spool_read_at(spool, spool->state.tail, &record, sizeof(record));
+    spool->state.tail += spool_record_size(record.length);
+    spool->state.tailSequence++;
+    spool->dirty = true;
+}
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef TEXT_FORMAT_H
+#define TEXT_FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aggregation.h"
+#include "unit_description.h"
+
+/**
+ * @brief The available text representations of a ResultSet
+ */
+typedef enum TextFormat {
+    TEXT_FORMAT_PLAIN,  ///< Human-readable, one measurement per line
+    TEXT_FORMAT_JSON,   ///< A JSON object containing an array of measurements
+    TEXT_FORMAT_INFLUX  ///< A single line in InfluxDB line protocol
+} TextFormat;
+
+/// Upper bound for the length of a formatted number: sign, 10 integer digits, point and fraction
+#define TEXT_NUMBER_MAX_LENGTH (1 + 10 + 1 + 9)
+/// Upper bound for everything in a message which does not depend on the measurements
+#define TEXT_HEADER_MAX_LENGTH 96
+/// Upper bound for the formatting around a single measurement, without its strings and number
+#define TEXT_ENTRY_MAX_OVERHEAD 64
+/// Upper bound for the formatting around the statistics of an aggregated measurement, without its numbers
+#define TEXT_AGGREGATE_MAX_OVERHEAD 96
+
+/**
+ * @brief A writer appending to a fixed-size buffer
+ *
+ * Writing past the end of the buffer stops the writer and sets its overflow flag instead of
+ * silently producing a truncated message.
+ */
+typedef struct TextWriter {
+    char *buf;          ///< The output buffer
+    size_t capacity;    ///< The size of the output buffer
+    size_t length;      ///< The number of bytes written so far
+    bool overflow;      ///< Whether anything did not fit into the buffer
+} TextWriter;
+
+/**
+ * @brief Appends raw bytes to the writer
+ */
+void writer_append(TextWriter *writer, const char *data, size_t length) {
+    if (writer->overflow || length > writer->capacity - writer->length) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buf + writer->length, data, length);
+    writer->length += length;
+}
+
+/**
+ * @brief Appends a null-terminated string to the writer
+ */
+void writer_append_str(TextWriter *writer, const char *str) {
+    writer_append(writer, str, strlen(str));
+}
+
+/**
+ * @brief Appends a single character to the writer
+ */
+void writer_append_char(TextWriter *writer, char c) {
+    writer_append(writer, &c, 1);
+}
+
+/**
+ * @brief Appends an unsigned integer, zero-padded to a minimum number of digits
+ */
+void writer_append_uint(TextWriter *writer, uint64_t value, unsigned minDigits) {
+    char digits[20];
+    size_t pos = sizeof(digits);
+
+    // 64-bit divisions are a library call on 32-bit ARM, so avoid them where possible
+    if (value <= UINT32_MAX) {
+        uint32_t small = (uint32_t)value;
+        do {
+            digits[--pos] = '0' + small % 10;
+            small /= 10;
+        } while (small > 0);
+    } else {
+        do {
+            digits[--pos] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+    }
+    while (sizeof(digits) - pos < minDigits && pos > 0) {
+        digits[--pos] = '0';
+    }
+    writer_append(writer, digits + pos, sizeof(digits) - pos);
+}
+
+/**
+ * @brief Appends a raw value as a decimal number, e.g. 23012 with exponent 2 as "230.12"
+ *
+ * This is the only place where a raw value is turned into its actual value, and it does so
+ * by placing the decimal point instead of dividing, so the output is exact.
+ *
+ * @param[in] writer The writer to append to
+ * @param[in] raw The raw value @see result_value
+ * @param[in] exponent The scale exponent of the value, which is the number of decimal places
+ */
+void writer_append_scaled(TextWriter *writer, int64_t raw, unsigned exponent) {
+    if (exponent > SCALE_EXPONENT_MAX) {
+        exponent = SCALE_EXPONENT_MAX;
+    }
+    uint64_t magnitude = (uint64_t)raw;
+    if (raw < 0) {
+        writer_append_char(writer, '-');
+        magnitude = -magnitude;
+    }
+
+    uint64_t integer, fraction;
+    // raw values fit into 32 bits, and 64-bit divisions are a library call on 32-bit ARM
+    if (magnitude <= UINT32_MAX) {
+        integer = (uint32_t)magnitude / POWERS_OF_TEN[exponent];
+        fraction = (uint32_t)magnitude % POWERS_OF_TEN[exponent];
+    } else {
+        integer = magnitude / POWERS_OF_TEN[exponent];
+        fraction = magnitude % POWERS_OF_TEN[exponent];
+    }
+    writer_append_uint(writer, integer, 1);
+    if (exponent > 0) {
+        writer_append_char(writer, '.');
+        writer_append_uint(writer, fraction, exponent);
+    }
+}
+
+/**
+ * @brief Appends a string as the contents of a JSON string, escaping where necessary
+ */
+void writer_append_json_escaped(TextWriter *writer, const char *str) {
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            writer_append_char(writer, '\\');
+            writer_append_char(writer, *str);
+        } else if ((unsigned char)*str < 0x20) {
+            writer_append_char(writer, ' ');
+        } else {
+            writer_append_char(writer, *str);
+        }
+    }
+}
+
+/**
+ * @brief Appends a string as an InfluxDB field key, e.g. "RMS Voltage, L1-N" as "rms_voltage_l1_n"
+ */
+void writer_append_influx_key(TextWriter *writer, const char *str) {
+    bool started = false, separator = false;
+    for (; *str != '\0'; str++) {
+        char c = *str;
+        if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 'a';
+        } else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+            separator = started;
+            continue;
+        }
+        if (separator) {
+            writer_append_char(writer, '_');
+            separator = false;
+        }
+        writer_append_char(writer, c);
+        started = true;
+    }
+}
+
+/**
+ * @brief Computes an upper bound for the formatted length of a ResultSet with the given descriptions
+ *
+ * @param[in] descriptions The descriptions of the ResultSet
+ * @param[in] size The number of descriptions
+ * @retval The maximum length of a formatted ResultSet in any of the text formats
+ */
+size_t get_text_max_size(const UnitDescription **descriptions, size_t size) {
+    size_t length = TEXT_HEADER_MAX_LENGTH;
+    for (size_t i = 0; i < size; i++) {
+        // escaping may double the length of the description in JSON
+        length += 2 * strlen(descriptions[i]->description) + strlen(descriptions[i]->unit);
+        length += TEXT_NUMBER_MAX_LENGTH + TEXT_ENTRY_MAX_OVERHEAD;
+        if (descriptions[i]->aggregationWindowMs > 0) {
+            // InfluxDB repeats the key for the min, max, last and count fields
+            length += 4 * strlen(descriptions[i]->description);
+            length += 4 * TEXT_NUMBER_MAX_LENGTH + TEXT_AGGREGATE_MAX_OVERHEAD;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Formats a ResultSet as human-readable text
+ */
+void format_plain(TextWriter *writer, const ResultSet *results) {
+    writer_append_str(writer, "Module Index: ");
+    writer_append_uint(writer, results->moduleIndex, 1);
+    writer_append_str(writer, "\nTimestamp: ");
+    writer_append_uint(writer, results->timestamp.tv_sec, 1);
+    writer_append_char(writer, '.');
+    writer_append_uint(writer, results->timestamp.tv_nsec / 1000000, 3);
+    writer_append_char(writer, '\n');
+
+    for (size_t i = 0; i < results->size; i++) {
+        const UnitDescription *description = results->descriptions[i];
+        if (!result_included(results, i)) {
+            continue;
+        }
+        writer_append_str(writer, description->description);
+        writer_append_str(writer, ": ");
+        const unsigned exponent = description->scaleExponent;
+        writer_append_scaled(writer, result_value(results, i), exponent);
+        writer_append_char(writer, ' ');
+        writer_append_str(writer, description->unit);
+
+        const Aggregate *aggregate = result_aggregate(results, i);
+        if (aggregate != NULL) {
+            writer_append_str(writer, " (min ");
+            writer_append_scaled(writer, aggregate->min, exponent);
+            writer_append_str(writer, ", max ");
+            writer_append_scaled(writer, aggregate->max, exponent);
+            writer_append_str(writer, ", last ");
+            writer_append_scaled(writer, aggregate->last, exponent);
+            writer_append_str(writer, ", ");
+            writer_append_uint(writer, aggregate->count, 1);
+            writer_append_str(writer, " samples)");
+        }
+        writer_append_char(writer, '\n');
+    }
+}
+
+/**
+ * @brief Formats a ResultSet as a JSON object
+ *
+ * The result looks like {"module":0,"timestamp":1612345678.123,"values":[{"metID":4,
+ * "description":"RMS Voltage, L1-N","value":230.12,"unit":"V"},...]}. Aggregated values
+ * additionally have "min", "max", "last" and "count" members, and values from another
+ * collection than the AC measurement a "colID" member.
+ */
+void format_json(TextWriter *writer, const ResultSet *results) {
+    writer_append_str(writer, "{\"module\":");
+    writer_append_uint(writer, results->moduleIndex, 1);
+    writer_append_str(writer, ",\"timestamp\":");
+    writer_append_uint(writer, results->timestamp.tv_sec, 1);
+    writer_append_char(writer, '.');
+    writer_append_uint(writer, results->timestamp.tv_nsec / 1000000, 3);
+    writer_append_str(writer, ",\"values\":[");
+
+    bool first = true;
+    for (size_t i = 0; i < results->size; i++) {
+        const UnitDescription *description = results->descriptions[i];
+        if (!result_included(results, i)) {
+            continue;
+        }
+        if (!first) {
+            writer_append_char(writer, ',');
+        }
+        first = false;
+        writer_append_str(writer, "{\"metID\":");
+        writer_append_uint(writer, description->metID, 1);
+        if (description->colID != AC_MEASUREMENT) {
+            writer_append_str(writer, ",\"colID\":");
+            writer_append_uint(writer, description->colID, 1);
+        }
+        writer_append_str(writer, ",\"description\":\"");
+        writer_append_json_escaped(writer, description->description);
+        writer_append_str(writer, "\",\"value\":");
+        const unsigned exponent = description->scaleExponent;
+        writer_append_scaled(writer, result_value(results, i), exponent);
+
+        const Aggregate *aggregate = result_aggregate(results, i);
+        if (aggregate != NULL) {
+            writer_append_str(writer, ",\"min\":");
+            writer_append_scaled(writer, aggregate->min, exponent);
+            writer_append_str(writer, ",\"max\":");
+            writer_append_scaled(writer, aggregate->max, exponent);
+            writer_append_str(writer, ",\"last\":");
+            writer_append_scaled(writer, aggregate->last, exponent);
+            writer_append_str(writer, ",\"count\":");
+            writer_append_uint(writer, aggregate->count, 1);
+        }
+        writer_append_str(writer, ",\"unit\":\"");
+        writer_append_json_escaped(writer, description->unit);
+        writer_append_str(writer, "\"}");
+    }
+    writer_append_str(writer, "]}");
+}
+
+/**
+ * @brief Formats a ResultSet as a line in InfluxDB line protocol
+ *
+ * The result looks like "energymeter,module=0 rms_voltage_l1_n=230.12,... 1612345678123456789".
+ * Aggregated values additionally have fields with the suffixes _min, _max, _last and _count.
+ */
+void format_influx(TextWriter *writer, const ResultSet *results) {
+    writer_append_str(writer, "energymeter,module=");
+    writer_append_uint(writer, results->moduleIndex, 1);
+    writer_append_char(writer, ' ');
+
+    bool first = true;
+    for (size_t i = 0; i < results->size; i++) {
+        const UnitDescription *description = results->descriptions[i];
+        if (!result_included(results, i)) {
+            continue;
+        }
+        if (!first) {
+            writer_append_char(writer, ',');
+        }
+        first = false;
+        const unsigned exponent = description->scaleExponent;
+        writer_append_influx_key(writer, description->description);
+        writer_append_char(writer, '=');
+        writer_append_scaled(writer, result_value(results, i), exponent);
+
+        const Aggregate *aggregate = result_aggregate(results, i);
+        if (aggregate != NULL) {
+            writer_append_char(writer, ',');
+            writer_append_influx_key(writer, description->description);
+            writer_append_str(writer, "_min=");
+            writer_append_scaled(writer, aggregate->min, exponent);
+            writer_append_char(writer, ',');
+            writer_append_influx_key(writer, description->description);
+            writer_append_str(writer, "_max=");
+            writer_append_scaled(writer, aggregate->max, exponent);
+            writer_append_char(writer, ',');
+            writer_append_influx_key(writer, description->description);
+            writer_append_str(writer, "_last=");
+            writer_append_scaled(writer, aggregate->last, exponent);
+            writer_append_char(writer, ',');
+            writer_append_influx_key(writer, description->description);
+            writer_append_str(writer, "_count=");
+            writer_append_uint(writer, aggregate->count, 1);
+            writer_append_char(writer, 'i');
+        }
+    }
+
+    writer_append_char(writer, ' ');
+    writer_append_uint(writer, results->timestamp.tv_sec, 1);
+    writer_append_uint(writer, results->timestamp.tv_nsec, 9);
+    writer_append_char(writer, '\n');
+}
+
+/**
+ * @brief Formats a ResultSet in a single pass into a bounded buffer
+ *
+ * Only the values included according to result_included() are formatted.
+ *
+ * @param[in] results The completed ResultSet
+ * @param[in] format The text format to use
+ * @param[out] buf The output buffer, which is not null-terminated
+ * @param[in] capacity The size of the output buffer
+ * @param[out] length The length of the formatted text
+ * @retval true on success, false if the buffer was too small
+ */
+bool format_results(const ResultSet *results, TextFormat format, char *buf, size_t capacity, size_t *length) {
+    TextWriter writer = { .buf = buf, .capacity = capacity, .length = 0, .overflow = false };
+
+    switch (format) {
+        case TEXT_FORMAT_PLAIN:
+            format_plain(&writer, results);
+            break;
+        case TEXT_FORMAT_JSON:
+            format_json(&writer, results);
+            break;
+        case TEXT_FORMAT_INFLUX:
+            format_influx(&writer, results);
+            break;
+    }
+
+    *length = writer.length;
+    return !writer.overflow;
+}
+
+#endif
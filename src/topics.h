@@ -0,0 +1,248 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define TOPIC_NAME_LENGTH 160   ///< Room for the prefix and "/module/<index>/harmonics", including the terminator
+#define TOPIC_KEY_BATCH 0       ///< The key of the batch topic @see topic_key
+#define TOPIC_KEY_STATUS 1      ///< The key of the status topic
+#define TOPIC_KEY_MODULES 2     ///< The key of the first stream of the first module
+
+/**
+ * @brief The streams published for each power measurement module
+ */
+typedef enum TopicStream {
+    TOPIC_STREAM_AC,            ///< <prefix>/module/<index>/ac: the ResultSets
+    TOPIC_STREAM_HARMONICS,     ///< <prefix>/module/<index>/harmonics: the harmonic spectra
+    TOPIC_STREAM_COUNT
+} TopicStream;
+
+const char *TOPIC_STREAM_NAMES[TOPIC_STREAM_COUNT] = { "ac", "harmonics" };
+
+/**
+ * @brief A topic and its alias on the current connection
+ */
+typedef struct Topic {
+    char name[TOPIC_NAME_LENGTH];
+    size_t rank;            ///< The topic gets an alias if the broker allows more aliases than this
+    uint16_t alias;         ///< The alias assigned on the connection of generation, 0 for none
+    uint32_t generation;    ///< The connection the alias belongs to
+    bool announced;         ///< Whether a message carrying both the name and the alias has been delivered
+} Topic;
+
+/**
+ * @brief All topics published to, with the topic aliases of the current connection
+ *
+ * Every stream of every module has a topic of its own, followed by the batch topic for the
+ * ResultSets of all modules @see Batch and the status topic, so subscribers can pick the
+ * modules and streams they need at the broker. The topics are numbered in this order. As the
+ * numbers depend on the number of modules, the store-and-forward buffer refers to the topics
+ * by their keys instead, which stay the same across restarts @see topic_key
+ *
+ * The broker allows as many aliases as the Topic Alias Maximum in its CONNACK. They go to the
+ * topics published most often first: the batch topic if the ResultSets are batched, then the
+ * ResultSet topics of all modules, the harmonics topics and the status topic; any topics left
+ * over are always sent by name. A topic is sent with its name and its alias until the client
+ * has delivered one of these messages, and with the alias only from then on. Every
+ * connection starts over with a new generation, as the broker forgets all aliases when the
+ * connection ends.
+ *
+ * Topics are resolved by the publisher thread, while (re)connections and deliveries are
+ * reported on the thread of the MQTT client.
+ */
+typedef struct TopicTable {
+    Topic *topics;
+    size_t count;
+    size_t moduleCount;
+    pthread_mutex_t lock;
+    uint32_t generation;        ///< Incremented on every connection
+    uint16_t aliasMaximum;      ///< The Topic Alias Maximum of the broker, 0 if it does not accept aliases
+} TopicTable;
+
+/// The topics of the MQTT client, as its callbacks need to reset the aliases
+TopicTable topicTable;
+
+/**
+ * @brief Builds the topics of all modules below a prefix
+ *
+ * @param[out] table The table to initialize
+ * @param[in] prefix The prefix of all topics, without a trailing slash
+ * @param[in] moduleCount The number of power measurement modules
+ * @param[in] batching Whether the ResultSets are sent to the batch topic
+ * @retval ERROR_SUCCESS on success, another error code otherwise
+ */
+ErrorCode topic_table_init(TopicTable *table, const char *prefix, size_t moduleCount, bool batching) {
+    memset(table, 0, sizeof(TopicTable));
+    table->moduleCount = moduleCount;
+    table->count = moduleCount * TOPIC_STREAM_COUNT + 2;
+    table->topics = calloc(table->count, sizeof(Topic));
+    if (table->topics == NULL) {
+        dprintf(LOGLEVEL_ERR, "Memory allocation for the topics failed\n");
+        return -ERROR_ALLOCATION_FAILED;
+    }
+    if (pthread_mutex_init(&table->lock, NULL) != 0) {
+        free(table->topics);
+        table->topics = NULL;
+        return -ERROR_THREAD_CREATION_FAILED;
+    }
+    for (size_t module = 0; module < moduleCount; module++) {
+        for (size_t stream = 0; stream < TOPIC_STREAM_COUNT; stream++) {
+            Topic *topic = &table->topics[module * TOPIC_STREAM_COUNT + stream];
+            snprintf(topic->name, TOPIC_NAME_LENGTH, "%s/module/%zu/%s", prefix, module, TOPIC_STREAM_NAMES[stream]);
+            topic->rank = stream * moduleCount + module + batching;
+        }
+    }
+    Topic *batch = &table->topics[table->count - 2];
+    snprintf(batch->name, TOPIC_NAME_LENGTH, "%s/batch", prefix);
+    batch->rank = batching ? 0 : table->count - 2;
+    snprintf(table->topics[table->count - 1].name, TOPIC_NAME_LENGTH, "%s/status", prefix);
+    table->topics[table->count - 1].rank = table->count - 1;
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Releases the topics
+ */
+void topic_table_destroy(TopicTable *table) {
+    if (table->topics != NULL) {
+        pthread_mutex_destroy(&table->lock);
+        free(table->topics);
+        table->topics = NULL;
+    }
+}
+
+/**
+ * @brief Returns the number of a stream of a module
+ */
+size_t topic_index(const TopicTable *table, size_t module, TopicStream stream) {
+    return module * TOPIC_STREAM_COUNT + stream;
+}
+
+/**
+ * @brief Returns the number of the batch topic
+ */
+size_t topic_batch_index(const TopicTable *table) {
+    return table->count - 2;
+}
+
+/**
+ * @brief Returns the number of the status topic
+ */
+size_t topic_status_index(const TopicTable *table) {
+    return table->count - 1;
+}
+
+/**
+ * @brief Returns the key of a topic, which identifies its module and stream regardless of the
+ *        number of modules
+ *
+ * @param[in] table The topics
+ * @param[in] index The number of the topic
+ * @retval The key of the topic
+ */
+uint32_t topic_key(const TopicTable *table, size_t index) {
+    if (index == topic_batch_index(table)) {
+        return TOPIC_KEY_BATCH;
+    } else if (index == topic_status_index(table)) {
+        return TOPIC_KEY_STATUS;
+    }
+    return TOPIC_KEY_MODULES + index;
+}
+
+/**
+ * @brief Finds the topic of a key
+ *
+ * @param[in] table The topics
+ * @param[in] key The key of the topic @see topic_key
+ * @param[out] index The number of the topic
+ * @retval true if the topic exists, false if its module does not
+ */
+bool topic_from_key(const TopicTable *table, uint32_t key, size_t *index) {
+    if (key == TOPIC_KEY_BATCH) {
+        *index = topic_batch_index(table);
+    } else if (key == TOPIC_KEY_STATUS) {
+        *index = topic_status_index(table);
+    } else if (key - TOPIC_KEY_MODULES < table->moduleCount * TOPIC_STREAM_COUNT) {
+        *index = key - TOPIC_KEY_MODULES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Starts a new connection, forgetting all aliases of the previous one
+ *
+ * @param[in] table The topics
+ * @param[in] aliasMaximum The Topic Alias Maximum from the CONNACK, or a negative value to keep
+ *            the one of the previous connection
+ */
+void topic_table_connected(TopicTable *table, int aliasMaximum) {
+    pthread_mutex_lock(&table->lock);
+    table->generation++;
+    if (aliasMaximum >= 0) {
+        table->aliasMaximum = aliasMaximum > UINT16_MAX ? UINT16_MAX : aliasMaximum;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+/**
+ * @brief Decides how to address a message to a topic
+ *
+ * @param[in] table The topics
+ * @param[in] index The number of the topic
+ * @param[out] name The buffer for the topic name to send, empty if the alias stands for it
+ * @param[out] alias The alias to send, 0 for none
+ * @retval A tag to hand to topic_table_delivered() once the message has been delivered, or 0
+ *         if the delivery does not matter
+ */
+uint64_t topic_table_resolve(TopicTable *table, size_t index, char name[TOPIC_NAME_LENGTH], uint16_t *alias) {
+    Topic *topic = &table->topics[index];
+    uint64_t tag = 0;
+
+    pthread_mutex_lock(&table->lock);
+    if (topic->generation != table->generation) {
+        topic->generation = table->generation;
+        topic->alias = topic->rank < table->aliasMaximum ? topic->rank + 1 : 0;
+        topic->announced = false;
+    }
+    *alias = topic->alias;
+    if (topic->alias != 0 && topic->announced) {
+        name[0] = '\0';
+    } else {
+        memcpy(name, topic->name, TOPIC_NAME_LENGTH);
+        if (topic->alias != 0) {
+            tag = ((uint64_t)topic->generation << 32) | (index + 1);
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return tag;
+}
+
+/**
+ * @brief Takes note of a delivered message which announced an alias
+ *
+ * @param[in] table The topics
+ * @param[in] tag The tag returned by topic_table_resolve() for the message
+ */
+void topic_table_delivered(TopicTable *table, uint64_t tag) {
+    const size_t index = (uint32_t)tag - 1;
+    const uint32_t generation = tag >> 32;
+
+    pthread_mutex_lock(&table->lock);
+    if (index < table->count && generation == table->generation
+        && table->topics[index].generation == generation) {
+        table->topics[index].announced = true;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+#endif
@@ -3,24 +3,45 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "collection.h"
 #include "process_image.h"
 #include "utils.h"
 
+#define RESULT_SET_MAX_VALUES 160   ///< Maximum number of measurements per ResultSet, room for the AC values and three spectra
+#define SCALE_EXPONENT_MAX 9        ///< Maximum scale exponent of a measurement, 10^9 still fits into 32 bits
+/// The scaling factor of a scale exponent, usable in constant expressions unlike POWERS_OF_TEN
+#define SCALE_FACTOR(exponent)                                                                  \
+    ((exponent) == 0 ? 1 : (exponent) == 1 ? 10 : (exponent) == 2 ? 100 : (exponent) == 3 ? 1000  \
+     : (exponent) == 4 ? 10000 : (exponent) == 5 ? 100000 : (exponent) == 6 ? 1000000            \
+     : (exponent) == 7 ? 10000000 : (exponent) == 8 ? 100000000 : 1000000000)
+
+const uint32_t POWERS_OF_TEN[SCALE_EXPONENT_MAX + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
 /**
  * @brief A struct containing all necessary information for querying a
  *        measurement value
  */
 typedef struct UnitDescription {
     // this needs to somehow change if we ever want to use a different table
-    const MET_ID_AC metID;     ///< The measurement ID as it appears in the process image @see MET_ID_AC
-    const char *unit;          ///< The unit of this measurement value
-    const char *description;   ///< A verbose description of this measurement value
-    const int scalingFactor;   ///< The factor by which the value in the process image has been scaled up
-    const bool isUnsigned;     ///< Whether the value in the process image is unsigned
+    const uint8_t colID;                ///< The collection of the measurement @see COL_ID
+    const uint8_t metID;                ///< The measurement ID within its collection, e.g. @see MET_ID_AC
+    const char *unit;                   ///< The unit of this measurement value
+    const char *description;            ///< A verbose description of this measurement value
+    const unsigned scaleExponent;       ///< The value in the process image is scaled up by 10^scaleExponent
+    const int scalingFactor;            ///< The factor by which the value in the process image has been scaled up
+    const bool isUnsigned;              ///< Whether the value in the process image is unsigned
+    const double absoluteDeadband;      ///< The change in units below which a value is not reported again
+    const double relativeDeadband;      ///< The same relative to the last reported value, e.g. 0.01 for 1%
+    const unsigned aggregationWindowMs; ///< The length of the window to aggregate the values over (0: none)
+    const unsigned samplePeriodMs;      ///< How often the value needs to be sampled (0: as often as possible)
 } UnitDescription;
 
 /**
@@ -30,13 +51,58 @@ typedef struct ResultSet {
     const UnitDescription **descriptions;   ///< The list of UnitDescription instances belonging to the result values @see UnitDescription
     const size_t size;                      ///< The size of the descriptions and values field
     const size_t moduleIndex;               ///< Index of the power measurement module on the bus for this set
-    double *values;                         ///< Result values at the same positions as descriptions, must be the same length
+    uint32_t *values;                       ///< Raw result values at the same positions as descriptions, must be the same
+                                            ///< length. Signed values are stored as their bits @see result_value
     struct timespec timestamp;              ///< The timestamp when the set was completed
-    bool *validity;                         ///< Used to determine whether a certain value has already been filled
-    size_t currentCount;                    ///< Number of valid entries to know whether the set is finshed
+    bool *validity;                         ///< Used to determine whether a certain value has already been filled,
+                                            ///< when publishing whether it is included (NULL: all values are)
+    const struct Aggregate *aggregates;     ///< Statistics over the aggregation window of each value, the values
+                                            ///< hold their means (NULL if the values were not aggregated)
+    size_t currentCount;                    ///< Number of valid entries
+    size_t requiredCount;                   ///< Number of valid entries required to finish the set @see MeasurementSchedule
 } ResultSet;
 
 
+/**
+ * @brief Interprets a raw value from the process image according to the signedness of its measurement
+ */
+int64_t raw_value(const UnitDescription *unit, uint32_t raw) {
+    // both conversions are cheap, selecting one of them compiles to a conditional move
+    return unit->isUnsigned ? (int64_t)raw : (int64_t)(int32_t)raw;
+}
+
+/**
+ * @brief Returns a value of a ResultSet as the scaled integer from the process image
+ *
+ * The measurement value is the result divided by 10^scaleExponent of its UnitDescription.
+ */
+int64_t result_value(const ResultSet *results, size_t index) {
+    return raw_value(results->descriptions[index], results->values[index]);
+}
+
+/**
+ * @brief Converts a raw value to a different scale exponent, rounding half away from zero
+ *
+ * @param[in] raw The raw value
+ * @param[in] exponent The scale exponent of the raw value
+ * @param[in] targetExponent The scale exponent to convert to
+ * @retval The value scaled up by 10^targetExponent
+ */
+int64_t rescale_raw_value(int64_t raw, unsigned exponent, unsigned targetExponent) {
+    if (targetExponent >= exponent) {
+        return raw * POWERS_OF_TEN[targetExponent - exponent];
+    }
+    const int64_t divisor = POWERS_OF_TEN[exponent - targetExponent];
+    return (raw + (raw < 0 ? -divisor / 2 : divisor / 2)) / divisor;
+}
+
+/**
+ * @brief Checks whether a value of a ResultSet is to be included when publishing it
+ */
+bool result_included(const ResultSet *results, size_t index) {
+    return results->validity == NULL || results->validity[index];
+}
+
 /**
  * @brief Allocates a list of multiple ResultSets
  *
@@ -56,9 +122,10 @@ ResultSet *allocate_results(const UnitDescription **descriptions, const size_t d
         result[i].descriptions = descriptions;
         *(size_t*)&result[i].size = descSize;
         *(size_t*)&result[i].moduleIndex = i;
-        result[i].values = calloc(sizeof(double), descSize);
+        result[i].values = calloc(sizeof(uint32_t), descSize);
         result[i].validity = calloc(sizeof(bool), descSize);
         result[i].currentCount = 0;
+        result[i].requiredCount = 0;
 
         if (result[i].values == NULL || result[i].validity == NULL) {
             // strictly speaking we would have to clean up all the allocated memory here,
@@ -71,178 +138,303 @@ ResultSet *allocate_results(const UnitDescription **descriptions, const size_t d
 }
 
 /**
- * @brief Reads and converts a measurement value according to its unit description.
+ * @brief Reads a raw measurement value from the process image.
+ *
+ * The value is kept as it is, scaled up and signed or unsigned as described by its
+ * UnitDescription, so reading it needs no floating point operations at all.
  *
- * @param[in] unit A pointer to the unit description
  * @param[in] buf The buffer from the process output image containing the value to be read
  *
- * @retval The converted and correctly scaled measurement value in double precision
- */
-double read_measurement_value(const UnitDescription *unit, uint8_t *buf) {
-    double result;
-    if (unit->isUnsigned) {
-        result = (double) read_uint32(buf);
-    } else {
-        result = (double) read_int32(buf);
-    }
-    return result / unit->scalingFactor;
+ * @retval The raw measurement value @see raw_value
+ */
+uint32_t read_measurement_value(uint8_t *buf) {
+    return read_uint32(buf);
 }
 
+#define MEASUREMENT_SLOT_NONE 0xFF    ///< Marks measurement IDs which are not part of a list
+
 /**
- * @brief Finds the UnitDescription with a given MET_ID in a provided list.
- *        Useful for correctly interpreting the process values from a given process input.
+ * @brief Maps every possible measurement of each collection to its position in a list of UnitDescriptions
  *
- * @param[in] list An Array of pointers to avalable UnitDescription instances
- * @param[in] listSize The size of the provided array
- * @param[in] id The measurement ID from the process input to search for
- * @param[out] index The list index of the found description (can be NULL if not desired)
+ * Measurement IDs are a single byte in the process image, so the lookup is a single array
+ * access without any comparisons.
+ */
+typedef struct MeasurementIndex {
+    uint8_t slots[COLLECTION_COUNT + 1][256];   ///< The list index of each measurement, or MEASUREMENT_SLOT_NONE,
+                                                ///< the last row stands for all unknown collections
+} MeasurementIndex;
+
+/**
+ * @brief Builds the index of a list of UnitDescriptions
  *
- * @retval A pointer to the corresponding UnitDescription if found, NULL otherwise
+ * @param[out] index The index to build
+ * @param[in] list An array of pointers to the UnitDescription instances
+ * @param[in] listSize The size of the provided array, at most RESULT_SET_MAX_VALUES
  */
-UnitDescription *find_description_with_id(const UnitDescription **list, size_t listSize, int id, size_t *index) {
-    if (list == NULL || listSize == 0 || id == 0) {
-        return NULL;
-    }
-    for (size_t i = 0; i < listSize; i++) {
-        if (list[i]->metID == id) {
-            if (index != NULL) {
-                *index = i;
-            }
-            return (UnitDescription *)list[i];
+void measurement_index_init(MeasurementIndex *index, const UnitDescription **list, size_t listSize) {
+    memset(index->slots, MEASUREMENT_SLOT_NONE, sizeof(index->slots));
+    // iterate backwards, so the first occurrence of a duplicate ID wins
+    for (size_t i = listSize; i-- > 0;) {
+        size_t collection = collection_slot(list[i]->colID);
+        if (collection < COLLECTION_COUNT) {
+            index->slots[collection][list[i]->metID] = i;
         }
     }
-    return NULL;
+    // 0 means that no measurement has been requested
+    for (size_t collection = 0; collection < COLLECTION_COUNT; collection++) {
+        index->slots[collection][0] = MEASUREMENT_SLOT_NONE;
+    }
 }
 
-/*
- * Some commonly used measurements are defined here for convenience.
- */
-UnitDescription RMSVoltageL1N = {
-    .metID = VOLTAGE_RMS_L1N,
-    .unit = "V",
-    .description = "RMS Voltage, L1-N",
-    .scalingFactor = 100,
-    .isUnsigned = true
-};
-
-UnitDescription RMSVoltageL2N = {
-    .metID = VOLTAGE_RMS_L2N,
-    .unit = "V",
-    .description = "RMS Voltage, L2-N",
-    .scalingFactor = 100,
-    .isUnsigned = true
-};
-
-UnitDescription RMSVoltageL3N = {
-    .metID = VOLTAGE_RMS_L3N,
-    .unit = "V",
-    .description = "RMS Voltage, L3-N",
-    .scalingFactor = 100,
-    .isUnsigned = true
-};
-
-UnitDescription RMSCurrentL1 = {
-    .metID = CURRENT_RMS_L1,
-    .unit = "A",
-    .description = "RMS current, L1",
-    .scalingFactor = 10000,
-    .isUnsigned = true
-};
-
-UnitDescription RMSCurrentL2 = {
-    .metID = CURRENT_RMS_L2,
-    .unit = "A",
-    .description = "RMS current, L2",
-    .scalingFactor = 10000,
-    .isUnsigned = true
-};
+/**
+ * @brief Finds the position of a measurement from the process input in the indexed list.
+ *
+ * @param[in] index The index of the list
+ * @param[in] colID The collection ID from the process input
+ * @param[in] id The measurement ID from the process input to search for
+ * @retval The list index of the measurement, or MEASUREMENT_SLOT_NONE if it is not in the list
+ */
+size_t measurement_index_find(const MeasurementIndex *index, uint8_t colID, uint8_t id) {
+    return index->slots[collection_slot(colID)][id];
+}
 
-UnitDescription RMSCurrentL3 = {
-    .metID = CURRENT_RMS_L3,
-    .unit = "A",
-    .description = "RMS current, L3",
-    .scalingFactor = 10000,
-    .isUnsigned = true
-};
+/**
+ * @brief The catalogue of all measurements of the AC measurement collection
+ *
+ * Each entry lists the variable name of its UnitDescription, the measurement ID @see MET_ID_AC,
+ * the unit, a description, the scale exponent, whether the value is unsigned, the absolute and
+ * relative deadband, the aggregation window and the sample period in milliseconds, in the order of
+ * UnitDescription. Energy counters change slowly, so they are only sampled every 30 s and not
+ * aggregated. The UnitDescriptions and the ID lookup table below are generated from this list.
+ */
+#define MEASUREMENT_CATALOGUE(X) \
+    X(RMSVoltageL1N,                 VOLTAGE_RMS_L1N,                  "V",   "RMS Voltage, L1-N",                 2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageL2N,                 VOLTAGE_RMS_L2N,                  "V",   "RMS Voltage, L2-N",                 2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageL3N,                 VOLTAGE_RMS_L3N,                  "V",   "RMS Voltage, L3-N",                 2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMaxL1N,              VOLTAGE_RMS_MAX_L1N,              "V",   "Maximum RMS Voltage, L1-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMaxL2N,              VOLTAGE_RMS_MAX_L2N,              "V",   "Maximum RMS Voltage, L2-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMaxL3N,              VOLTAGE_RMS_MAX_L3N,              "V",   "Maximum RMS Voltage, L3-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMinL1N,              VOLTAGE_RMS_MIN_L1N,              "V",   "Minimum RMS Voltage, L1-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMinL2N,              VOLTAGE_RMS_MIN_L2N,              "V",   "Minimum RMS Voltage, L2-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageMinL3N,              VOLTAGE_RMS_MIN_L3N,              "V",   "Minimum RMS Voltage, L3-N",         2,     true,  0.5,  0,    1000, 0)     \
+    X(RMSVoltageL1L2,                VOLTAGE_RMS_L1L2,                 "V",   "RMS Voltage, L1-L2",                2,     true,  1,    0,    1000, 0)     \
+    X(RMSVoltageL1L3,                VOLTAGE_RMS_L1L3,                 "V",   "RMS Voltage, L1-L3",                2,     true,  1,    0,    1000, 0)     \
+    X(RMSVoltageL2L3,                VOLTAGE_RMS_L2L2,                 "V",   "RMS Voltage, L2-L3",                2,     true,  1,    0,    1000, 0)     \
+    X(MeanVoltageL1N,                VOLTAGE_MEAN_L1N,                 "V",   "Mean Voltage, L1-N",                2,     true,  0.5,  0,    1000, 0)     \
+    X(MeanVoltageL2N,                VOLTAGE_MEAN_L2N,                 "V",   "Mean Voltage, L2-N",                2,     true,  0.5,  0,    1000, 0)     \
+    X(MeanVoltageL3N,                VOLTAGE_MEAN_L3N,                 "V",   "Mean Voltage, L3-N",                2,     true,  0.5,  0,    1000, 0)     \
+    X(PeakVoltageL1N,                VOLTAGE_PEAK_L1N,                 "V",   "Peak Voltage, L1-N",                2,     true,  1,    0,    1000, 0)     \
+    X(PeakVoltageL2N,                VOLTAGE_PEAK_L2N,                 "V",   "Peak Voltage, L2-N",                2,     true,  1,    0,    1000, 0)     \
+    X(PeakVoltageL3N,                VOLTAGE_PEAK_L3N,                 "V",   "Peak Voltage, L3-N",                2,     true,  1,    0,    1000, 0)     \
+    X(RMSCurrentL1,                  CURRENT_RMS_L1,                   "A",   "RMS current, L1",                   4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentL2,                  CURRENT_RMS_L2,                   "A",   "RMS current, L2",                   4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentL3,                  CURRENT_RMS_L3,                   "A",   "RMS current, L3",                   4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMaxL1,               CURRENT_RMS_MAX_L1,               "A",   "Maximum RMS current, L1",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMaxL2,               CURRENT_RMS_MAX_L2,               "A",   "Maximum RMS current, L2",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMaxL3,               CURRENT_RMS_MAX_L3,               "A",   "Maximum RMS current, L3",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMinL1,               CURRENT_RMS_MIN_L1,               "A",   "Minimum RMS current, L1",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMinL2,               CURRENT_RMS_MIN_L2,               "A",   "Minimum RMS current, L2",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentMinL3,               CURRENT_RMS_MIN_L3,               "A",   "Minimum RMS current, L3",           4,     true,  0.01, 0.02, 1000, 0)     \
+    X(MeanCurrentL1,                 CURRENT_MEAN_L1,                  "A",   "Mean current, L1",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(MeanCurrentL2,                 CURRENT_MEAN_L2,                  "A",   "Mean current, L2",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(MeanCurrentL3,                 CURRENT_MEAN_L3,                  "A",   "Mean current, L3",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(PeakCurrentL1,                 CURRENT_PEAK_L1,                  "A",   "Peak current, L1",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(PeakCurrentL2,                 CURRENT_PEAK_L2,                  "A",   "Peak current, L2",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(PeakCurrentL3,                 CURRENT_PEAK_L3,                  "A",   "Peak current, L3",                  4,     true,  0.01, 0.02, 1000, 0)     \
+    X(RMSCurrentN,                   CURRENT_RMS_N,                    "A",   "RMS current, N",                    4,     true,  0.01, 0.02, 1000, 0)     \
+    X(EffectivePowerL1,              POWER_EFFECTIVE_L1,               "W",   "Effective Power, L1",               2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerL2,              POWER_EFFECTIVE_L2,               "W",   "Effective Power, L2",               2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerL3,              POWER_EFFECTIVE_L3,               "W",   "Effective Power, L3",               2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMaxL1,           POWER_EFFECTIVE_MAX_L1,           "W",   "Maximum Effective Power, L1",       2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMaxL2,           POWER_EFFECTIVE_MAX_L2,           "W",   "Maximum Effective Power, L2",       2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMaxL3,           POWER_EFFECTIVE_MAX_L3,           "W",   "Maximum Effective Power, L3",       2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMinL1,           POWER_EFFECTIVE_MIN_L1,           "W",   "Minimum Effective Power, L1",       2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMinL2,           POWER_EFFECTIVE_MIN_L2,           "W",   "Minimum Effective Power, L2",       2,     false, 5,    0.02, 1000, 0)     \
+    X(EffectivePowerMinL3,           POWER_EFFECTIVE_MIN_L3,           "W",   "Minimum Effective Power, L3",       2,     false, 5,    0.02, 1000, 0)     \
+    X(ReactivePowerN1,               POWER_REACTIVE_L1,                "VAR", "Reactive Power, L1",                2,     false, 5,    0.02, 1000, 0)     \
+    X(ReactivePowerN2,               POWER_REACTIVE_L2,                "VAR", "Reactive Power, L2",                2,     false, 5,    0.02, 1000, 0)     \
+    X(ReactivePowerN3,               POWER_REACTIVE_L3,                "VAR", "Reactive Power, L3",                2,     false, 5,    0.02, 1000, 0)     \
+    X(ApparentPowerL1,               POWER_APPARENT_L1,                "VA",  "Apparent Power, L1",                2,     true,  5,    0.02, 1000, 0)     \
+    X(ApparentPowerL2,               POWER_APPARENT_L2,                "VA",  "Apparent Power, L2",                2,     true,  5,    0.02, 1000, 0)     \
+    X(ApparentPowerL3,               POWER_APPARENT_L3,                "VA",  "Apparent Power, L3",                2,     true,  5,    0.02, 1000, 0)     \
+    X(ActiveEnergyL1,                ENERGY_ACTIVE_L1,                 "Wh",  "Active Energy, L1",                 1,     false, 10,   0,    0,    30000) \
+    X(ActiveEnergyL2,                ENERGY_ACTIVE_L2,                 "Wh",  "Active Energy, L2",                 1,     false, 10,   0,    0,    30000) \
+    X(ActiveEnergyL3,                ENERGY_ACTIVE_L3,                 "Wh",  "Active Energy, L3",                 1,     false, 10,   0,    0,    30000) \
+    X(ActiveEnergyImportL1,          ENERGY_ACTIVE_IMPORT_L1,          "Wh",  "Imported Active Energy, L1",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyImportL2,          ENERGY_ACTIVE_IMPORT_L2,          "Wh",  "Imported Active Energy, L2",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyImportL3,          ENERGY_ACTIVE_IMPORT_L3,          "Wh",  "Imported Active Energy, L3",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyExportL1,          ENERGY_ACTIVE_EXPORT_L1,          "Wh",  "Exported Active Energy, L1",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyExportL2,          ENERGY_ACTIVE_EXPORT_L2,          "Wh",  "Exported Active Energy, L2",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyExportL3,          ENERGY_ACTIVE_EXPORT_L3,          "Wh",  "Exported Active Energy, L3",        1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyTotal,             ENERGY_ACTIVE_TOTAL,              "Wh",  "Active Energy, Total",              1,     false, 10,   0,    0,    30000) \
+    X(ActiveEnergyImportTotal,       ENERGY_ACTIVE_IMPORT_TOTAL,       "Wh",  "Imported Active Energy, Total",     1,     true,  10,   0,    0,    30000) \
+    X(ActiveEnergyExportTotal,       ENERGY_ACTIVE_EXPORT_TOTAL,       "Wh",  "Exported Active Energy, Total",     1,     true,  10,   0,    0,    30000) \
+    X(ReactiveEnergyL1,              ENERGY_REACTIVE_L1,               "VARh","Reactive Energy, L1",               1,     false, 10,   0,    0,    30000) \
+    X(ReactiveEnergyL2,              ENERGY_REACTIVE_L2,               "VARh","Reactive Energy, L2",               1,     false, 10,   0,    0,    30000) \
+    X(ReactiveEnergyL3,              ENERGY_REACTIVE_L3,               "VARh","Reactive Energy, L3",               1,     false, 10,   0,    0,    30000) \
+    X(InductiveReactiveEnergyL1,     ENERGY_REACTIVE_INDUCTIVE_L1,     "VARh","Inductive Reactive Energy, L1",     1,     true,  10,   0,    0,    30000) \
+    X(InductiveReactiveEnergyL2,     ENERGY_REACTIVE_INDUCTIVE_L2,     "VARh","Inductive Reactive Energy, L2",     1,     true,  10,   0,    0,    30000) \
+    X(InductiveReactiveEnergyL3,     ENERGY_REACTIVE_INDUCTIVE_L3,     "VARh","Inductive Reactive Energy, L3",     1,     true,  10,   0,    0,    30000) \
+    X(CapacitiveReactiveEnergyL1,    ENERGY_REACTIVE_CAPACITIVE_L1,    "VARh","Capacitive Reactive Energy, L1",    1,     true,  10,   0,    0,    30000) \
+    X(CapacitiveReactiveEnergyL2,    ENERGY_REACTIVE_CAPACITIVE_L2,    "VARh","Capacitive Reactive Energy, L2",    1,     true,  10,   0,    0,    30000) \
+    X(CapacitiveReactiveEnergyL3,    ENERGY_REACTIVE_CAPACITIVE_L3,    "VARh","Capacitive Reactive Energy, L3",    1,     true,  10,   0,    0,    30000) \
+    X(ReactiveEnergyTotal,           ENERGY_REACTIVE_TOTAL,            "VARh","Reactive Energy, Total",            1,     false, 10,   0,    0,    30000) \
+    X(InductiveReactiveEnergyTotal,  ENERGY_REACTIVE_TOTAL_INDUCTIVE,  "VARh","Inductive Reactive Energy, Total",  1,     true,  10,   0,    0,    30000) \
+    X(CapacitiveReactiveEnergyTotal, ENERGY_REACTIVE_TOTAL_CAPACITIVE, "VARh","Capacitive Reactive Energy, Total", 1,     true,  10,   0,    0,    30000) \
+    X(ApparentEnergyL1,              ENERGY_APPARENT_L1,               "VAh", "Apparent Energy, L1",               1,     true,  10,   0,    0,    30000) \
+    X(ApparentEnergyL2,              ENERGY_APPARENT_L2,               "VAh", "Apparent Energy, L2",               1,     true,  10,   0,    0,    30000) \
+    X(ApparentEnergyL3,              ENERGY_APPARENT_L3,               "VAh", "Apparent Energy, L3",               1,     true,  10,   0,    0,    30000) \
+    X(LineFrequencyL1,               LINE_FREQUENCY_L1,                "Hz",  "Line Frequency, L1",                2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyL2,               LINE_FREQUENCY_L2,                "Hz",  "Line Frequency, L2",                2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyL3,               LINE_FREQUENCY_L3,                "Hz",  "Line Frequency, L3",                2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMaxL1,            LINE_FREQUENCY_MAX_L1,            "Hz",  "Maximum Line Frequency, L1",        2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMaxL2,            LINE_FREQUENCY_MAX_L2,            "Hz",  "Maximum Line Frequency, L2",        2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMaxL3,            LINE_FREQUENCY_MAX_L3,            "Hz",  "Maximum Line Frequency, L3",        2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMinL1,            LINE_FREQUENCY_MIN_L1,            "Hz",  "Minimum Line Frequency, L1",        2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMinL2,            LINE_FREQUENCY_MIN_L2,            "Hz",  "Minimum Line Frequency, L2",        2,     true,  0.01, 0,    1000, 0)     \
+    X(LineFrequencyMinL3,            LINE_FREQUENCY_MIN_L3,            "Hz",  "Minimum Line Frequency, L3",        2,     true,  0.01, 0,    1000, 0)     \
+    X(PhaseAngleL1,                  PHASE_ANGLE_PHI_L1,               "deg", "Phase Angle, L1",                   2,     false, 1,    0,    1000, 0)     \
+    X(PhaseAngleL2,                  PHASE_ANGLE_PHI_L2,               "deg", "Phase Angle, L2",                   2,     false, 1,    0,    1000, 0)     \
+    X(PhaseAngleL3,                  PHASE_ANGLE_PHI_L3,               "deg", "Phase Angle, L3",                   2,     false, 1,    0,    1000, 0)     \
+    X(CosPhiL1,                      COS_PHI_L1,                       "",    "Cos Phi, L1",                       3,     false, 0.01, 0,    1000, 0)     \
+    X(CosPhiL2,                      COS_PHI_L2,                       "",    "Cos Phi, L2",                       3,     false, 0.01, 0,    1000, 0)     \
+    X(CosPhiL3,                      COS_PHI_L3,                       "",    "Cos Phi, L3",                       3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorPFL1,               POWER_FACTOR_PF_L1,               "",    "Power Factor (PF), L1",             3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorPFL2,               POWER_FACTOR_PF_L2,               "",    "Power Factor (PF), L2",             3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorPFL3,               POWER_FACTOR_PF_L3,               "",    "Power Factor (PF), L3",             3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorLFL1,               POWER_FACTOR_LF_L1,               "",    "Power Factor (LF), L1",             3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorLFL2,               POWER_FACTOR_LF_L2,               "",    "Power Factor (LF), L2",             3,     false, 0.01, 0,    1000, 0)     \
+    X(PowerFactorLFL3,               POWER_FACTOR_LF_L3,               "",    "Power Factor (LF), L3",             3,     false, 0.01, 0,    1000, 0)
 
-UnitDescription RMSCurrentN = {
-    .metID = CURRENT_RMS_N,
-    .unit = "A",
-    .description = "RMS current, N",
-    .scalingFactor = 10000,
-    .isUnsigned = true
-};
+#define DEFINE_UNIT_DESCRIPTION(name, id, unitName, text, exponent, isUnsignedValue, absolute, relative, window, \
+                                period)                                 \
+    UnitDescription name = {                    \
+        .colID = AC_MEASUREMENT,                \
+        .metID = id,                            \
+        .unit = unitName,                       \
+        .description = text,                    \
+        .scaleExponent = exponent,              \
+        .scalingFactor = SCALE_FACTOR(exponent),\
+        .isUnsigned = isUnsignedValue,          \
+        .absoluteDeadband = absolute,           \
+        .relativeDeadband = relative,           \
+        .aggregationWindowMs = window,          \
+        .samplePeriodMs = period                \
+    };
+MEASUREMENT_CATALOGUE(DEFINE_UNIT_DESCRIPTION)
+#undef DEFINE_UNIT_DESCRIPTION
 
-UnitDescription EffectivePowerL1 = {
-    .metID = POWER_EFFECTIVE_L1,
-    .unit = "W",
-    .description = "Effective Power, L1",
-    .scalingFactor = 100,
-    .isUnsigned = false
+#define CATALOGUE_ENTRY(name, id, ...) [id] = &name,
+/// All UnitDescriptions of the AC measurement collection indexed by their measurement ID, NULL for unknown IDs
+const UnitDescription *const UNIT_CATALOGUE[256] = {
+    MEASUREMENT_CATALOGUE(CATALOGUE_ENTRY)
 };
+#undef CATALOGUE_ENTRY
 
-UnitDescription EffectivePowerL2 = {
-    .metID = POWER_EFFECTIVE_L2,
-    .unit = "W",
-    .description = "Effective Power, L2",
-    .scalingFactor = 100,
-    .isUnsigned = false
-};
+/// Harmonics change slowly and a whole spectrum takes many cycles, so they are only sampled every 10 s
+#define HARMONIC_SAMPLE_PERIOD_MS 10000
 
-UnitDescription EffectivePowerL3 = {
-    .metID = POWER_EFFECTIVE_L3,
-    .unit = "W",
-    .description = "Effective Power, L3",
-    .scalingFactor = 100,
-    .isUnsigned = false
-};
+/**
+ * @brief Calls X(order, ...) for every order of the harmonic analysis collections
+ */
+#define HARMONIC_ORDERS(X, ...) \
+    X(1, __VA_ARGS__)  X(2, __VA_ARGS__)  X(3, __VA_ARGS__)  X(4, __VA_ARGS__)  X(5, __VA_ARGS__)  \
+    X(6, __VA_ARGS__)  X(7, __VA_ARGS__)  X(8, __VA_ARGS__)  X(9, __VA_ARGS__)  X(10, __VA_ARGS__) \
+    X(11, __VA_ARGS__) X(12, __VA_ARGS__) X(13, __VA_ARGS__) X(14, __VA_ARGS__) X(15, __VA_ARGS__) \
+    X(16, __VA_ARGS__) X(17, __VA_ARGS__) X(18, __VA_ARGS__) X(19, __VA_ARGS__) X(20, __VA_ARGS__) \
+    X(21, __VA_ARGS__) X(22, __VA_ARGS__) X(23, __VA_ARGS__) X(24, __VA_ARGS__) X(25, __VA_ARGS__) \
+    X(26, __VA_ARGS__) X(27, __VA_ARGS__) X(28, __VA_ARGS__) X(29, __VA_ARGS__) X(30, __VA_ARGS__) \
+    X(31, __VA_ARGS__) X(32, __VA_ARGS__) X(33, __VA_ARGS__) X(34, __VA_ARGS__) X(35, __VA_ARGS__) \
+    X(36, __VA_ARGS__) X(37, __VA_ARGS__) X(38, __VA_ARGS__) X(39, __VA_ARGS__) X(40, __VA_ARGS__) \
+    X(41, __VA_ARGS__)
 
-UnitDescription ReactivePowerN1 = {
-    .metID = POWER_REACTIVE_L1,
-    .unit = "VAR",
-    .description = "Reactive Power, L1",
-    .scalingFactor = 100,
-    .isUnsigned = false
-};
+/*
+ * The UnitDescriptions of the harmonic analysis collections are named after their phase and
+ * order, e.g. HarmonicL1Order5 for the 5th harmonic of the current in L1. The amplitudes are
+ * given in percent of the fundamental with a resolution of 0.01%.
+ */
+#define DEFINE_HARMONIC_DESCRIPTION(order, phase, collection) \
+    UnitDescription Harmonic##phase##Order##order = {   \
+        .colID = collection,                            \
+        .metID = order,                                 \
+        .unit = "%",                                    \
+        .description = "Current Harmonic " #order ", " #phase, \
+        .scaleExponent = 2,                             \
+        .scalingFactor = SCALE_FACTOR(2),               \
+        .isUnsigned = true,                             \
+        .absoluteDeadband = 0.1,                        \
+        .relativeDeadband = 0,                          \
+        .aggregationWindowMs = 0,                       \
+        .samplePeriodMs = HARMONIC_SAMPLE_PERIOD_MS     \
+    };
+HARMONIC_ORDERS(DEFINE_HARMONIC_DESCRIPTION, L1, HARMONIC_ANALYSIS_L1)
+HARMONIC_ORDERS(DEFINE_HARMONIC_DESCRIPTION, L2, HARMONIC_ANALYSIS_L2)
+HARMONIC_ORDERS(DEFINE_HARMONIC_DESCRIPTION, L3, HARMONIC_ANALYSIS_L3)
+#undef DEFINE_HARMONIC_DESCRIPTION
 
-UnitDescription ReactivePowerN2 = {
-    .metID = POWER_REACTIVE_L2,
-    .unit = "VAR",
-    .description = "Reactive Power, L2",
-    .scalingFactor = 100,
-    .isUnsigned = false
+#define HARMONIC_ENTRY(order, phase, ...) [order] = &Harmonic##phase##Order##order,
+/// All UnitDescriptions of the harmonic analysis collections indexed by phase and order
+const UnitDescription *const HARMONIC_CATALOGUE[HARMONIC_PHASE_COUNT][HARMONIC_MAX_ORDER + 1] = {
+    { HARMONIC_ORDERS(HARMONIC_ENTRY, L1) },
+    { HARMONIC_ORDERS(HARMONIC_ENTRY, L2) },
+    { HARMONIC_ORDERS(HARMONIC_ENTRY, L3) }
 };
+#undef HARMONIC_ENTRY
 
-UnitDescription ReactivePowerN3 = {
-    .metID = POWER_REACTIVE_L3,
-    .unit = "VAR",
-    .description = "Reactive Power, L3",
-    .scalingFactor = 100,
-    .isUnsigned = false
-};
+/**
+ * @brief Looks up the UnitDescription of a measurement in the catalogue
+ *
+ * @param[in] colID The collection of the measurement @see COL_ID
+ * @param[in] id The measurement ID within the collection
+ * @retval A pointer to the UnitDescription, or NULL if the measurement is unknown
+ */
+const UnitDescription *find_catalogue_entry(uint8_t colID, uint8_t id) {
+    if (colID == AC_MEASUREMENT) {
+        return UNIT_CATALOGUE[id];
+    }
+    if (is_harmonic_collection(colID) && id <= HARMONIC_MAX_ORDER) {
+        return HARMONIC_CATALOGUE[colID - HARMONIC_ANALYSIS_L1][id];
+    }
+    return NULL;
+}
 
-UnitDescription ApparentPowerL1 = {
-    .metID = POWER_APPARENT_L1,
-    .unit = "VAR",
-    .description = "Apparent Power, L1",
-    .scalingFactor = 100,
-    .isUnsigned = true
-};
+/**
+ * @brief The name of a UnitDescription of the catalogue, as used in the configuration file
+ */
+typedef struct CatalogueName {
+    const char *name;
+    const UnitDescription *description;
+} CatalogueName;
 
-UnitDescription ApparentPowerL2 = {
-    .metID = POWER_APPARENT_L2,
-    .unit = "VAR",
-    .description = "Apparent Power, L2",
-    .scalingFactor = 100,
-    .isUnsigned = true
+#define CATALOGUE_NAME_ENTRY(name, ...) { #name, &name },
+/// All UnitDescriptions of the AC measurement collection by their variable name
+const CatalogueName UNIT_CATALOGUE_NAMES[] = {
+    MEASUREMENT_CATALOGUE(CATALOGUE_NAME_ENTRY)
 };
+#undef CATALOGUE_NAME_ENTRY
 
-UnitDescription ApparentPowerL3 = {
-    .metID = POWER_APPARENT_L3,
-    .unit = "VAR",
-    .description = "Apparent Power, L3",
-    .scalingFactor = 100,
-    .isUnsigned = true
-};
+/**
+ * @brief Looks up the UnitDescription of a measurement in the catalogue by its variable name
+ *
+ * Harmonics are named like HarmonicL1Order5 @see DEFINE_HARMONIC_DESCRIPTION. This is only
+ * meant for reading the configuration, so a linear search is fine.
+ *
+ * @param[in] name The name of the measurement
+ * @retval A pointer to the UnitDescription, or NULL if the measurement is unknown
+ */
+const UnitDescription *find_catalogue_entry_by_name(const char *name) {
+    for (size_t i = 0; i < sizeof(UNIT_CATALOGUE_NAMES) / sizeof(CatalogueName); i++) {
+        if (strcmp(UNIT_CATALOGUE_NAMES[i].name, name) == 0) {
+            return UNIT_CATALOGUE_NAMES[i].description;
+        }
+    }
+    unsigned phase, order;
+    int length = 0;
+    if (sscanf(name, "HarmonicL%1uOrder%u%n", &phase, &order, &length) == 2 && name[length] == '\0'
+        && phase >= 1 && phase <= HARMONIC_PHASE_COUNT && order <= HARMONIC_MAX_ORDER) {
+        return HARMONIC_CATALOGUE[phase - 1][order];
+    }
+    return NULL;
+}
 
 #endif
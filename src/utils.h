@@ -19,6 +19,13 @@ typedef enum ErrorCode {
     ERROR_NO_MODULES,
     ERROR_MQTT_MSG_CREATION_FAILED,
     ERROR_MQTT_MSG_SEND_FAILED,
+    ERROR_THREAD_CREATION_FAILED,
+    ERROR_TOO_MANY_MEASUREMENTS,
+    ERROR_TIMER_FAILED,
+    ERROR_REALTIME_SETUP_FAILED,
+    ERROR_CONFIG_INVALID,
+    ERROR_SPOOL_FAILED,
+    ERROR_SNAPSHOT_FAILED,
 } ErrorCode;
 
 /**